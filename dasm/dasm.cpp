@@ -26,16 +26,17 @@
 #include <iostream>
 #include <sstream>
 
-void assemble(const std::string& filename, bool generateListing)
+void assemble(const std::string& filename, bool generateListing,
+              bool generateImage)
 {
   std::string outputFilename(filename);
   if (outputFilename.find_last_of(".dls") != std::string::npos)
   {
-    outputFilename.back() = 'x';
+    outputFilename.back() = generateImage ? 'i' : 'x';
   }
   else
   {
-    outputFilename.append(".dlx");
+    outputFilename.append(generateImage ? ".dli" : ".dlx");
   }
 
   std::cout << "Assembling " << filename << " to " << outputFilename << std::endl;
@@ -47,14 +48,19 @@ void assemble(const std::string& filename, bool generateListing)
     return;
   }
 
-  std::ofstream output(outputFilename);
+  std::ofstream output(
+    outputFilename,
+    generateImage ? std::ios::out | std::ios::binary : std::ios::out);
   if (!output)
   {
     std::cerr << "Failed to open for write: " << outputFilename << std::endl;
     return;
   }
 
-  dlx::assembly::ObjectWriter writer(output);
+  dlx::assembly::ObjectWriter writer(
+    output,
+    generateImage ? dlx::assembly::ObjectWriter::Image :
+                    dlx::assembly::ObjectWriter::Absolute);
   dlx::assembly::Assembler assembler(filename, file, generateListing);
   assembler.assemble(writer);
   assembler.printSymbolTable();
@@ -125,6 +131,11 @@ int main(int argc, char* argv[])
   const size_t optionRelocatable =
     arguments.addOption('r', "relocatable",
                         "Generate relocatable machine code.");
+  const size_t optionImage =
+    arguments.addOption(
+      'b', "binary",
+      "Generates a binary image (.dli) rather than the .abs text.\n"
+      "demu loads it by copying it straight into memory.");
 
   const bool succeeded = arguments.parse(argc, argv);
   if (!succeeded) return 1;
@@ -143,6 +154,7 @@ int main(int argc, char* argv[])
   }
 
   const bool generateListing = arguments.provided(optionListing);
+  const bool generateImage = arguments.provided(optionImage);
 
   if (arguments.size() > 0)
   {
@@ -150,7 +162,7 @@ int main(int argc, char* argv[])
     std::for_each(
       arguments.begin(), arguments.end(),
       [=](const std::string& filename)
-      { assemble(filename, generateListing); });
+      { assemble(filename, generateListing, generateImage); });
     return 0;
   }
 
@@ -300,5 +312,32 @@ int main(int argc, char* argv[])
       std::cout << "PASSED" << std::endl;
     }
   }
+
+  // This is a test to make sure a binary image has the header, the segment
+  // table and then the machine code.
+  {
+    std::istringstream sample("m:\tclr r1\n\t.start m");
+    std::ostringstream output(std::ios::out | std::ios::binary);
+    {
+      dlx::assembly::ObjectWriter writer(output,
+                                         dlx::assembly::ObjectWriter::Image);
+      dlx::assembly::Assembler assembler("example", sample, false);
+      assembler.assemble(writer);
+    }
+
+    const std::string expected(
+      "DLXI\1\0\0\0\0\0\0\0\1\0\0\0"
+      "\0\0\0\0\4\0\0\0\x20\0\0\0\3\0\0\0"
+      "\x20\1\0\0", 36);
+    std::cout << "Object writer for a binary image" << std::endl;
+    if (output.str() == expected)
+    {
+      std::cout << "PASSED" << std::endl;
+    }
+    else
+    {
+      std::cerr << "Failed to generate the correct binary image" << std::endl;
+    }
+  }
   return 0;
 }
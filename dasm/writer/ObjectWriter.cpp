@@ -12,20 +12,45 @@
 
 #include "ObjectWriter.hpp"
 
-dlx::assembly::ObjectWriter::ObjectWriter(std::ostream& writer)
+#include <cstdint>
+
+namespace
+{
+  // Writes a 32-bit number in little-endian byte order.
+  void WriteWord(std::ostream& writer, uint32_t word)
+  {
+    const char bytes[] = {
+      static_cast<char>(word & 0xFF),
+      static_cast<char>((word >> 8) & 0xFF),
+      static_cast<char>((word >> 16) & 0xFF),
+      static_cast<char>((word >> 24) & 0xFF),
+    };
+    writer.write(bytes, sizeof(bytes));
+  }
+}
+
+dlx::assembly::ObjectWriter::ObjectWriter(std::ostream& writer, Format format)
 : myWriter(writer),
+  myFormat(format),
   myBytesWrittenToLine(0),
   myAddressOfLine(0),
   myStartAddress(0),
-  isStartAddressKnown(false)
+  isStartAddressKnown(false),
+  myImage()
 {
+  if (myFormat == Image) return;
+
   myWriter << ".abs" << std::endl;
   myWriter << std::hex << std::uppercase;
 }
 
 dlx::assembly::ObjectWriter::~ObjectWriter()
 {
-  if (isStartAddressKnown)
+  if (myFormat == Image)
+  {
+    WriteImage();
+  }
+  else if (isStartAddressKnown)
   {
     if (myBytesWrittenToLine != 0)
     {
@@ -43,6 +68,32 @@ void dlx::assembly::ObjectWriter::SetStartAddress(size_t startAddress)
   isStartAddressKnown = true;
 }
 
+void dlx::assembly::ObjectWriter::WriteImage()
+{
+  // The program is a single segment at address 0, starting on a 16 byte
+  // boundary after the header and the segment table.
+  const uint32_t headerSize = 16;
+  const uint32_t segmentSize = 16;
+  const uint32_t offset = (headerSize + segmentSize + 15) & ~15u;
+
+  myWriter.write("DLXI", 4);
+  WriteWord(myWriter, 1);
+  WriteWord(myWriter, static_cast<uint32_t>(myStartAddress));
+  WriteWord(myWriter, 1);
+
+  WriteWord(myWriter, 0);
+  WriteWord(myWriter, static_cast<uint32_t>(myImage.size()));
+  WriteWord(myWriter, offset);
+  WriteWord(myWriter, 3); // Executable and writable.
+
+  for (uint32_t i = headerSize + segmentSize; i < offset; ++i)
+  {
+    myWriter.put('\0');
+  }
+  myWriter.write(reinterpret_cast<const char*>(myImage.data()),
+                 myImage.size());
+}
+
 void dlx::assembly::ObjectWriter::PreByteWritten()
 {
   if (myBytesWrittenToLine == 16)
@@ -13,11 +13,21 @@
 // DESCRIPTION  : Provides a class for writing out machine code to an objec
 //                file.
 //
+//                The object file is either the .abs text format, with the
+//                address and up to 16 bytes in hexadecimal on each line, or
+//                a binary image which demu can copy straight into memory.
+//                An image is laid out as (all numbers 32-bit little-endian):
+//
+//                  "DLXI", version (1), start address, segment count
+//                  address, size, offset, flags   for each segment
+//                  the bytes of each segment
+//
 //===----------------------------------------------------------------------===//
 
 #include <type_traits>
 #include <iomanip>
 #include <ostream>
+#include <vector>
 
 namespace dlx
 {
@@ -25,14 +35,28 @@ namespace dlx
   {
     class ObjectWriter
     {
+    public:
+      enum Format
+      {
+        Absolute, // The .abs text format.
+        Image,    // The binary image format.
+      };
+
+    private:
       std::ostream& myWriter;
+      Format myFormat;
       size_t myBytesWrittenToLine;
       size_t myAddressOfLine;
       size_t myStartAddress;
       bool isStartAddressKnown;
 
+      // The bytes of an image, which are written once the start address is
+      // known as it comes before them.
+      std::vector<unsigned char> myImage;
+
     public:
-      ObjectWriter(std::ostream& writer);
+      // The writer must be opened in binary mode for an Image.
+      ObjectWriter(std::ostream& writer, Format format = Absolute);
       ~ObjectWriter();
 
       template<typename INTEGER_TYPE>
@@ -48,18 +72,31 @@ namespace dlx
       // an end of line or a space.
       void PreByteWritten();
 
+      void WriteByte(unsigned int byte)
+      {
+        if (myFormat == Image)
+        {
+          myImage.push_back(static_cast<unsigned char>(byte));
+          return;
+        }
+
+        PreByteWritten();
+        myWriter << std::setfill('0') << std::setw(2) << byte;
+      }
+
+      // Writes the header, the segment table and the contents of an image.
+      void WriteImage();
+
       template<typename INTEGER_TYPE>
       ObjectWriter& Out(INTEGER_TYPE value, std::true_type)
       {
         // Break down the integer into groups of two hex digits.
         for (size_t i = 8 * (sizeof(value) - 1); i > 0; i -= 8)
         {
-          PreByteWritten();
-          myWriter << std::setfill('0') << std::setw(2) << ((value >> i) & 0xFF);
+          WriteByte((value >> i) & 0xFF);
         }
 
-        PreByteWritten();
-        myWriter << std::setfill('0') << std::setw(2) << (value & 0xFF);
+        WriteByte(value & 0xFF);
         return *this;
       }
     };
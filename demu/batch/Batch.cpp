@@ -0,0 +1,465 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Batch
+// NAMESPACE    : dlx::batch
+// PURPOSE      : Provides running many programs from a manifest.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements reading the manifest and running the jobs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Batch.hpp"
+
+#include "Scheduler.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+  // Discards everything written to it.
+  //
+  // Running a machine writes to std::cout as the program starts and stops,
+  // which is pointed at this while the jobs run so the threads don't
+  // interleave it.
+  class NullBuffer : public std::streambuf
+  {
+  protected:
+    int overflow(int c) override { return traits_type::not_eof(c); }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override
+    {
+      return count;
+    }
+  };
+
+  // Parses a decimal or 0x-prefixed hexadecimal number, which must be the
+  // whole of text.
+  bool ParseNumber(const std::string& text, std::uint64_t* value)
+  {
+    if (text.empty() || text[0] == '-') return false;
+
+    char* end = nullptr;
+    *value = std::strtoull(text.c_str(), &end, 0);
+    return *end == '\0';
+  }
+
+  bool ParseSignedNumber(const std::string& text, std::int32_t* value)
+  {
+    std::uint64_t magnitude;
+    const bool negative = !text.empty() && text[0] == '-';
+    if (!ParseNumber(negative ? text.substr(1) : text, &magnitude) ||
+        magnitude > std::numeric_limits<std::uint32_t>::max())
+    {
+      return false;
+    }
+
+    const std::uint32_t bits = static_cast<std::uint32_t>(magnitude);
+    *value = static_cast<std::int32_t>(negative ? 0u - bits : bits);
+    return true;
+  }
+
+  // Splits "ADDRESS:VALUE" into its two parts.
+  bool SplitAddress(const std::string& text, std::uint32_t* address,
+                    std::string* value)
+  {
+    const std::size_t colon = text.find(':');
+    if (colon == std::string::npos) return false;
+
+    std::uint64_t number;
+    if (!ParseNumber(text.substr(0, colon), &number) ||
+        number > std::numeric_limits<std::uint32_t>::max())
+    {
+      return false;
+    }
+
+    *address = static_cast<std::uint32_t>(number);
+    *value = text.substr(colon + 1);
+    return true;
+  }
+
+  bool ParseBytes(const std::string& text, std::vector<unsigned char>* bytes)
+  {
+    if (text.empty() || text.length() % 2 != 0) return false;
+
+    for (std::size_t i = 0; i < text.length(); i += 2)
+    {
+      if (!std::isxdigit(text[i]) || !std::isxdigit(text[i + 1])) return false;
+      bytes->push_back(static_cast<unsigned char>(
+        std::strtoul(text.substr(i, 2).c_str(), nullptr, 16)));
+    }
+    return true;
+  }
+
+  // Creates a machine for the job from the snapshot of its program.
+  //
+  // Returns nullptr, having written the error to result, if it can't.
+  std::unique_ptr<dlx::hardware::DLXMachine> PrepareJob(
+    const dlx::batch::Job& job,
+    const dlx::hardware::MachineSnapshot* snapshot,
+    std::ostream& result)
+  {
+    result << job.program << ": ";
+
+    if (snapshot == nullptr)
+    {
+      result << "error: the program could not be loaded" << std::endl;
+      return nullptr;
+    }
+
+    std::unique_ptr<dlx::hardware::DLXMachine> prepared(
+      new dlx::hardware::DLXMachine(*snapshot));
+    dlx::hardware::DLXMachine& machine = *prepared;
+    machine.SetInstructionLimit(job.budget);
+
+    if (job.hasProgramCounter) machine.SetProgramCounter(job.programCounter);
+
+    for (auto value = job.registers.begin(); value != job.registers.end();
+         ++value)
+    {
+      machine.Registers()[value->first] = value->second;
+    }
+
+    for (auto write = job.writes.begin(); write != job.writes.end(); ++write)
+    {
+      for (std::size_t i = 0; i < write->bytes.size(); ++i)
+      {
+        const std::uint32_t address =
+          write->address + static_cast<std::uint32_t>(i);
+        dlx::hardware::MemoryBlock* const block = machine.block(address);
+        if (block == nullptr)
+        {
+          result << "error: writing outside the memory at 0x" << std::hex
+                 << address << std::dec << std::endl;
+          return nullptr;
+        }
+        block->storage[address - block->startAddress] = write->bytes[i];
+      }
+    }
+
+    if (!job.record.empty() || !job.replay.empty())
+    {
+      const bool record = !job.record.empty();
+      try
+      {
+        machine.SetInputLog(std::unique_ptr<dlx::hardware::InputLog>(
+          new dlx::hardware::InputLog(
+            (record ? job.record : job.replay).c_str(),
+            record ? dlx::hardware::InputLog::Mode::Record :
+                     dlx::hardware::InputLog::Mode::Replay)));
+      }
+      catch (const std::exception& error)
+      {
+        result << "error: " << (record ? job.record : job.replay) << ": "
+               << error.what() << std::endl;
+        return nullptr;
+      }
+    }
+
+    return prepared;
+  }
+
+  // Writes how the job's machine stopped, given the message of the
+  // exception it raised if it did, along with its registers and memory.
+  void ReportJob(const dlx::batch::Job& job,
+                 dlx::hardware::DLXMachine& machine,
+                 const char* error,
+                 std::ostream& result)
+  {
+    if (error)
+    {
+      result << "error: " << error;
+    }
+    else
+    {
+      result << (machine.IsHalted() ? "halt" : "budget");
+    }
+
+    result << " after " << machine.InstructionCount() << " instructions"
+           << std::endl;
+
+    result << " ";
+    for (int i = 0; i < 32; ++i)
+    {
+      result << " r" << i << '=' << machine.ConstRegisters()[i].value;
+    }
+    result << " pc=0x" << std::hex << machine.ProgramCounter() << std::dec
+           << std::endl;
+
+    for (auto dump = job.dumps.begin(); dump != job.dumps.end(); ++dump)
+    {
+      result << "  0x" << std::hex << std::setfill('0') << std::setw(8)
+             << dump->address << ':';
+      for (std::uint32_t i = 0; i < dump->size; ++i)
+      {
+        const std::uint32_t address = dump->address + i;
+        const dlx::hardware::MemoryBlock* const block = machine.block(address);
+        if (block == nullptr)
+        {
+          result << " --";
+        }
+        else
+        {
+          result << ' ' << std::setw(2)
+                 << static_cast<unsigned int>(
+                      block->storage[address - block->startAddress]);
+        }
+      }
+      result << std::dec << std::setfill(' ') << std::endl;
+    }
+  }
+
+  // Runs the job on a machine created from the snapshot of its program and
+  // returns the result as it is to be written out.
+  std::string RunJob(const dlx::batch::Job& job,
+                     const dlx::hardware::MachineSnapshot* snapshot,
+                     dlx::hardware::Engine engine)
+  {
+    std::ostringstream result;
+    std::unique_ptr<dlx::hardware::DLXMachine> machine =
+      PrepareJob(job, snapshot, result);
+    if (!machine) return result.str();
+
+    try
+    {
+      machine->run(engine);
+      ReportJob(job, *machine, nullptr, result);
+    }
+    catch (const std::exception& error)
+    {
+      ReportJob(job, *machine, error.what(), result);
+    }
+    return result.str();
+  }
+
+  // Runs the jobs, which all have the same program, in lockstep and sets the
+  // result of each.
+  void RunJobsInLockstep(const std::vector<dlx::batch::Job>& jobs,
+                         const std::vector<std::size_t>& indices,
+                         const dlx::hardware::MachineSnapshot* snapshot,
+                         std::vector<std::string>* results)
+  {
+    std::vector<std::ostringstream> streams(indices.size());
+    std::vector<std::unique_ptr<dlx::hardware::DLXMachine>> machines;
+    std::vector<dlx::hardware::DLXMachine*> lanes;
+    for (std::size_t i = 0; i < indices.size(); ++i)
+    {
+      machines.push_back(PrepareJob(jobs[indices[i]], snapshot, streams[i]));
+      if (machines.back()) lanes.push_back(machines.back().get());
+    }
+
+    // Each job which raises an exception stops there on its own, while the
+    // rest of them carry on.
+    std::vector<std::exception_ptr> errors(lanes.size());
+    try
+    {
+      dlx::hardware::RunLockstep(lanes.data(), lanes.size(), errors.data());
+    }
+    catch (...)
+    {
+      std::fill(errors.begin(), errors.end(), std::current_exception());
+    }
+
+    std::size_t lane = 0;
+    for (std::size_t i = 0; i < indices.size(); ++i)
+    {
+      if (machines[i])
+      {
+        std::string error;
+        try
+        {
+          if (errors[lane]) std::rethrow_exception(errors[lane]);
+        }
+        catch (const std::exception& exception)
+        {
+          error = exception.what();
+        }
+        ++lane;
+
+        ReportJob(jobs[indices[i]], *machines[i],
+                  error.empty() ? nullptr : error.c_str(), streams[i]);
+      }
+      (*results)[indices[i]] = streams[i].str();
+    }
+  }
+}
+
+std::vector<dlx::batch::Job> dlx::batch::ReadManifest(std::istream& manifest)
+{
+  std::vector<Job> jobs;
+  std::string line;
+  for (unsigned int lineNumber = 1; std::getline(manifest, line); ++lineNumber)
+  {
+    std::istringstream fields(line);
+    std::string field;
+    if (!(fields >> field) || field[0] == '#') continue;
+
+    Job job;
+    job.program = field;
+    job.budget = std::numeric_limits<std::uint64_t>::max();
+    job.hasProgramCounter = false;
+    job.programCounter = 0;
+
+    while (fields >> field)
+    {
+      const std::size_t equals = field.find('=');
+      const std::string name = field.substr(0, equals);
+      const std::string value =
+        (equals == std::string::npos) ? "" : field.substr(equals + 1);
+
+      bool valid = true;
+      std::uint64_t number = 0;
+      std::string rest;
+      if (equals == std::string::npos)
+      {
+        valid = false;
+      }
+      else if (name == "budget")
+      {
+        valid = ParseNumber(value, &job.budget);
+      }
+      else if (name == "pc")
+      {
+        valid = ParseNumber(value, &number) &&
+                number <= std::numeric_limits<std::uint32_t>::max();
+        job.hasProgramCounter = true;
+        job.programCounter = static_cast<std::uint32_t>(number);
+      }
+      else if (name == "record" || name == "replay")
+      {
+        // A job either records its input or replays it, not both.
+        valid = !value.empty() && job.record.empty() && job.replay.empty();
+        (name == "record" ? job.record : job.replay) = value;
+      }
+      else if (name.length() > 1 && name[0] == 'r')
+      {
+        std::int32_t registerValue;
+        valid = ParseNumber(name.substr(1), &number) && number < 32 &&
+                ParseSignedNumber(value, &registerValue);
+        if (valid)
+        {
+          job.registers.push_back(
+            std::make_pair(static_cast<unsigned int>(number), registerValue));
+        }
+      }
+      else if (name == "mem")
+      {
+        MemoryWrite write;
+        valid = SplitAddress(value, &write.address, &rest) &&
+                ParseBytes(rest, &write.bytes);
+        job.writes.push_back(write);
+      }
+      else if (name == "dump")
+      {
+        MemoryRange range;
+        valid = SplitAddress(value, &range.address, &rest) &&
+                ParseNumber(rest, &number) &&
+                number <= std::numeric_limits<std::uint32_t>::max();
+        range.size = static_cast<std::uint32_t>(number);
+        job.dumps.push_back(range);
+      }
+      else
+      {
+        valid = false;
+      }
+
+      if (!valid)
+      {
+        std::ostringstream message;
+        message << "line " << lineNumber << ": invalid field " << field;
+        throw std::invalid_argument(message.str());
+      }
+    }
+
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+void dlx::batch::RunBatch(
+  const std::vector<Job>& jobs,
+  const hardware::Configuration& configuration,
+  hardware::Engine engine,
+  LoadProgram load,
+  unsigned int workers,
+  std::ostream& output)
+{
+  // Load each program once, keeping a snapshot which the jobs fork from.
+  std::map<std::string, std::unique_ptr<hardware::MachineSnapshot>> programs;
+  for (auto job = jobs.begin(); job != jobs.end(); ++job)
+  {
+    if (programs.count(job->program) != 0) continue;
+
+    std::unique_ptr<hardware::MachineSnapshot>& snapshot =
+      programs[job->program];
+    hardware::DLXMachine machine(configuration);
+    if (load(job->program.c_str(), &machine))
+    {
+      snapshot.reset(new hardware::MachineSnapshot(machine.snapshot()));
+    }
+  }
+
+  std::vector<std::string> results(jobs.size());
+
+  NullBuffer discard;
+  std::streambuf* const standardOutput = std::cout.rdbuf(&discard);
+
+  if (engine == hardware::Engine::Lockstep)
+  {
+    // Each task is as many jobs for the same program as fit in the vectors.
+    std::vector<std::vector<std::size_t>> tasks;
+    std::map<std::string, std::size_t> filling;
+    for (std::size_t index = 0; index < jobs.size(); ++index)
+    {
+      const auto task = filling.find(jobs[index].program);
+      if (task != filling.end() &&
+          tasks[task->second].size() < hardware::LockstepWidth)
+      {
+        tasks[task->second].push_back(index);
+      }
+      else
+      {
+        filling[jobs[index].program] = tasks.size();
+        tasks.push_back(std::vector<std::size_t>(1, index));
+      }
+    }
+
+    RunInParallel(tasks.size(), workers, [&](std::size_t index)
+    {
+      const Job& job = jobs[tasks[index].front()];
+      RunJobsInLockstep(jobs, tasks[index],
+                        programs.find(job.program)->second.get(), &results);
+    });
+  }
+  else
+  {
+    RunInParallel(jobs.size(), workers, [&](std::size_t index)
+    {
+      const Job& job = jobs[index];
+      results[index] =
+        RunJob(job, programs.find(job.program)->second.get(), engine);
+    });
+  }
+
+  std::cout.rdbuf(standardOutput);
+
+  for (std::size_t index = 0; index < results.size(); ++index)
+  {
+    output << '[' << index << "] " << results[index];
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,92 @@
+#ifndef DLX_BATCH_HPP_
+#define DLX_BATCH_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Batch
+// NAMESPACE    : dlx::batch
+// PURPOSE      : Provides running many programs from a manifest.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : A manifest has a job on each line, which is the program to
+//                run followed by any of:
+//
+//                  budget=N          Stop after N instructions.
+//                  pc=ADDRESS        Start at ADDRESS rather than .start.
+//                  rN=VALUE          Set register N to VALUE.
+//                  mem=ADDRESS:BYTES Write the hexadecimal BYTES at ADDRESS.
+//                  dump=ADDRESS:SIZE Report the SIZE bytes at ADDRESS once
+//                                    the program has stopped.
+//                  record=FILE       Log the input the job reads to FILE.
+//                  replay=FILE       Give the job the input logged in FILE,
+//                                    see hardware/Replay.hpp.
+//
+//                Numbers may be given in decimal or as 0x followed by the
+//                hexadecimal digits. Blank lines and lines starting with #
+//                are ignored.
+//
+//                Each program is loaded once, then every job using it runs
+//                on its own machine forked from the loaded one.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../hardware/Machine.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dlx
+{
+  namespace batch
+  {
+    struct MemoryWrite
+    {
+      std::uint32_t address;
+      std::vector<unsigned char> bytes;
+    };
+
+    struct MemoryRange
+    {
+      std::uint32_t address;
+      std::uint32_t size;
+    };
+
+    struct Job
+    {
+      std::string program;
+      std::uint64_t budget;
+      bool hasProgramCounter;
+      std::uint32_t programCounter;
+      std::vector<std::pair<unsigned int, std::int32_t>> registers;
+      std::vector<MemoryWrite> writes;
+      std::vector<MemoryRange> dumps;
+      std::string record;
+      std::string replay;
+    };
+
+    // Loads the program into the machine, returning false if it could not.
+    typedef bool (*LoadProgram)(const char* filename,
+                                hardware::DLXMachine* machine);
+
+    // Reads the jobs from a manifest.
+    //
+    // Throws std::invalid_argument if a line is not a valid job.
+    std::vector<Job> ReadManifest(std::istream& manifest);
+
+    // Runs the jobs across the given number of threads and writes the result
+    // of each to output, in the same order as the jobs.
+    void RunBatch(const std::vector<Job>& jobs,
+                  const hardware::Configuration& configuration,
+                  hardware::Engine engine,
+                  LoadProgram load,
+                  unsigned int workers,
+                  std::ostream& output);
+  }
+}
+
+#endif
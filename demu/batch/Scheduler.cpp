@@ -0,0 +1,119 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Scheduler
+// NAMESPACE    : dlx::batch
+// PURPOSE      : Provides running of independent tasks across threads.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the work-stealing deques.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Scheduler.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  // The tasks of a single worker.
+  //
+  // The tasks are whole programs, so a lock per deque costs nothing compared
+  // to running one.
+  class TaskDeque
+  {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+
+  public:
+    void push(std::size_t task)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(task);
+    }
+
+    // Take the task most recently pushed, for the worker which owns this.
+    bool pop(std::size_t* task)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (tasks.empty()) return false;
+      *task = tasks.back();
+      tasks.pop_back();
+      return true;
+    }
+
+    // Take the task least recently pushed, for the other workers.
+    bool steal(std::size_t* task)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (tasks.empty()) return false;
+      *task = tasks.front();
+      tasks.pop_front();
+      return true;
+    }
+  };
+}
+
+void dlx::batch::RunInParallel(
+  std::size_t count, unsigned int workers,
+  const std::function<void(std::size_t)>& task)
+{
+  if (workers == 0) workers = 1;
+
+  std::vector<std::unique_ptr<TaskDeque>> deques;
+  for (unsigned int worker = 0; worker < workers; ++worker)
+  {
+    deques.emplace_back(new TaskDeque());
+  }
+
+  // Give each worker a contiguous share of the tasks, pushed in reverse so
+  // the worker performs them in order.
+  for (unsigned int worker = 0; worker < workers; ++worker)
+  {
+    const std::size_t first = count * worker / workers;
+    const std::size_t last = count * (worker + 1) / workers;
+    for (std::size_t index = last; index > first; --index)
+    {
+      deques[worker]->push(index - 1);
+    }
+  }
+
+  // No tasks are added once the workers have started, so once a worker finds
+  // every deque empty there is nothing left for it to do.
+  const auto work = [&deques, &task, workers](unsigned int worker)
+  {
+    std::size_t index;
+    for (;;)
+    {
+      bool found = deques[worker]->pop(&index);
+      for (unsigned int i = 1; !found && i < workers; ++i)
+      {
+        found = deques[(worker + i) % workers]->steal(&index);
+      }
+
+      if (!found) return;
+      task(index);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int worker = 1; worker < workers; ++worker)
+  {
+    threads.emplace_back(work, worker);
+  }
+
+  work(0);
+
+  for (auto thread = threads.begin(); thread != threads.end(); ++thread)
+  {
+    thread->join();
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
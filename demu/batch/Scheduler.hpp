@@ -0,0 +1,37 @@
+#ifndef DLX_SCHEDULER_HPP_
+#define DLX_SCHEDULER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Scheduler
+// NAMESPACE    : dlx::batch
+// PURPOSE      : Provides running of independent tasks across threads.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Each worker has a deque of tasks, which starts with an even
+//                share of them. A worker takes tasks from the back of its own
+//                deque and once that is empty steals from the front of the
+//                others, so a worker that drew long tasks is helped out by
+//                the ones that drew short tasks.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <functional>
+
+namespace dlx
+{
+  namespace batch
+  {
+    // Calls task(index) for each index in [0, count) using the given number
+    // of threads, returning once every call has returned.
+    //
+    // The task must not throw.
+    void RunInParallel(std::size_t count, unsigned int workers,
+                       const std::function<void(std::size_t)>& task);
+  }
+}
+
+#endif
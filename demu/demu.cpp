@@ -14,19 +14,40 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+#include "hardware/Checkpoint.hpp"
 #include "hardware/Instruction.hpp"
 #include "hardware/Instructions.hpp"
 #include "hardware/Machine.hpp"
+#include "hardware/RingBuffer.hpp"
+#include "hardware/Trace.hpp"
 
+#include "batch/Batch.hpp"
+
+#include "loader/Absolute.hpp"
+#include "loader/Image.hpp"
+#include "loader/MappedFile.hpp"
+
+#include "recompiler/Recompiler.hpp"
+
+#include "timing/BranchPredictor.hpp"
+#include "timing/Cache.hpp"
+#include "timing/Pipeline.hpp"
+
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <limits>
 #include <memory>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
-#include <stdio.h>
-
 std::uint32_t SwapBytes(std::uint32_t word)
 {
   // Take into account the different endianness.
@@ -36,207 +57,312 @@ std::uint32_t SwapBytes(std::uint32_t word)
 }
 
 dlx::hardware::DLXMachine::DLXMachine(const Configuration& configuration)
-: mem(configuration.startAddress, configuration.endAddress),
-  programCounter(std::numeric_limits<unsigned int>::max())
+: mem(configuration.startAddress, configuration.endAddress,
+      configuration.pageSize),
+  programCounter(std::numeric_limits<unsigned int>::max()),
+  instructionCount(0),
+  instructionLimit(std::numeric_limits<std::uint64_t>::max()),
+  nativeModified(false),
+  checkpoint(nullptr),
+  inputLog()
+{
+}
+
+dlx::hardware::DLXMachine::DLXMachine(const MachineSnapshot& snapshot)
+: mem(*snapshot.memory),
+  floatRegisters(snapshot.floatRegisters),
+  programCounter(snapshot.programCounter),
+  instructionRegister(snapshot.instructionRegister),
+  processorStatusWord(snapshot.processorStatusWord),
+  exceptionAddress(snapshot.exceptionAddress),
+  exceptionBase(snapshot.exceptionBase),
+  floatingPointStatus(snapshot.floatingPointStatus),
+  instructionCount(snapshot.instructionCount),
+  instructionLimit(std::numeric_limits<std::uint64_t>::max()),
+  nativeModified(false),
+  memorySnapshot(snapshot.memory),
+  checkpoint(nullptr),
+  inputLog()
+{
+  std::copy(snapshot.registers, snapshot.registers + 32, registers);
+}
+
+dlx::hardware::DLXMachine::~DLXMachine()
+{
+}
+
+dlx::hardware::MachineSnapshot dlx::hardware::DLXMachine::snapshot()
+{
+  if (!memorySnapshot)
+  {
+    memorySnapshot = std::make_shared<const MemorySnapshot>(mem.snapshot());
+  }
+
+  MachineSnapshot snapshot;
+  snapshot.memory = memorySnapshot;
+  std::copy(registers, registers + 32, snapshot.registers);
+  snapshot.floatRegisters = floatRegisters;
+  snapshot.programCounter = programCounter;
+  snapshot.instructionRegister = instructionRegister;
+  snapshot.processorStatusWord = processorStatusWord;
+  snapshot.exceptionAddress = exceptionAddress;
+  snapshot.exceptionBase = exceptionBase;
+  snapshot.floatingPointStatus = floatingPointStatus;
+  snapshot.instructionCount = instructionCount;
+  return snapshot;
+}
+
+std::unique_ptr<dlx::hardware::DLXMachine> dlx::hardware::DLXMachine::fork()
 {
+  return std::unique_ptr<DLXMachine>(new DLXMachine(snapshot()));
 }
 
 void dlx::hardware::DLXMachine::step()
 {
-  // Find the memory block for the starting address.
-  const MemoryBlock* const block = memory()[programCounter.value];
-  if (block == nullptr) 
+  // The instruction may store to memory.
+  memorySnapshot.reset();
+
+  // Look-up the next instruction, which is decoded the first time it is
+  // reached.
+  const DecodedInstruction* const instruction =
+    decodeCache(mem, programCounter.value);
+  if (instruction == nullptr)
   {
-    throw std::out_of_range("The program counter is pointing to memory "
-                            "outside the addressable range.");
+    Memory::fault(programCounter.value, 4, MemoryAccess::Fetch);
   }
-  
-  std::cout << "Executing " << programCounter.value << " (0x"
-            << std::hex << programCounter.value<< ")" << std::endl;
 
-  const unsigned char* const rawBlock = block->storage.get();
-  const auto typedBlock =
-    reinterpret_cast<const std::uint32_t* const>(rawBlock);
-    
-  const auto pc =
-    (programCounter.value - block->startAddress) / sizeof(std::uint32_t);
+  TraceInstruction(*this, programCounter.value, *instruction);
+  if (profile) profile->count(mem, programCounter.value);
+
+  // The address is worked out first as a load may replace its base register.
+  Execution execution = {
+    instruction, static_cast<std::uint32_t>(programCounter.value), 0, 0,
+  };
+  if (!observers.empty() && (isLoad(*instruction) || isStore(*instruction)))
+  {
+    execution.effectiveAddress =
+      registers[instruction->ri].value + instruction->immediate;
+  }
 
-  // Look-up the next instruction from memory.  
-  instructionRegister.value = SwapBytes(typedBlock[pc]);
+  instructionRegister.value = instruction->word;
+  ++instructionCount;
 
   // Increment the program counter.
   programCounter.value += 4;
-  
-  // Decode the instruction.
-  const auto opcode = instructionRegister.formatI.opcode;
-  
-//  if (opcode == 0 || opcode == 1)
-//  {
-//    // The instruction is a register-to-register instruction.
-//    std::cout << "ri=" << instructionRegister.formatR.ri << std::endl;
-//    std::cout << "rj=" << instructionRegister.formatR.rj << std::endl;
-//    std::cout << "rk=" << instructionRegister.formatR.rk << std::endl;
-//    std::cout << "mod=" << instructionRegister.formatR.modifier << std::endl;
-//  }
-//  else if (opcode == 2 || opcode == 3 || opcode == 16 || opcode == 17)
-//  {
-//    // The instruction is a long-immediate instruction.
-//    std::cout << "Lsgn=" << instructionRegister.formatL.Lsgn << std::endl;
-//  }
-//  else
-//  {
-//    // The instruction is a immediate instruction.
-//    std::cout << "ri=" << instructionRegister.formatI.ri << std::endl;
-//    std::cout << "rj=" << instructionRegister.formatI.rj << std::endl;
-//    std::cout << "Ksgn=" << instructionRegister.formatI.Ksgn << std::endl;
-//    std::cout << "Kusn=" << instructionRegister.formatI.Kusn << std::endl;
-//  }
-
-//  std::cout << "Instruction: 0x" 
-//            << std::hex << std::setw(8) << std::setfill('0')
-//            << instructionRegister.value
-//            << " opcode=" << std::dec << (int)opcode
-//            << std::endl;
-
-  if (Instructions[opcode])
-  {
-    Instructions[opcode](this);
+
+  instruction->execute(this, *instruction);
+
+  TraceResult(*this, *instruction);
+
+  if (!observers.empty())
+  {
+    execution.nextAddress = programCounter.value;
+    for (auto observer = observers.begin(); observer != observers.end();
+         ++observer)
+    {
+      (*observer)->executed(execution);
+    }
   }
 }
 
-void dlx::hardware::DLXMachine::run()
+std::int32_t dlx::hardware::DLXMachine::input(InputKind kind)
 {
-  std::cout << "> Program starting" << std::endl;
-
-  instructionRegister.value = 0;
-
-  // Keep stepping until the halt instruction is raised.
-  while (instructionRegister.formatR.opcode != 0 ||
-         instructionRegister.formatR.modifier != 1)
+  if (inputLog && inputLog->mode() == InputLog::Mode::Replay)
   {
-    step();
+    return inputLog->replay(instructionCount, kind);
   }
-  
-  std::cout << " r1=" << registers[1].value
-            << " r2=" << registers[2].value
-            << " r3=" << registers[3].value
-            << " r4=" << registers[4].value
-            << std::endl;
 
-  std::cout << "< Program terminated" << std::endl;  
+  const std::int32_t value = ReadHostInput(kind);
+  if (inputLog) inputLog->record(instructionCount, kind, value);
+  return value;
 }
 
-#include <fstream>
-#include <string>
-#include <cctype>
+void dlx::hardware::DLXMachine::AddObserver(Observer* observer)
+{
+  observers.push_back(observer);
+}
+
+void dlx::hardware::DLXMachine::RemoveObserver(Observer* observer)
+{
+  observers.erase(std::remove(observers.begin(), observers.end(), observer),
+                  observers.end());
+}
 
-void LoadDlxFile(const char *filename, dlx::hardware::DLXMachine* machine)
+void dlx::hardware::DLXMachine::codeModified(
+  std::uint32_t address, std::uint32_t size)
 {
-  std::ifstream file(filename);
-  if (!file.is_open())
+  // Instructions are always aligned on a 4-byte boundary.
+  const std::uint32_t endAddress = address + size;
+  for (std::uint32_t word = address & ~3u; word < endAddress; word += 4)
   {
-      std::cerr << "error: could not read " << filename << std::endl;
-      return;
-  }
-  
-  std::string line;
-  std::getline(file, line);
-  if (line != std::string(".abs")) {
-    std::cerr << "error: invalid file " << filename << ". It must have .abs on "
-                 "the first line, instead it had " << line << std::endl;
-    return;
+    decodeCache.invalidate(word);
   }
+  blocks.invalidate(address, endAddress);
+  if (native && native->covers(address, endAddress)) nativeModified = true;
+}
 
-  typedef dlx::hardware::MemoryBlock MemoryBlock;
+void dlx::hardware::DLXMachine::SetNativeCode(
+  std::shared_ptr<const NativeCode> code)
+{
+  native = std::move(code);
+  nativeModified = false;
+  if (!native) return;
 
-  const auto findBlock = [&machine](unsigned int address) -> MemoryBlock*
+  const auto& ranges = native->Ranges();
+  for (auto range = ranges.begin(); range != ranges.end(); ++range)
   {
-    MemoryBlock* const block = machine->memory()[address];
-    if (block == nullptr)
+    for (std::uint64_t address = range->first; address < range->second;
+         address += MemoryBlock::CodePageBytes)
     {
-      std::cerr << "error: tried loading data outside any of the valid "
-                   "memory ranges."
-                << std::endl;
+      if (MemoryBlock* const block =
+            mem[static_cast<std::uint32_t>(address)])
+      {
+        block->markCode(static_cast<std::uint32_t>(address));
+      }
     }
-    return block;
-  };
+    if (MemoryBlock* const block = mem[range->second - 1])
+    {
+      block->markCode(range->second - 1);
+    }
+  }
+}
 
-  MemoryBlock* currentBlock = nullptr;
-  while (!file.eof())
-  {
-    std::getline(file, line);
+void dlx::hardware::DLXMachine::run(Engine engine)
+{
+  std::cout << "> Program starting" << std::endl;
 
-    if (line.empty()) continue;
+  memorySnapshot.reset();
 
-    unsigned int address = 0;
-    if (sscanf(line.c_str(), "%08X", &address) == 1)
-    {
-      if (currentBlock == nullptr || !currentBlock->contains(address))
-      {
-        // Find the block that contains this address.
-        currentBlock = findBlock(address);
-        if (currentBlock == nullptr) return;
-      }
+  instructionRegister.value = 0;
 
-      // Read the data on the line.
-      unsigned char* rawStorage = currentBlock->storage.get();
-      rawStorage += address - currentBlock->startAddress;
-      for (std::size_t i = 8; i < line.length(); ++i)
+  // Keep going until the halt instruction is raised, as there is nothing
+  // further to do for a trap yet it carries on after one.
+  const auto runUntilHalt =
+    [this](const DecodedInstruction* (*runner)(DLXMachine*))
+    {
+      while (instructionCount < instructionLimit)
       {
-        const auto c = std::toupper(line[i]);
-        if (std::isspace(c)) continue;
-
-        if (!std::isxdigit(c))
-        {
-          std::cerr << "error: expected a white-space or a hexadecimal digit."
-                    << std::endl;
-          return;
-        }
-        else
+        const DecodedInstruction* const instruction = runner(this);
+        if (instruction == nullptr)
         {
-          // For simplicity assume they are always in pairs.
-          // I.e a hexadecimal digit is followed by another one.
-          const auto c2 = std::toupper(line[i + 1]);
-          ++i;
-          if (!std::isxdigit(c2))
-          {
-            std::cerr << "error: expected a hexadecimal digit." << std::endl;
-            return;
-          }
-
-          int data;
-          if (c >= 'A' && c <= 'F') data = (10 + (c - 'A')) << 4;
-          else data = (c - '0') << 4;
-
-          if (c2 >= 'A' && c2 <= 'F') data += (10 + (c2 - 'A'));
-          else data += (c2 - '0');
-
-          *rawStorage = static_cast<unsigned char>(data);
-          ++rawStorage;
+          Memory::fault(programCounter.value, 4, MemoryAccess::Fetch);
         }
+
+        if (instruction->operation == operationIndex(0, 1)) break;
       }
+    };
+
+  // With a checkpoint to save to the machine runs a slice of instructions at
+  // a time, and saves between them once one is due. The limit is put back
+  // however it stops.
+  struct LimitGuard
+  {
+    std::uint64_t* limit;
+    std::uint64_t value;
+    ~LimitGuard() { *limit = value; }
+  } const guard = { &instructionLimit, instructionLimit };
+  const std::uint64_t SliceInstructions = 1 << 24;
+  do
+  {
+    if (checkpoint)
+    {
+      instructionLimit =
+        std::min(guard.value, instructionCount + SliceInstructions);
     }
-    else if (line.compare(0, 6, ".start") == 0)
+
+    if (!observers.empty())
     {
-      // This line contains the starting address.
-      if (sscanf(line.c_str(), ".start %08X", &address) == 1)
+      // The observers are only told of what is performed by step().
+      while (!IsHalted() && instructionCount < instructionLimit)
       {
-        machine->SetProgramCounter(address);
+        step();
       }
-      else
+    }
+    // The vectors don't trace or count the instructions, so the machine
+    // runs as blocks instead.
+    else if (engine == Engine::Blocks ||
+             (engine == Engine::Lockstep && (IsTracing() || profile)))
+    {
+      runUntilHalt(RunBlocks);
+    }
+    else if (engine == Engine::Jit)
+    {
+      runUntilHalt(RunJit);
+    }
+    else if (engine == Engine::Native)
+    {
+      runUntilHalt(RunNative);
+    }
+    else if (engine == Engine::Lockstep)
+    {
+      DLXMachine* const machine = this;
+      RunLockstep(&machine, 1);
+    }
+    else
+    {
+#if DEMU_THREADED_DISPATCH
+      runUntilHalt(RunThreaded);
+#else
+      // Keep stepping until the halt instruction is raised.
+      while (!IsHalted() && instructionCount < instructionLimit)
       {
-        std::cerr << "error: expected start address but found "
-                  << line.substr(6) << std::endl;
+        step();
       }
+#endif
+    }
+
+    if (checkpoint && !IsHalted() && instructionCount < guard.value &&
+        checkpoint->due())
+    {
+      checkpoint->save(*this);
+    }
+  }
+  while (checkpoint && !IsHalted() && instructionCount < guard.value);
+
+  // Save where the run finished as well, so there is a checkpoint to restore
+  // even when it finished before the first one was due.
+  if (checkpoint) checkpoint->save(*this);
+  
+  std::cout << " r1=" << registers[1].value
+            << " r2=" << registers[2].value
+            << " r3=" << registers[3].value
+            << " r4=" << registers[4].value
+            << std::endl;
+
+  std::cout << "< Program terminated after " << std::dec << instructionCount
+            << " instructions" << std::endl;
+}
+
+#include <fstream>
+#include <string>
+
+bool LoadDlxFile(const char *filename, dlx::hardware::DLXMachine* machine)
+{
+  // A binary image is copied straight into memory, otherwise it is the .abs
+  // text.
+  try
+  {
+    const dlx::loader::MappedFile mapped(filename);
+    if (dlx::loader::IsImage(mapped.data(), mapped.size()))
+    {
+      dlx::loader::LoadImage(mapped.data(), mapped.size(), machine);
     }
     else
     {
-      std::cerr << "error: expected address of the form XXXXXX where X is a "
-                   "hexdecimal digit or .start XXXXXX" << std::endl;
+      dlx::loader::LoadAbsolute(mapped.data(), mapped.size(), machine);
     }
   }
+  catch (const std::exception& error)
+  {
+    std::cerr << "error: " << filename << ": " << error.what() << std::endl;
+    return false;
+  }
+
+  return true;
 }
 
+// The tests always check what they assert, even in a build without asserts.
+#undef NDEBUG
 #include <cassert>
 
 void tests()
@@ -267,6 +393,26 @@ void tests()
     std::cout << a.value << " " << b.value << std::endl;
   }
   
+  // The logical operations, lhi and the shifts by an immediate extend it
+  // with zero, and the rest by its sign.
+  {
+    const std::uint32_t unsignedWords[] = {
+      0x3022FFFF, // andi r2, r1, 0xFFFF
+      0x3422FFFF, // ori r2, r1, 0xFFFF
+      0x3822FFFF, // xori r2, r1, 0xFFFF
+      0x3C02FFFF, // lhi r2, 0xFFFF
+      0x5022FFFF, // slai r2, r1, 0xFFFF
+      0x5822FFFF, // srli r2, r1, 0xFFFF
+      0x5C22FFFF, // srai r2, r1, 0xFFFF
+    };
+    for (auto word : unsignedWords)
+    {
+      assert(dlx::hardware::decode(word).immediate == 0xFFFF);
+    }
+    assert(dlx::hardware::decode(0x2022FFFF).immediate == -1); // addi
+    assert(dlx::hardware::decode(0x6822FFFF).immediate == -1); // slti
+  }
+
   // Execute a simple DLX program that is equivelent to this:
   //
   //   sum = 0
@@ -278,6 +424,7 @@ void tests()
   //   halt. 
   dlx::hardware::Configuration config = {
     0x00000, 0x10000, // dsim new ram dsim.memory.Ram 00000 4000
+    dlx::hardware::PageSize::Normal,
   };
   dlx::hardware::DLXMachine machine(config);
 
@@ -292,6 +439,48 @@ void tests()
    };
 
   MemoryBlock* block = machine.block(0);
+  assert(machine.block(0xFFFF) == block);
+  assert(machine.block(0x10000) == nullptr);
+
+  // A second block, which starts part way through a page.
+  {
+    dlx::hardware::Memory memory(0x00000, 0x10000);
+    MemoryBlock* const second = memory.add(0x10800, 0x20000);
+    assert(memory[0x10000] == nullptr);
+    assert(memory[0x10800] == second);
+    assert(memory[0x1FFFF] == second);
+    assert(memory[0x0FFFF] != second);
+  }
+
+  // The whole address space, of which only the pages touched are committed.
+  {
+    dlx::hardware::Memory memory(0x00000, std::uint64_t(1) << 32);
+    MemoryBlock* const whole = memory[0xFFFFFFFF];
+    assert(whole == memory[0x00000000]);
+    whole->storage[0xFFFFFFFF] = 1;
+    assert(whole->storage[0x80000000] == 0);
+  }
+
+  // A fork shares the memory until either of them modifies it.
+  {
+    dlx::hardware::DLXMachine parent(config);
+    parent.block(0)->storage[0x100] = 1;
+    parent.Registers()[1] = 7;
+    std::unique_ptr<dlx::hardware::DLXMachine> child = parent.fork();
+    assert(child->block(0x100)->storage[0x100] == 1);
+    assert(child->ConstRegisters()[1] == 7);
+
+    child->block(0x100)->storage[0x100] = 2;
+    parent.block(0x100)->storage[0x200] = 3;
+    assert(parent.block(0x100)->storage[0x100] == 1);
+    assert(child->block(0x100)->storage[0x200] == 0);
+
+    // Forking again takes the parent's modification along.
+    std::unique_ptr<dlx::hardware::DLXMachine> second = parent.fork();
+    assert(second->block(0x100)->storage[0x100] == 1);
+    assert(second->block(0x100)->storage[0x200] == 3);
+  }
+
   std::memcpy(block->storage.get(), instructions, sizeof(std::uint32_t) * 7);
   
   machine.SetProgramCounter(0);
@@ -326,28 +515,1716 @@ void tests()
   assert(machine.ConstRegisters()[3] == 1);
   
   machine.run(); // keep going until we halt.
-}
 
-int main(int argc, const char *argv[])
-{
-  std::cout << "demu v0.1 by Donno" << std::endl;
-  if (argc < 2)
+  // Executing the same program as translated blocks should give the same
+  // result in the same number of instructions.
   {
-    std::cout << "usage: " << argv[0] << " filename" << std::endl;
-    return 0;
+    dlx::hardware::DLXMachine blockMachine(config);
+    std::memcpy(blockMachine.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    blockMachine.SetProgramCounter(0);
+    blockMachine.run(dlx::hardware::Engine::Blocks);
+
+    assert(blockMachine.ConstRegisters()[1] == machine.ConstRegisters()[1]);
+    assert(blockMachine.ConstRegisters()[2] == machine.ConstRegisters()[2]);
+    assert(blockMachine.InstructionCount() == machine.InstructionCount());
+
+    // Replace the increment of the sum with an increment of 4 then run it
+    // again, which must not use the old translation.
+    const std::uint32_t increment = SwapBytes(0x20210004);
+    std::memcpy(blockMachine.block(0)->storage.get() + 8, &increment,
+                sizeof(increment));
+    blockMachine.codeModified(8, sizeof(increment));
+    blockMachine.SetProgramCounter(0);
+    blockMachine.run(dlx::hardware::Engine::Blocks);
+    assert(blockMachine.ConstRegisters()[1] == 4000);
   }
- 
-  //tests();
 
-  dlx::hardware::Configuration config = {
-    0x00000, 0x10000, // dsim new ram dsim.memory.Ram 00000 4000
-  };
+  // Counting the instructions gives the number of times round the loop for
+  // each instruction in it, whichever way they are executed.
+  {
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+    };
+    for (auto engine : engines)
+    {
+      dlx::hardware::DLXMachine profiled(config);
+      std::memcpy(profiled.block(0)->storage.get(), instructions,
+                  sizeof(std::uint32_t) * 7);
+      profiled.SetProgramCounter(0);
+      profiled.EnableProfile();
+      profiled.run(engine);
 
-  dlx::hardware::DLXMachine machine(config);
+      const dlx::hardware::Profile* profile = profiled.InstructionProfile();
+      assert(profile->executed(0x00) == 1);
+      assert(profile->executed(0x08) == 1000);
+      assert(profile->executed(0x14) == 1000);
+      assert(profile->executed(0x18) == 1);
+      assert(profile->executed(0x1C) == 0);
+      assert(profile->executedOperation(8) == 2 + 2 * 1000); // addi
+      assert(profile->executedOperation(26) == 1000); // slti
+      assert(profile->executedOperation(65) == 1); // halt
 
-  std::cout << "Loading dlx: " << argv[1] << std::endl;
-  LoadDlxFile(argv[1], &machine);
-  
-  // Execute the program loaded into to machine.
-  machine.run();
+      // A run which stops part way round the loop counts up to where it
+      // stopped, and carries on counting from there.
+      dlx::hardware::DLXMachine stopped(config);
+      std::memcpy(stopped.block(0)->storage.get(), instructions,
+                  sizeof(std::uint32_t) * 7);
+      stopped.SetProgramCounter(0);
+      stopped.EnableProfile();
+      stopped.SetInstructionLimit(2003);
+      stopped.run(engine);
+      profile = stopped.InstructionProfile();
+      assert(profile->executed(0x08) == 501);
+      assert(profile->executed(0x0C) == 500);
+      assert(profile->executed(0x18) == 0);
+
+      stopped.SetInstructionLimit(std::numeric_limits<std::uint64_t>::max());
+      stopped.run(engine);
+      assert(profile->executed(0x08) == 1000);
+      assert(profile->executed(0x0C) == 1000);
+      assert(profile->executed(0x18) == 1);
+    }
+  }
+
+  // The loop stalls for the result of slti and throws away the instruction
+  // fetched after each taken branch. Without forwarding it also stalls for
+  // the addi before slti, and for the first addi once.
+  {
+    dlx::timing::PipelineConfiguration forwarding = {
+      true, dlx::timing::Stage::Decode,
+    };
+    dlx::timing::PipelineConfiguration noForwarding = {
+      false, dlx::timing::Stage::Decode,
+    };
+    dlx::timing::Pipeline pipelines[] = {
+      dlx::timing::Pipeline(forwarding),
+      dlx::timing::Pipeline(noForwarding),
+    };
+
+    dlx::hardware::DLXMachine timed(config);
+    std::memcpy(timed.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    timed.SetProgramCounter(0);
+    timed.AddObserver(&pipelines[0]);
+    timed.AddObserver(&pipelines[1]);
+    timed.run(dlx::hardware::Engine::Jit);
+
+    assert(timed.ConstRegisters()[1] == 3000);
+    assert(pipelines[0].InstructionCount() == 4003);
+    assert(pipelines[0].DataStalls() == 1000);
+    assert(pipelines[0].LoadStalls() == 0);
+    assert(pipelines[0].ControlStalls() == 999);
+    assert(pipelines[0].CycleCount() == 4003 + 4 + 1000 + 999);
+    assert(pipelines[1].DataStalls() == 4001);
+    assert(pipelines[1].ControlStalls() == 999);
+    assert(pipelines[1].CycleCount() == 4003 + 4 + 4001 + 999);
+
+    // A load is only forwarded from MEM, so the add after it waits a cycle.
+    const dlx::hardware::DecodedInstruction load =
+      dlx::hardware::decode(0x8C410000); // lw r1, 0(r2)
+    const dlx::hardware::DecodedInstruction add =
+      dlx::hardware::decode(0x00211820); // add r3, r1, r1
+    dlx::timing::Pipeline loadUse(forwarding);
+    const dlx::hardware::Execution first = { &load, 0x100, 0x104, 0x200 };
+    const dlx::hardware::Execution second = { &add, 0x104, 0x108, 0 };
+    loadUse.executed(first);
+    loadUse.executed(second);
+    assert(loadUse.LoadStalls() == 1);
+    assert(loadUse.DataStalls() == 0);
+    assert(loadUse.CycleCount() == 2 + 4 + 1);
+
+    // The multiply waits for its operands the same as an add does.
+    const dlx::hardware::DecodedInstruction set =
+      dlx::hardware::decode(0x20010003); // addi r1, r0, 3
+    const dlx::hardware::DecodedInstruction multiply =
+      dlx::hardware::decode(0x0421180E); // mult r3, r1, r1
+    dlx::timing::Pipeline multiplyUse(noForwarding);
+    const dlx::hardware::Execution setting = { &set, 0x100, 0x104, 0 };
+    const dlx::hardware::Execution multiplying = { &multiply, 0x104, 0x108, 0 };
+    multiplyUse.executed(setting);
+    multiplyUse.executed(multiplying);
+    assert(multiplyUse.DataStalls() == 2);
+
+    // The floating point registers and the fpsr are waited for the same as
+    // the general registers, with a double waiting for both of its pair.
+    const std::uint32_t floatHazards[][2] = {
+      { 0x04220010, 0x18000008 }, // eqf f1, f2; bfpt 8
+      { 0x00011834, 0x00632020 }, // movfp2i r3, f1; add r4, r3, r3
+      { 0x9C220000, 0x04422004 }, // ld f2, 0(r1); addd f4, f2, f2
+      { 0x00001835, 0x04422004 }, // movi2fp f3, r0; addd f4, f2, f2
+    };
+    const std::uint64_t floatStalls[][2] = {
+      { 1, 2 }, { 0, 2 }, { 1, 2 }, { 0, 2 },
+    };
+    for (int i = 0; i < 4; ++i)
+    {
+      const dlx::hardware::DecodedInstruction writer =
+        dlx::hardware::decode(floatHazards[i][0]);
+      const dlx::hardware::DecodedInstruction reader =
+        dlx::hardware::decode(floatHazards[i][1]);
+      const dlx::hardware::Execution writing = { &writer, 0x100, 0x104, 0 };
+      const dlx::hardware::Execution reading = { &reader, 0x104, 0x108, 0 };
+      dlx::timing::Pipeline hazards[] = {
+        dlx::timing::Pipeline(forwarding),
+        dlx::timing::Pipeline(noForwarding),
+      };
+      for (int j = 0; j < 2; ++j)
+      {
+        hazards[j].executed(writing);
+        hazards[j].executed(reading);
+        assert(hazards[j].DataStalls() + hazards[j].LoadStalls() ==
+               floatStalls[i][j]);
+      }
+    }
+  }
+
+  // The caches should keep the most recently used or first brought in lines,
+  // and write back the modified ones they replace.
+  {
+    using dlx::timing::Cache;
+    using dlx::timing::CacheConfiguration;
+    using dlx::timing::Replacement;
+    using dlx::timing::WritePolicy;
+
+    const CacheConfiguration parsed =
+      dlx::timing::ParseCacheConfiguration("32K,4,64,fifo,wt");
+    assert(parsed.size == 32 * 1024 && parsed.ways == 4);
+    assert(parsed.lineSize == 64);
+    assert(parsed.replacement == Replacement::FirstInFirstOut);
+    assert(parsed.writePolicy == WritePolicy::WriteThrough);
+    try
+    {
+      dlx::timing::ParseCacheConfiguration("32K,4,64,plru");
+      assert(false);
+    }
+    catch (const std::invalid_argument&) {}
+
+    // Two ways of four sets of 16 byte lines, so 0x00, 0x40 and 0x80 are in
+    // the same set.
+    const CacheConfiguration twoWay = {
+      128, 2, 16, Replacement::LeastRecentlyUsed, WritePolicy::WriteBack,
+    };
+    Cache leastRecent(twoWay, nullptr);
+    assert(!leastRecent.access(0x00, false));
+    assert(leastRecent.access(0x04, false));
+    assert(!leastRecent.access(0x40, false));
+    assert(leastRecent.access(0x00, false));
+    assert(!leastRecent.access(0x80, false));
+    assert(leastRecent.access(0x00, false));
+    assert(!leastRecent.access(0x40, false));
+
+    CacheConfiguration fifo = twoWay;
+    fifo.replacement = Replacement::FirstInFirstOut;
+    Cache firstIn(fifo, nullptr);
+    assert(!firstIn.access(0x00, false));
+    assert(!firstIn.access(0x40, false));
+    assert(firstIn.access(0x00, false));
+    assert(!firstIn.access(0x80, false));
+    assert(!firstIn.access(0x00, false));
+
+    const CacheConfiguration unified = {
+      1024, 4, 16, Replacement::LeastRecentlyUsed, WritePolicy::WriteBack,
+    };
+    Cache level2(unified, nullptr);
+    Cache level1(twoWay, &level2);
+    level1.access(0x00, true);
+    level1.access(0x40, false);
+    level1.access(0x80, false);
+    assert(level1.WriteBacks() == 1);
+    assert(level2.Accesses() == 4 && level2.Misses() == 3);
+
+    // Using the last of 16 ways makes it the most recent.
+    const CacheConfiguration sixteenWay = {
+      256, 16, 16, Replacement::LeastRecentlyUsed, WritePolicy::WriteBack,
+    };
+    Cache wide(sixteenWay, nullptr);
+    for (std::uint32_t line = 0; line < 16; ++line)
+    {
+      assert(!wide.access(line * 16, false));
+    }
+    assert(wide.access(0x00, false));
+    assert(!wide.access(0x100, false));
+    assert(wide.access(0x00, false));
+    assert(!wide.access(0x10, false));
+
+    // The loop is in two lines, which stay in the cache.
+    dlx::timing::CacheHierarchy caches(twoWay, twoWay, &unified);
+    dlx::hardware::DLXMachine cached(config);
+    std::memcpy(cached.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    cached.SetProgramCounter(0);
+    cached.AddObserver(&caches);
+    cached.run(dlx::hardware::Engine::Blocks);
+    assert(caches.InstructionCache().Accesses() == 4003);
+    assert(caches.InstructionCache().Misses() == 2);
+    assert(caches.DataCache().Accesses() == 0);
+    assert(caches.Level2Cache()->Misses() == 2);
+  }
+
+  // The branch at the end of the loop is taken all but the last time.
+  {
+    dlx::timing::BranchPredictors branches(16, 4);
+    branches.add(dlx::timing::CreatePredictor("not-taken"));
+    branches.add(dlx::timing::CreatePredictor("bimodal:4"));
+    branches.add(dlx::timing::CreatePredictor("gshare"));
+    branches.add(dlx::timing::CreatePredictor("tournament:8"));
+    try
+    {
+      dlx::timing::CreatePredictor("bimodal:25");
+      assert(false);
+    }
+    catch (const std::invalid_argument&) {}
+
+    dlx::hardware::DLXMachine predicted(config);
+    std::memcpy(predicted.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    predicted.SetProgramCounter(0);
+    predicted.AddObserver(&branches);
+    predicted.run(dlx::hardware::Engine::Interpreter);
+
+    assert(branches.ConditionalCount() == 1000);
+    assert(branches.Mispredictions(0) == 999);
+    assert(branches.Mispredictions(1) == 2);
+    assert(branches.Mispredictions(2) < 20);
+    assert(branches.Mispredictions(3) < 20);
+
+    // A return goes back to after the call, and a jump to a register goes
+    // where it did the last time.
+    const dlx::hardware::DecodedInstruction call =
+      dlx::hardware::decode(0x0C0000FC); // jal 0x100 + 4 + 0xFC
+    const dlx::hardware::DecodedInstruction back =
+      dlx::hardware::decode(0x4BE00000); // jr r31
+    const dlx::hardware::DecodedInstruction jump =
+      dlx::hardware::decode(0x4CA00000); // jalr r5
+    dlx::timing::TargetPredictor targets(16, 4);
+    assert(targets.resolve(call, 0x100, 0x200));
+    assert(targets.resolve(back, 0x204, 0x104));
+    assert(!targets.resolve(back, 0x108, 0x300));
+    assert(!targets.resolve(jump, 0x300, 0x400));
+    assert(!targets.resolve(back, 0x404, 0x308));
+    assert(targets.resolve(jump, 0x300, 0x400));
+    assert(targets.resolve(back, 0x404, 0x304));
+    assert(targets.ReturnCount() == 4 && targets.ReturnMisses() == 2);
+    assert(targets.IndirectCount() == 2 && targets.IndirectMisses() == 1);
+  }
+
+  // A binary image is copied into memory as it is, with the segment table
+  // checked before any of it is.
+  {
+    const unsigned char image[] = {
+      'D', 'L', 'X', 'I', 1, 0, 0, 0, 0x08, 0, 0, 0, 1, 0, 0, 0,
+      0x04, 0, 0, 0, 8, 0, 0, 0, 0x20, 0, 0, 0, 3, 0, 0, 0,
+      0x20, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x01,
+    };
+
+    dlx::hardware::DLXMachine loaded(config);
+    assert(dlx::loader::IsImage(image, sizeof(image)));
+    dlx::loader::LoadImage(image, sizeof(image), &loaded);
+    assert(loaded.ProgramCounter() == 0x08);
+    assert(std::memcmp(loaded.block(0)->storage.get() + 4, image + 32, 8) ==
+           0);
+
+    unsigned char truncated[sizeof(image)];
+    std::memcpy(truncated, image, sizeof(image));
+    truncated[20] = 9; // The segment is now a byte longer than the file.
+    try
+    {
+      dlx::loader::LoadImage(truncated, sizeof(truncated), &loaded);
+      assert(false);
+    }
+    catch (const std::invalid_argument&) {}
+
+    truncated[20] = 8;
+    truncated[19] = 0x10; // The segment is now past the end of memory.
+    try
+    {
+      dlx::loader::LoadImage(truncated, sizeof(truncated), &loaded);
+      assert(false);
+    }
+    catch (const std::out_of_range&) {}
+  }
+
+  // The .abs text is decoded the same whichever way a line is written and
+  // however it is split between the threads, and errors give their line.
+  {
+    const std::string text =
+      ".abs\n"
+      "00000000  20 01 00 05 20 02 00 0A 00 22 18 20 00 00 00 01\n"
+      "\n"
+      "00000010  de ad\tbe EF\r\n"
+      "00000014  0102 03\n"
+      ".start 00000008\n";
+    const unsigned char* const data =
+      reinterpret_cast<const unsigned char*>(text.data());
+
+    for (unsigned int threads = 1; threads <= 4; ++threads)
+    {
+      dlx::hardware::DLXMachine loaded(config);
+      dlx::loader::LoadAbsolute(data, text.size(), &loaded, threads);
+
+      const unsigned char expected[] = {
+        0x20, 0x01, 0x00, 0x05, 0x20, 0x02, 0x00, 0x0A,
+        0x00, 0x22, 0x18, 0x20, 0x00, 0x00, 0x00, 0x01,
+        0xDE, 0xAD, 0xBE, 0xEF, 0x01, 0x02, 0x03,
+      };
+      assert(std::memcmp(loaded.block(0)->storage.get(), expected,
+                         sizeof(expected)) == 0);
+      assert(loaded.ProgramCounter() == 0x08);
+    }
+
+    const auto errorFrom = [&config](const std::string& text) -> std::string
+    {
+      dlx::hardware::DLXMachine loaded(config);
+      try
+      {
+        dlx::loader::LoadAbsolute(
+          reinterpret_cast<const unsigned char*>(text.data()), text.size(),
+          &loaded, 2);
+      }
+      catch (const std::out_of_range& error)
+      {
+        return std::string("range ") + error.what();
+      }
+      catch (const std::invalid_argument& error)
+      {
+        return error.what();
+      }
+      return std::string();
+    };
+
+    assert(errorFrom("abs\n").compare(0, 7, "line 1:") == 0);
+    assert(errorFrom(".abs\n00000000  20\n\n\n00000004  0G\n")
+             .compare(0, 7, "line 5:") == 0);
+    assert(errorFrom(
+      ".abs\n00000000  20 01 00 05 20 02 00 0A 00 22 18 20 00 00 00 0Z\n")
+             .compare(0, 7, "line 2:") == 0);
+    assert(errorFrom(".abs\n00000000  20\n0000000  20\n")
+             .compare(0, 7, "line 3:") == 0);
+    assert(errorFrom(".abs\n0000FFFF  20 01\n")
+             .compare(0, 13, "range line 2:") == 0);
+  }
+
+  // As should compiling the blocks to native code.
+  {
+    dlx::hardware::DLXMachine jitMachine(config);
+    std::memcpy(jitMachine.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    jitMachine.SetProgramCounter(0);
+    jitMachine.run(dlx::hardware::Engine::Jit);
+
+    assert(jitMachine.ConstRegisters()[1] == machine.ConstRegisters()[1]);
+    assert(jitMachine.ConstRegisters()[2] == machine.ConstRegisters()[2]);
+    assert(jitMachine.InstructionCount() == machine.InstructionCount());
+  }
+
+  // Machines in lockstep which branch different ways must each end up the
+  // same as if they were run on their own.
+  {
+    const std::uint32_t loop[] = {
+      SwapBytes(0x20010000), // sum = 0   (r1)
+      SwapBytes(0x20210003), // sum = sum + 3
+      SwapBytes(0x28A50001), // n = n - 1 (r5)
+      SwapBytes(0x14A0FFF4), // if n != 0 then goto instruction 2.
+      SwapBytes(0x00000001), // halt
+    };
+
+    dlx::hardware::DLXMachine parent(config);
+    std::memcpy(parent.block(0)->storage.get(), loop, sizeof(loop));
+    parent.SetProgramCounter(0);
+
+    std::vector<std::unique_ptr<dlx::hardware::DLXMachine>> children;
+    std::vector<dlx::hardware::DLXMachine*> lanes;
+    for (int i = 0; i < 10; ++i)
+    {
+      children.push_back(parent.fork());
+      children.back()->Registers()[5] = 1 + (i * 7) % 5;
+      lanes.push_back(children.back().get());
+    }
+    children[3]->SetInstructionLimit(5);
+
+    dlx::hardware::RunLockstep(lanes.data(), lanes.size());
+
+    for (int i = 0; i < 10; ++i)
+    {
+      const int n = 1 + (i * 7) % 5;
+      if (i == 3)
+      {
+        assert(!children[i]->IsHalted());
+        assert(children[i]->InstructionCount() == 5);
+        continue;
+      }
+      assert(children[i]->IsHalted());
+      assert(children[i]->ConstRegisters()[1] == 3 * n);
+      assert(children[i]->ConstRegisters()[5] == 0);
+      assert(children[i]->InstructionCount() ==
+             static_cast<std::uint64_t>(2 + 3 * n));
+    }
+  }
+
+  // A lane of machines in lockstep which faults stops with the exception of
+  // its machine, the same as when the machine is run on its own, while the
+  // other lanes carry on to the same results as they would without it.
+  {
+    const std::uint32_t byLane[] = {
+      SwapBytes(0x2001FFF9), // addi r1, r0, -7
+      SwapBytes(0x0425200F), // div r4, r1, r5
+      SwapBytes(0x20860001), // addi r6, r4, 1
+      SwapBytes(0x00000001), // halt
+    };
+
+    dlx::hardware::DLXMachine parent(config);
+    std::memcpy(parent.block(0)->storage.get(), byLane, sizeof(byLane));
+    parent.SetProgramCounter(0);
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+      std::vector<std::unique_ptr<dlx::hardware::DLXMachine>> children;
+      std::vector<dlx::hardware::DLXMachine*> lanes;
+      for (int i = 0; i < 4; ++i)
+      {
+        children.push_back(parent.fork());
+        children.back()->Registers()[5] = 2 - i; // Lane 2 divides by 0.
+        lanes.push_back(children.back().get());
+      }
+
+      // Without somewhere to put the exceptions the first is thrown once
+      // the other lanes have finished.
+      std::vector<std::exception_ptr> errors(lanes.size());
+      try
+      {
+        dlx::hardware::RunLockstep(lanes.data(), lanes.size(),
+                                   pass ? errors.data() : nullptr);
+        assert(pass == 1);
+        std::rethrow_exception(errors[2]);
+      }
+      catch (const dlx::hardware::GuestException& exception)
+      {
+        assert(exception.cause() ==
+               dlx::hardware::ExceptionCause::DivideByZero);
+        assert(exception.address() == 4);
+      }
+
+      for (int i = 0; i < 4; ++i)
+      {
+        if (i == 2)
+        {
+          assert(!children[i]->IsHalted());
+          assert(children[i]->InstructionCount() == 2);
+          assert(children[i]->ProgramCounter() == 8);
+          continue;
+        }
+        assert(!errors[i]);
+        assert(children[i]->IsHalted());
+        assert(children[i]->ConstRegisters()[4] == -7 / (2 - i));
+        assert(children[i]->ConstRegisters()[6] == -7 / (2 - i) + 1);
+        assert(children[i]->InstructionCount() == 4);
+      }
+    }
+  }
+
+  // A checkpoint saves only the pages written to since the one before, and
+  // the machine restored from it carries on the same as the one saved.
+  {
+    DLXMachine saved(config);
+    std::memcpy(saved.block(0)->storage.get(), instructions,
+                sizeof(std::uint32_t) * 7);
+    saved.SetProgramCounter(0);
+    saved.SetInstructionLimit(2001);
+    saved.run();
+
+    const char* const filename = "demu-test.checkpoint";
+    {
+      Checkpoint checkpoint(filename);
+      checkpoint.save(saved);
+      assert(checkpoint.PagesWritten() == 1);
+
+      saved.block(0x2000)->storage[0x2000] = 42;
+      saved.block(0x2000)->markDirty(0x2000, 1);
+      checkpoint.save(saved);
+      assert(checkpoint.PagesWritten() == 1);
+      checkpoint.save(saved);
+      assert(checkpoint.PagesWritten() == 0 && checkpoint.Saves() == 3);
+    }
+
+    std::unique_ptr<DLXMachine> restored = RestoreCheckpoint(filename);
+    std::remove(filename);
+    assert(restored->InstructionCount() == 2001);
+    assert(restored->block(0x2000)->storage[0x2000] == 42);
+
+    saved.SetInstructionLimit(std::numeric_limits<std::uint64_t>::max());
+    saved.run();
+    restored->run(dlx::hardware::Engine::Jit);
+    assert(restored->ConstRegisters()[1] == saved.ConstRegisters()[1]);
+    assert(restored->InstructionCount() == saved.InstructionCount());
+    assert(restored->IsHalted());
+  }
+
+  // The clock read by a trap is given back at the same instruction when the
+  // log is replayed, whichever engine runs it, and a run which reads it at
+  // another instruction has diverged.
+  {
+    const std::uint32_t clock[] = {
+      SwapBytes(0x44000003), // trap 3   r1 = clock
+      SwapBytes(0x20220000), // addi r2, r1, 0
+      SwapBytes(0x44000003), // trap 3
+      SwapBytes(0x00000001), // halt
+    };
+    const char* const filename = "demu-test.replay";
+
+    DLXMachine recorded(config);
+    std::memcpy(recorded.block(0)->storage.get(), clock, sizeof(clock));
+    recorded.SetProgramCounter(0);
+    recorded.SetInputLog(std::unique_ptr<InputLog>(
+      new InputLog(filename, InputLog::Mode::Record)));
+    recorded.run();
+    assert(recorded.Inputs()->Events() == 2);
+    recorded.SetInputLog(nullptr);
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine replayed(config);
+      std::memcpy(replayed.block(0)->storage.get(), clock, sizeof(clock));
+      replayed.SetProgramCounter(0);
+      replayed.SetInputLog(std::unique_ptr<InputLog>(
+        new InputLog(filename, InputLog::Mode::Replay)));
+      replayed.run(engine);
+      assert(replayed.ConstRegisters()[1] == recorded.ConstRegisters()[1]);
+      assert(replayed.ConstRegisters()[2] == recorded.ConstRegisters()[2]);
+      assert(replayed.Inputs()->AtEnd());
+    }
+
+    DLXMachine diverged(config);
+    std::memcpy(diverged.block(0)->storage.get(), clock + 1,
+                sizeof(clock) - sizeof(clock[0]));
+    diverged.SetProgramCounter(0);
+    diverged.SetInputLog(std::unique_ptr<InputLog>(
+      new InputLog(filename, InputLog::Mode::Replay)));
+    try
+    {
+      diverged.run();
+      assert(false);
+    }
+    catch (const std::runtime_error&) {}
+    std::remove(filename);
+  }
+
+  // The loads and stores read and write memory as big-endian, extending the
+  // bytes and halves loaded by their sign or with zero, and an access which
+  // is misaligned or outside the memory raises a guest exception.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x2001FFFE), // addi r1, r0, -2
+      SwapBytes(0xAC010100), // sw 0x100(r0), r1
+      SwapBytes(0x80020103), // lb r2, 0x103(r0)
+      SwapBytes(0x90030103), // lbu r3, 0x103(r0)
+      SwapBytes(0x84040102), // lh r4, 0x102(r0)
+      SwapBytes(0x94050100), // lhu r5, 0x100(r0)
+      SwapBytes(0xA0030104), // sb 0x104(r0), r3
+      SwapBytes(0xA4050106), // sh 0x106(r0), r5
+      SwapBytes(0x8C060104), // lw r6, 0x104(r0)
+      SwapBytes(0x00000001), // halt
+    };
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine accessed(config);
+      std::memcpy(accessed.block(0)->storage.get(), instructions,
+                  sizeof(instructions));
+      accessed.SetProgramCounter(0);
+      accessed.run(engine);
+      assert(accessed.ConstRegisters()[2] == -2);
+      assert(accessed.ConstRegisters()[3] == 254);
+      assert(accessed.ConstRegisters()[4] == -2);
+      assert(accessed.ConstRegisters()[5] == 65535);
+      assert(accessed.ConstRegisters()[6].value ==
+             static_cast<std::int32_t>(0xFE00FFFF));
+      assert(accessed.block(0)->storage.get()[0x103] == 0xFE);
+      assert(accessed.memory().load<std::uint32_t>(0x100) == 0xFFFFFFFE);
+    }
+
+    const std::uint32_t faults[][2] = {
+      { SwapBytes(0x8C010102), SwapBytes(0x00000001) }, // lw r1, 0x102(r0)
+      { SwapBytes(0xAC01FFFC), SwapBytes(0x00000001) }, // sw -4(r0), r1
+    };
+    const dlx::hardware::ExceptionCause causes[] = {
+      dlx::hardware::ExceptionCause::MisalignedAccess,
+      dlx::hardware::ExceptionCause::OutsideMemory,
+    };
+    for (int i = 0; i < 2; ++i)
+    {
+      DLXMachine faulted(config);
+      std::memcpy(faulted.block(0)->storage.get(), faults[i],
+                  sizeof(faults[i]));
+      faulted.SetProgramCounter(0);
+      try
+      {
+        faulted.run();
+        assert(false);
+      }
+      catch (const dlx::hardware::GuestException& exception)
+      {
+        assert(exception.cause() == causes[i]);
+        assert(faulted.InstructionCount() == 1);
+      }
+    }
+  }
+
+  // A j goes to its target and a jalr to ri, linking r31 to the instruction
+  // after it, whichever engine runs them.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x08000004), // j 4
+      SwapBytes(0x20210005), // addi r1, r1, 5
+      SwapBytes(0x20020018), // addi r2, r0, 0x18
+      SwapBytes(0x4C400000), // jalr r2
+      SwapBytes(0x20630007), // addi r3, r3, 7
+      SwapBytes(0x00000001), // halt
+      SwapBytes(0x20040009), // addi r4, r0, 9
+      SwapBytes(0x4BE00000), // jr r31
+    };
+    const auto check = [](const DLXMachine& machine)
+    {
+      assert(machine.ConstRegisters()[1] == 0);
+      assert(machine.ConstRegisters()[3] == 7);
+      assert(machine.ConstRegisters()[4] == 9);
+      assert(machine.ConstRegisters()[31] == 0x10);
+      assert(machine.InstructionCount() == 7);
+    };
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine jumped(config);
+      std::memcpy(jumped.block(0)->storage.get(), instructions,
+                  sizeof(instructions));
+      jumped.SetProgramCounter(0);
+      jumped.run(engine);
+      check(jumped);
+    }
+
+    DLXMachine native(config);
+    std::memcpy(native.block(0)->storage.get(), instructions,
+                sizeof(instructions));
+    native.SetProgramCounter(0);
+    const dlx::recompiler::Program program =
+      dlx::recompiler::RecoverProgram(native.memory(), 0);
+    assert(program.blocks.count(0x04) == 0);
+    assert(program.blocks.at(0x10) == 0x18);
+    assert(program.indirectJumps == 1);
+    try
+    {
+      native.SetNativeCode(std::make_shared<const dlx::hardware::NativeCode>(
+        dlx::recompiler::Recompile(
+          reinterpret_cast<const unsigned char*>(instructions),
+          sizeof(instructions), native.memory(), 0).c_str()));
+      native.run(dlx::hardware::Engine::Native);
+      check(native);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+  }
+
+  // A jump to an address which is misaligned or outside the memory raises a
+  // guest exception for the fetch of the instruction there, rather than
+  // running the word it falls within.
+  {
+    const std::uint32_t faults[][3] = {
+      {
+        SwapBytes(0x2002000E), // addi r2, r0, 0xE
+        SwapBytes(0x48400000), // jr r2
+        SwapBytes(0x00000001), // halt
+      },
+      {
+        SwapBytes(0x3C027FFF), // lhi r2, 0x7FFF
+        SwapBytes(0x48400000), // jr r2
+        SwapBytes(0x00000001), // halt
+      },
+    };
+    const dlx::hardware::ExceptionCause causes[] = {
+      dlx::hardware::ExceptionCause::MisalignedAccess,
+      dlx::hardware::ExceptionCause::OutsideMemory,
+    };
+    const std::uint32_t addresses[] = { 0x0000000E, 0x7FFF0000 };
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      for (int i = 0; i < 2; ++i)
+      {
+        DLXMachine faulted(config);
+        std::memcpy(faulted.block(0)->storage.get(), faults[i],
+                    sizeof(faults[i]));
+        faulted.SetProgramCounter(0);
+        try
+        {
+          faulted.run(engine);
+          assert(false);
+        }
+        catch (const dlx::hardware::GuestException& exception)
+        {
+          assert(exception.cause() == causes[i]);
+          assert(exception.address() == addresses[i]);
+          assert(faulted.InstructionCount() == 2);
+        }
+      }
+    }
+  }
+
+  // The multiply and divide instructions keep the low 32 bits of the result,
+  // with the quotient rounded towards zero, and a divide by zero raises a
+  // guest exception at the address of the div.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x2001FFF9), // addi r1, r0, -7
+      SwapBytes(0x20020002), // addi r2, r0, 2
+      SwapBytes(0x0422180E), // mult r3, r1, r2
+      SwapBytes(0x0422200F), // div r4, r1, r2
+      SwapBytes(0x04222816), // multu r5, r1, r2
+      SwapBytes(0x04223017), // divu r6, r1, r2
+      SwapBytes(0x3C078000), // lhi r7, 0x8000
+      SwapBytes(0x2008FFFF), // addi r8, r0, -1
+      SwapBytes(0x04E8480F), // div r9, r7, r8
+      SwapBytes(0x00000001), // halt
+    };
+    const auto check = [](const DLXMachine& machine)
+    {
+      assert(machine.ConstRegisters()[3] == -14);
+      assert(machine.ConstRegisters()[4] == -3);
+      assert(machine.ConstRegisters()[5] == -14);
+      assert(machine.ConstRegisters()[6] == 0x7FFFFFFC);
+      assert(machine.ConstRegisters()[9].value ==
+             std::numeric_limits<std::int32_t>::min());
+    };
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine divided(config);
+      std::memcpy(divided.block(0)->storage.get(), instructions,
+                  sizeof(instructions));
+      divided.SetProgramCounter(0);
+      divided.run(engine);
+      check(divided);
+    }
+
+    DLXMachine native(config);
+    std::memcpy(native.block(0)->storage.get(), instructions,
+                sizeof(instructions));
+    native.SetProgramCounter(0);
+    try
+    {
+      native.SetNativeCode(std::make_shared<const dlx::hardware::NativeCode>(
+        dlx::recompiler::Recompile(
+          reinterpret_cast<const unsigned char*>(instructions),
+          sizeof(instructions), native.memory(), 0).c_str()));
+      native.run(dlx::hardware::Engine::Native);
+      check(native);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    const std::uint32_t byZero[] = {
+      SwapBytes(0x2001FFF9), // addi r1, r0, -7
+      SwapBytes(0x0420200F), // div r4, r1, r0
+      SwapBytes(0x00000001), // halt
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine faulted(config);
+      std::memcpy(faulted.block(0)->storage.get(), byZero, sizeof(byZero));
+      faulted.SetProgramCounter(0);
+      try
+      {
+        faulted.run(engine);
+        assert(false);
+      }
+      catch (const dlx::hardware::GuestException& exception)
+      {
+        assert(exception.cause() ==
+               dlx::hardware::ExceptionCause::DivideByZero);
+        assert(exception.address() == 4);
+        assert(faulted.InstructionCount() == 2);
+        assert(faulted.ProgramCounter() == 8);
+      }
+    }
+  }
+
+  // The floating point registers hold a single each and a double in each
+  // even/odd pair, with the even register the upper half as sd stores it,
+  // and bfpt and bfpf branch on the last compare.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x20010003), // addi r1, r0, 3
+      SwapBytes(0x00210835), // movi2fp f1, r1
+      SwapBytes(0x0441100D), // cvti2d f2, f1
+      SwapBytes(0x20020004), // addi r2, r0, 4
+      SwapBytes(0x00A22835), // movi2fp f5, r2
+      SwapBytes(0x0485200D), // cvti2d f4, f5
+      SwapBytes(0x04443007), // divd f6, f2, f4
+      SwapBytes(0xBC060100), // sd 0x100(r0), f6
+      SwapBytes(0x98080100), // lf f8, 0x100(r0)
+      SwapBytes(0x98090104), // lf f9, 0x104(r0)
+      SwapBytes(0x0548500A), // cvtd2f f10, f8
+      SwapBytes(0x054A5802), // multf f11, f10, f10
+      SwapBytes(0x056A5812), // ltf f11, f10
+      SwapBytes(0x1C000008), // bfpf 8
+      SwapBytes(0x04847006), // multd f14, f4, f4
+      SwapBytes(0x060E800B), // cvtd2i f16, f14
+      SwapBytes(0x00701834), // movfp2i r3, f16
+      SwapBytes(0x18000008), // bfpt 8
+      SwapBytes(0x20040001), // addi r4, r0, 1
+      SwapBytes(0x20040002), // addi r4, r0, 2
+      SwapBytes(0x0444101B), // gtd f2, f4
+      SwapBytes(0x1C000004), // bfpf 4
+      SwapBytes(0x20040003), // addi r4, r0, 3
+      SwapBytes(0x028BA032), // movf f20, f11
+      SwapBytes(0xB8140108), // sf 0x108(r0), f20
+      SwapBytes(0x8C050108), // lw r5, 0x108(r0)
+      SwapBytes(0x00000001), // halt
+    };
+    const auto check = [](DLXMachine& machine)
+    {
+      const dlx::hardware::FloatingPointRegisters& f =
+        machine.ConstFloatRegisters();
+      assert(f.at<double>(6) == 0.75);
+      assert(f.at<std::int32_t>(8) == 0x3FE80000);
+      assert(f.at<std::int32_t>(9) == 0);
+      assert(f.at<float>(10) == 0.75f);
+      assert(f.at<float>(11) == 0.5625f);
+      assert(!machine.FloatingPointStatus());
+      assert(machine.ConstRegisters()[3] == 16);
+      assert(machine.ConstRegisters()[4] == 0);
+      assert(machine.ConstRegisters()[5] == 0x3F100000);
+      assert(machine.memory().load<std::uint64_t>(0x100) ==
+             0x3FE8000000000000);
+      assert(machine.InstructionCount() == 24);
+    };
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine floating(config);
+      std::memcpy(floating.block(0)->storage.get(), instructions,
+                  sizeof(instructions));
+      floating.SetProgramCounter(0);
+      floating.run(engine);
+      check(floating);
+
+      // The registers are carried by a snapshot.
+      DLXMachine copy(floating.snapshot());
+      assert(copy.ConstFloatRegisters().at<double>(6) == 0.75);
+    }
+
+    DLXMachine native(config);
+    std::memcpy(native.block(0)->storage.get(), instructions,
+                sizeof(instructions));
+    native.SetProgramCounter(0);
+    try
+    {
+      native.SetNativeCode(std::make_shared<const dlx::hardware::NativeCode>(
+        dlx::recompiler::Recompile(
+          reinterpret_cast<const unsigned char*>(instructions),
+          sizeof(instructions), native.memory(), 0).c_str()));
+      native.run(dlx::hardware::Engine::Native);
+      check(native);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    std::ostringstream output;
+    const std::uint32_t words[] = {
+      0x04443007, 0x0548500A, 0x056A5812, 0x00701834, 0x00A22835, 0xBC060100,
+      0x98080100, 0x18000008,
+    };
+    for (auto word : words)
+    {
+      dlx::hardware::disassemble(output, dlx::hardware::decode(word));
+      output << '\n';
+    }
+    assert(output.str() ==
+           "divd f6, f2, f4\n"
+           "cvtd2f f10, f8\n"
+           "ltf f11, f10\n"
+           "movfp2i r3, f16\n"
+           "movi2fp f5, r2\n"
+           "sd 256(r0), f6\n"
+           "lf f8, 256(r0)\n"
+           "bfpt 8\n");
+  }
+
+  // A store over an instruction which has been decoded, translated and
+  // compiled replaces it whichever engine runs it, while the pages the
+  // program never executed aren't marked as holding code.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x20030064), // addi r3, r0, 100
+      SwapBytes(0x20210001), // addi r1, r1, 1   (replaced)
+      SwapBytes(0x28630001), // subi r3, r3, 1
+      SwapBytes(0x60640032), // seqi r4, r3, 50
+      SwapBytes(0x10800008), // beqz r4, 8
+      SwapBytes(0x8C020040), // lw r2, 0x40(r0)
+      SwapBytes(0xAC020004), // sw 0x04(r0), r2
+      SwapBytes(0x1460FFE4), // bnez r3, -28
+      SwapBytes(0x00000001), // halt
+    };
+    const std::uint32_t replacement = SwapBytes(0x20210064); // addi r1, r1, 100
+
+    const dlx::hardware::Engine engines[] = {
+      dlx::hardware::Engine::Interpreter,
+      dlx::hardware::Engine::Blocks,
+      dlx::hardware::Engine::Jit,
+      dlx::hardware::Engine::Lockstep,
+    };
+    for (auto engine : engines)
+    {
+      DLXMachine modified(config);
+      std::memcpy(modified.block(0)->storage.get(), instructions,
+                  sizeof(instructions));
+      std::memcpy(modified.block(0)->storage.get() + 0x40, &replacement,
+                  sizeof(replacement));
+      modified.SetProgramCounter(0);
+      modified.run(engine);
+      assert(modified.ConstRegisters()[1] == 50 + 50 * 100);
+      assert(modified.block(0)->hasCode(0x04));
+      assert(!modified.block(0)->hasCode(0x8000));
+    }
+
+    // The native code stops at the store, and the rest runs as blocks.
+    DLXMachine native(config);
+    std::memcpy(native.block(0)->storage.get(), instructions,
+                sizeof(instructions));
+    std::memcpy(native.block(0)->storage.get() + 0x40, &replacement,
+                sizeof(replacement));
+    native.SetProgramCounter(0);
+    try
+    {
+      const std::string library = dlx::recompiler::Recompile(
+        native.block(0)->storage.get(), 0x44, native.memory(), 0);
+      native.SetNativeCode(
+        std::make_shared<const dlx::hardware::NativeCode>(library.c_str()));
+      assert(native.block(0)->hasCode(0x04));
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    native.run(dlx::hardware::Engine::Native);
+    assert(native.ConstRegisters()[1] == 50 + 50 * 100);
+    assert(native.InstructionCount() == 504);
+  }
+
+  // The fused instructions give the same result in the same number of
+  // instructions as those performed one at a time, whether a branch lands in
+  // the middle of them or the limit stops the machine there, and the
+  // profile gives the fusion for the hottest pairs.
+  {
+    const std::uint32_t instructions[] = {
+      SwapBytes(0x20020000), // addi r2, r0, 0
+      SwapBytes(0x10000008), // beqz r0, 8
+      SwapBytes(0x20210002), // addi r1, r1, 2
+      SwapBytes(0x20420001), // addi r2, r2, 1     (addi+slti+bnez)
+      SwapBytes(0x68430064), // slti r3, r2, 100   (slti+bnez)
+      SwapBytes(0x1460FFF0), // bnez r3, -16
+      SwapBytes(0x3C041234), // lhi r4, 0x1234     (lhi+ori)
+      SwapBytes(0x3484ABCD), // ori r4, r4, 0xABCD
+      SwapBytes(0x00000001), // halt
+    };
+
+    const auto load = [&instructions](DLXMachine& machine)
+      {
+        std::memcpy(machine.block(0)->storage.get(), instructions,
+                    sizeof(instructions));
+        machine.SetProgramCounter(0);
+      };
+
+    DLXMachine separate(config);
+    separate.SetFusions(0);
+    load(separate);
+    separate.run();
+    assert(separate.ConstRegisters()[1] == 200);
+    assert(separate.ConstRegisters()[4].value == 0x1234ABCD);
+    assert(separate.InstructionCount() == 407);
+
+    DLXMachine fused(config);
+    load(fused);
+    fused.run();
+    assert(fused.ConstRegisters()[1] == 200);
+    assert(fused.ConstRegisters()[4].value == 0x1234ABCD);
+    assert(fused.InstructionCount() == 407);
+
+    for (std::uint64_t limit = 1; limit < 12; ++limit)
+    {
+      DLXMachine limited(config);
+      load(limited);
+      limited.SetInstructionLimit(limit);
+      limited.run();
+
+      DLXMachine expected(config);
+      expected.SetFusions(0);
+      load(expected);
+      expected.SetInstructionLimit(limit);
+      expected.run();
+
+      assert(limited.InstructionCount() == limit);
+      assert(limited.ProgramCounter() == expected.ProgramCounter());
+      for (int i = 1; i < 5; ++i)
+      {
+        assert(limited.ConstRegisters()[i] == expected.ConstRegisters()[i]);
+      }
+    }
+
+    DLXMachine profiled(config);
+    load(profiled);
+    profiled.EnableProfile();
+    profiled.run();
+    assert(profiled.InstructionCount() == 407);
+    std::ostringstream report;
+    profiled.InstructionProfile()->report(report, 3);
+    assert(report.str().find("addi, slti       addi+slti+bnez") !=
+           std::string::npos);
+
+    // Recompiled ahead of time the loop is a block of its own in the one
+    // routine, and the native code gives the same result however far it is
+    // run. This is left out where there is no compiler to build it.
+    const dlx::recompiler::Program program =
+      dlx::recompiler::RecoverProgram(separate.memory(), 0);
+    assert(program.routines.size() == 1);
+    assert(program.routines[0].blocks.size() == 4);
+    assert(program.blocks.at(0x10) == 0x18);
+    assert(program.indirectJumps == 0);
+
+    std::string library;
+    try
+    {
+      library = dlx::recompiler::Recompile(
+        reinterpret_cast<const unsigned char*>(instructions),
+        sizeof(instructions), separate.memory(), 0);
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+
+    for (std::uint64_t limit = 1; !library.empty() && limit < 410; ++limit)
+    {
+      DLXMachine native(config);
+      load(native);
+      native.SetNativeCode(
+        std::make_shared<const dlx::hardware::NativeCode>(library.c_str()));
+      native.SetInstructionLimit(limit);
+      native.run(dlx::hardware::Engine::Native);
+
+      DLXMachine expected(config);
+      load(expected);
+      expected.SetInstructionLimit(limit);
+      expected.run();
+
+      assert(native.InstructionCount() == expected.InstructionCount());
+      assert(native.ProgramCounter() == expected.ProgramCounter());
+      for (int i = 1; i < 5; ++i)
+      {
+        assert(native.ConstRegisters()[i] == expected.ConstRegisters()[i]);
+      }
+    }
+  }
+
+  // The text trace has the address, the word, the instruction and what it
+  // wrote.
+  {
+    std::ostringstream output;
+    const dlx::hardware::TraceRecord branch = { 0x14, 0x1460FFF0, 0, 0 };
+    dlx::hardware::TextTraceSink::write(
+      output, branch, dlx::hardware::decode(branch.word));
+    const dlx::hardware::TraceRecord add = { 0x0C, 0x20420003, 6, 0 };
+    dlx::hardware::TextTraceSink::write(
+      output, add, dlx::hardware::decode(add.word));
+    const dlx::hardware::TraceRecord load = { 0x20, 0x8C410008, 7, 0x108 };
+    dlx::hardware::TextTraceSink::write(
+      output, load, dlx::hardware::decode(load.word));
+    assert(output.str() ==
+           "00000014: 1460fff0  bnez r3, -16\n"
+           "0000000c: 20420003  addi r2, r2, 3  r2=6\n"
+           "00000020: 8c410008  lw r1, 8(r2)  r1=7  [00000108]\n");
+  }
+
+  // The ring buffer wraps around, handing back the items up to the end of
+  // the buffer and then the rest.
+  {
+    dlx::hardware::RingBuffer<int> buffer(4);
+    const int* items;
+    for (int i = 0; i < 3; ++i) assert(buffer.push(i));
+    assert(buffer.peek(&items) == 3 && items[0] == 0);
+    buffer.consume(3);
+    for (int i = 3; i < 7; ++i) assert(buffer.push(i));
+    assert(!buffer.push(7));
+    assert(buffer.peek(&items) == 1 && items[0] == 3);
+    buffer.consume(1);
+    assert(buffer.peek(&items) == 3 && items[0] == 4 && items[2] == 6);
+    buffer.consume(3);
+    assert(buffer.peek(&items) == 0);
+  }
+}
+
+int main(int argc, const char *argv[])
+{
+  std::cout << "demu v0.1 by Donno" << std::endl;
+
+  // The options come before the filename.
+  dlx::hardware::Engine engine = dlx::hardware::Engine::Interpreter;
+  dlx::hardware::Configuration config = {
+    0x00000, 0x10000, // dsim new ram dsim.memory.Ram 00000 4000
+    dlx::hardware::PageSize::Normal,
+  };
+  std::string manifest;
+  unsigned int profile = 0;
+  bool pipeline = false;
+  dlx::timing::PipelineConfiguration pipelineConfiguration = {
+    true, dlx::timing::Stage::Decode,
+  };
+  unsigned int cache = 0;
+  dlx::timing::CacheConfiguration instructionCache = {
+    8 * 1024, 2, 32,
+    dlx::timing::Replacement::LeastRecentlyUsed,
+    dlx::timing::WritePolicy::WriteBack,
+  };
+  dlx::timing::CacheConfiguration dataCache = instructionCache;
+  std::unique_ptr<dlx::timing::CacheConfiguration> level2Cache;
+  unsigned int branches = 0;
+  std::string predictors = "not-taken,bimodal,gshare,tournament";
+  bool trace = false;
+  std::string traceFile;
+  dlx::hardware::TraceOverflow traceOverflow =
+    dlx::hardware::TraceOverflow::Wait;
+  unsigned int workers = std::thread::hardware_concurrency();
+  std::string checkpointFile;
+  unsigned long checkpointInterval = 10;
+  std::string restoreFile;
+  std::string recordFile;
+  std::string replayFile;
+  std::string fusions = "all";
+  bool recompile = false;
+  int argument = 1;
+  for (; argument < argc && argv[argument][0] == '-'; ++argument)
+  {
+    const std::string option(argv[argument]);
+    if (option == "--engine=interpreter")
+    {
+      engine = dlx::hardware::Engine::Interpreter;
+    }
+    else if (option == "--engine=blocks")
+    {
+      engine = dlx::hardware::Engine::Blocks;
+    }
+    else if (option == "--engine=jit")
+    {
+      engine = dlx::hardware::Engine::Jit;
+    }
+    else if (option == "--engine=lockstep")
+    {
+      engine = dlx::hardware::Engine::Lockstep;
+    }
+    else if (option == "--engine=native")
+    {
+      engine = dlx::hardware::Engine::Native;
+    }
+    else if (option == "--recompile")
+    {
+      recompile = true;
+    }
+    else if (option == "--test")
+    {
+      // An assert that fails stops with the expression that didn't hold.
+      tests();
+      std::cout << "All the tests passed." << std::endl;
+      return 0;
+    }
+    else if (option.compare(0, 9, "--memory=") == 0)
+    {
+      // The size of the memory in MiB, starting at address 0.
+      const unsigned long size = std::strtoul(option.c_str() + 9, nullptr, 0);
+      if (size == 0 || size > 4096)
+      {
+        std::cerr << "error: the memory must be 1 to 4096 MiB." << std::endl;
+        return 1;
+      }
+      config.endAddress = static_cast<std::uint64_t>(size) << 20;
+    }
+    else if (option == "--huge-pages")
+    {
+      config.pageSize = dlx::hardware::PageSize::Huge;
+    }
+    else if (option.compare(0, 8, "--batch=") == 0)
+    {
+      manifest = option.substr(8);
+    }
+    else if (option.compare(0, 10, "--workers=") == 0)
+    {
+      workers = std::strtoul(option.c_str() + 10, nullptr, 0);
+    }
+    else if (option == "--trace" || option.compare(0, 8, "--trace=") == 0)
+    {
+      if (!dlx::hardware::TraceSink::Enabled)
+      {
+        std::cerr << "error: demu was built without tracing, see DEMU_TRACE."
+                  << std::endl;
+        return 1;
+      }
+      trace = true;
+      if (option.size() > 8) traceFile = option.substr(8);
+#if DEMU_TRACE == 2
+      // The records would be mixed in with the rest of the standard output.
+      if (traceFile.empty())
+      {
+        std::cerr << "error: the binary trace needs a file, as in "
+                  << "--trace=FILE." << std::endl;
+        return 1;
+      }
+#endif
+    }
+    else if (option == "--profile" || option.compare(0, 10, "--profile=") == 0)
+    {
+      // The number of the most executed addresses to report.
+      profile = 20;
+      if (option.size() > 10)
+      {
+        profile = std::strtoul(option.c_str() + 10, nullptr, 0);
+      }
+    }
+    else if (option == "--pipeline")
+    {
+      pipeline = true;
+    }
+    else if (option == "--no-forwarding")
+    {
+      pipelineConfiguration.forwarding = false;
+    }
+    else if (option == "--branch-stage=id")
+    {
+      pipelineConfiguration.branchStage = dlx::timing::Stage::Decode;
+    }
+    else if (option == "--branch-stage=ex")
+    {
+      pipelineConfiguration.branchStage = dlx::timing::Stage::Execute;
+    }
+    else if (option == "--branch-stage=mem")
+    {
+      pipelineConfiguration.branchStage = dlx::timing::Stage::Memory;
+    }
+    else if (option == "--cache" || option.compare(0, 8, "--cache=") == 0)
+    {
+      // The number of the addresses with the most misses to report.
+      cache = 20;
+      if (option.size() > 8)
+      {
+        cache = std::strtoul(option.c_str() + 8, nullptr, 0);
+      }
+    }
+    else if (option.compare(0, 6, "--l1i=") == 0 ||
+             option.compare(0, 6, "--l1d=") == 0 ||
+             option.compare(0, 5, "--l2=") == 0)
+    {
+      const std::size_t equals = option.find('=');
+      try
+      {
+        const dlx::timing::CacheConfiguration configuration =
+          dlx::timing::ParseCacheConfiguration(option.substr(equals + 1));
+        if (option[4] == 'i') instructionCache = configuration;
+        else if (option[4] == 'd') dataCache = configuration;
+        else level2Cache.reset(
+          new dlx::timing::CacheConfiguration(configuration));
+      }
+      catch (const std::invalid_argument& error)
+      {
+        std::cerr << "error: " << option.substr(0, equals) << ": "
+                  << error.what() << std::endl;
+        return 1;
+      }
+      if (cache == 0) cache = 20;
+    }
+    else if (option == "--branches" ||
+             option.compare(0, 11, "--branches=") == 0)
+    {
+      // The number of the branches with the most mispredictions to report.
+      branches = 20;
+      if (option.size() > 11)
+      {
+        branches = std::strtoul(option.c_str() + 11, nullptr, 0);
+      }
+    }
+    else if (option.compare(0, 13, "--predictors=") == 0)
+    {
+      predictors = option.substr(13);
+      if (branches == 0) branches = 20;
+    }
+    else if (option == "--trace-drop")
+    {
+      traceOverflow = dlx::hardware::TraceOverflow::Drop;
+    }
+    else if (option.compare(0, 13, "--checkpoint=") == 0)
+    {
+      checkpointFile = option.substr(13);
+    }
+    else if (option.compare(0, 22, "--checkpoint-interval=") == 0)
+    {
+      // The number of seconds between saving the checkpoint.
+      checkpointInterval = std::strtoul(option.c_str() + 22, nullptr, 0);
+      if (checkpointInterval == 0)
+      {
+        std::cerr << "error: the checkpoint interval must be at least a "
+                  << "second." << std::endl;
+        return 1;
+      }
+    }
+    else if (option.compare(0, 10, "--restore=") == 0)
+    {
+      restoreFile = option.substr(10);
+    }
+    else if (option.compare(0, 9, "--record=") == 0)
+    {
+      recordFile = option.substr(9);
+    }
+    else if (option.compare(0, 9, "--replay=") == 0)
+    {
+      replayFile = option.substr(9);
+    }
+    else if (option.compare(0, 7, "--fuse=") == 0)
+    {
+      fusions = option.substr(7);
+    }
+    else
+    {
+      std::cerr << "error: unknown option " << option << std::endl;
+      return 1;
+    }
+  }
+
+  if (!manifest.empty())
+  {
+    // The jobs run on many threads at once, which would mix their traces.
+    // Each job records or replays its input with record= and replay=.
+    if (trace || profile || pipeline || cache || branches ||
+        !checkpointFile.empty() || !restoreFile.empty() ||
+        !recordFile.empty() || !replayFile.empty())
+    {
+      std::cerr << "error: --trace, --profile, --pipeline, --cache, "
+                << "--branches, --checkpoint, --restore, --record and "
+                << "--replay can't be used with --batch." << std::endl;
+      return 1;
+    }
+
+    std::ifstream file(manifest);
+    if (!file.is_open())
+    {
+      std::cerr << "error: could not read " << manifest << std::endl;
+      return 1;
+    }
+
+    try
+    {
+      const std::vector<dlx::batch::Job> jobs = dlx::batch::ReadManifest(file);
+      dlx::batch::RunBatch(jobs, config, engine, LoadDlxFile, workers,
+                           std::cout);
+    }
+    catch (const std::invalid_argument& error)
+    {
+      std::cerr << "error: " << manifest << ": " << error.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+
+  if (argument >= argc && restoreFile.empty())
+  {
+    std::cout << "usage: " << argv[0] << " [--engine=interpreter|blocks|jit|lockstep|native] "
+              << "[--memory=MiB] [--huge-pages] [--trace[=FILE]] "
+              << "[--trace-drop] [--profile[=N]] [--pipeline "
+              << "[--no-forwarding] [--branch-stage=id|ex|mem]] "
+              << "[--cache[=N]] [--l1i=CACHE] [--l1d=CACHE] [--l2=CACHE] "
+              << "[--branches[=N]] [--predictors=LIST] "
+              << "[--checkpoint=FILE [--checkpoint-interval=SECONDS]] "
+              << "[--record=LOG|--replay=LOG] [--fuse=all|none|LIST] "
+              << "[--recompile] filename|--restore=FILE"
+              << std::endl;
+    std::cout << "       " << argv[0] << " --test" << std::endl;
+    std::cout << "       where CACHE is SIZE,WAYS,LINE[,lru|fifo|random]"
+              << "[,wb|wt]" << std::endl;
+    std::cout << "       " << argv[0] << " [--engine=...] [--memory=MiB] "
+              << "--batch=manifest [--workers=N]" << std::endl;
+    return 0;
+  }
+
+  // A restored machine carries on from where it was saved, with the memory
+  // it had then.
+  std::unique_ptr<dlx::hardware::DLXMachine> machine;
+  if (!restoreFile.empty())
+  {
+    std::cout << "Restoring checkpoint: " << restoreFile << std::endl;
+    try
+    {
+      machine = dlx::hardware::RestoreCheckpoint(restoreFile.c_str());
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "error: " << restoreFile << ": " << error.what()
+                << std::endl;
+      return 1;
+    }
+
+    // A checkpoint saved when the program halted has nothing left to run.
+    if (machine->IsHalted())
+    {
+      std::cout << "The program had halted when the checkpoint was saved."
+                << std::endl;
+      return 0;
+    }
+  }
+  else
+  {
+    machine.reset(new dlx::hardware::DLXMachine(config));
+    std::cout << "Loading dlx: " << argv[argument] << std::endl;
+    if (!LoadDlxFile(argv[argument], machine.get())) return 1;
+  }
+
+  // The program is recompiled the first time it is run natively, and found
+  // in the cache each time after that.
+  if (engine == dlx::hardware::Engine::Native || recompile)
+  {
+    if (!restoreFile.empty())
+    {
+      std::cerr << "error: --engine=native and --recompile need a program "
+                << "rather than --restore." << std::endl;
+      return 1;
+    }
+
+    try
+    {
+      const dlx::loader::MappedFile image(argv[argument]);
+      const std::string library = dlx::recompiler::Recompile(
+        image.data(), image.size(), machine->memory(),
+        machine->ProgramCounter());
+      if (recompile)
+      {
+        std::cout << library << std::endl;
+        return 0;
+      }
+      machine->SetNativeCode(
+        std::make_shared<const dlx::hardware::NativeCode>(library.c_str()));
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "error: " << argv[argument] << ": " << error.what()
+                << std::endl;
+      return 1;
+    }
+  }
+
+  if (!recordFile.empty() || !replayFile.empty())
+  {
+    if (!recordFile.empty() && !replayFile.empty())
+    {
+      std::cerr << "error: --record and --replay can't be used together."
+                << std::endl;
+      return 1;
+    }
+
+    const std::string& logFile =
+      recordFile.empty() ? replayFile : recordFile;
+    try
+    {
+      machine->SetInputLog(std::unique_ptr<dlx::hardware::InputLog>(
+        new dlx::hardware::InputLog(
+          logFile.c_str(),
+          recordFile.empty() ? dlx::hardware::InputLog::Mode::Replay :
+                               dlx::hardware::InputLog::Mode::Record)));
+    }
+    catch (const std::exception& error)
+    {
+      std::cerr << "error: " << logFile << ": " << error.what() << std::endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<dlx::hardware::Checkpoint> checkpoint;
+  if (!checkpointFile.empty())
+  {
+    try
+    {
+      checkpoint.reset(new dlx::hardware::Checkpoint(
+        checkpointFile.c_str(), std::chrono::seconds(checkpointInterval)));
+    }
+    catch (const std::runtime_error& error)
+    {
+      std::cerr << "error: " << checkpointFile << ": " << error.what()
+                << std::endl;
+      return 1;
+    }
+    machine->SetCheckpoint(checkpoint.get());
+  }
+
+  std::ofstream traceOutput;
+
+  // The trace is switched off however this returns, before traceOutput is
+  // closed, as the binary trace is written to it by a thread of its own.
+  struct TraceGuard
+  {
+    bool on;
+    ~TraceGuard() { if (on) dlx::hardware::StopTrace(); }
+  } traceGuard = { false };
+
+  if (trace && !traceFile.empty())
+  {
+    traceOutput.open(traceFile, std::ios::binary);
+    if (!traceOutput.is_open())
+    {
+      std::cerr << "error: could not write " << traceFile << std::endl;
+      return 1;
+    }
+  }
+  if (trace)
+  {
+    dlx::hardware::SetTrace(
+      dlx::hardware::TraceLevel::Instructions,
+      traceFile.empty() ? &std::cout : &traceOutput,
+      traceOverflow);
+    traceGuard.on = true;
+  }
+
+  // The fusions are named as in the hottest pairs of --profile.
+  if (fusions != "all")
+  {
+    std::uint32_t enabled = 0;
+    std::istringstream names(fusions == "none" ? "" : fusions);
+    std::string name;
+    while (std::getline(names, name, ','))
+    {
+      unsigned int fusion = 0;
+      while (fusion < dlx::hardware::FusionCount &&
+             name != dlx::hardware::FusionPatterns[fusion].name)
+      {
+        ++fusion;
+      }
+      if (fusion == dlx::hardware::FusionCount)
+      {
+        std::cerr << "error: --fuse: unknown fusion " << name << std::endl;
+        return 1;
+      }
+      enabled |= 1u << fusion;
+    }
+    machine->SetFusions(enabled);
+  }
+
+  if (profile) machine->EnableProfile();
+
+  // The timing is worked out as the instructions are executed.
+  dlx::timing::Pipeline timing(pipelineConfiguration);
+  if (pipeline) machine->AddObserver(&timing);
+
+  std::unique_ptr<dlx::timing::CacheHierarchy> caches;
+  if (cache)
+  {
+    try
+    {
+      caches.reset(new dlx::timing::CacheHierarchy(
+        instructionCache, dataCache, level2Cache.get()));
+    }
+    catch (const std::invalid_argument& error)
+    {
+      std::cerr << "error: " << error.what() << std::endl;
+      return 1;
+    }
+    machine->AddObserver(caches.get());
+  }
+
+  // The branch target buffer has 512 entries and the return stack 16.
+  dlx::timing::BranchPredictors predictions(512, 16);
+  if (branches)
+  {
+    try
+    {
+      std::istringstream names(predictors);
+      std::string name;
+      while (std::getline(names, name, ','))
+      {
+        predictions.add(dlx::timing::CreatePredictor(name));
+      }
+    }
+    catch (const std::invalid_argument& error)
+    {
+      std::cerr << "error: --predictors: " << error.what() << std::endl;
+      return 1;
+    }
+    machine->AddObserver(&predictions);
+  }
+
+  // Execute the program loaded into to machine. Any exception is caught so
+  // the machine is destroyed, which writes out the rest of the --record log.
+  try
+  {
+    machine->run(engine);
+  }
+  catch (const std::exception& error)
+  {
+    std::cerr << "error: " << error.what() << std::endl;
+    return 1;
+  }
+
+  const dlx::hardware::InputLog* const inputs = machine->Inputs();
+  if (inputs && inputs->mode() == dlx::hardware::InputLog::Mode::Replay &&
+      !inputs->AtEnd())
+  {
+    std::cerr << "warning: the program stopped before all of the input "
+              << "recorded had been replayed." << std::endl;
+  }
+
+  if (profile) machine->InstructionProfile()->report(std::cout, profile);
+  if (pipeline) timing.report(std::cout);
+  if (caches) caches->report(std::cout, cache);
+  if (branches) predictions.report(std::cout, branches);
+
+  if (trace)
+  {
+    dlx::hardware::StopTrace();
+    const std::uint64_t dropped = dlx::hardware::DroppedTraceRecords();
+    if (dropped > 0)
+    {
+      std::cerr << "warning: " << dropped << " instructions were left out "
+                << "of the trace as it fell behind." << std::endl;
+    }
+  }
 }
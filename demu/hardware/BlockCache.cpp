@@ -0,0 +1,282 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : BlockCache
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides execution of translated blocks of instructions.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the translation of blocks from the decoded
+//                instructions, the links between them, retiring the blocks a
+//                store writes over, and RunBlocks(), which executes the
+//                program a block at a time.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BlockCache.hpp"
+
+#include "Machine.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+void dlx::hardware::TranslatedBlock::link(
+  std::uint32_t address, TranslatedBlock* block)
+{
+  const int slot = (successors[0] == nullptr) ? 0 : 1;
+
+  // An indirect jump replaces the block it was linked to before.
+  TranslatedBlock* const replaced = successors[slot];
+  if (replaced && replaced != successors[1 - slot])
+  {
+    std::vector<TranslatedBlock*>& others = replaced->predecessors;
+    others.erase(std::remove(others.begin(), others.end(), this),
+                 others.end());
+  }
+
+  successors[slot] = block;
+  successorAddresses[slot] = address;
+  block->predecessors.push_back(this);
+}
+
+dlx::hardware::TranslatedBlock*
+dlx::hardware::BlockCache::lookup(DLXMachine* machine, std::uint32_t address)
+{
+  const auto existing = blocks.find(address);
+  if (existing != blocks.end()) return existing->second.get();
+
+  std::unique_ptr<TranslatedBlock> block(new TranslatedBlock());
+  block->startAddress = address;
+  block->successors[0] = nullptr;
+  block->successors[1] = nullptr;
+  block->successorAddresses[0] = 0;
+  block->successorAddresses[1] = 0;
+  block->hasStores = false;
+  block->valid = true;
+  block->executionCount = 0;
+  block->native = nullptr;
+  block->nativeGeneration = 0;
+
+  // Take instructions until reaching one that transfers control elsewhere. If
+  // the end of memory is reached first the block stops short and looking-up
+  // the next one will fail.
+  std::uint32_t pc = address;
+  while (block->instructions.size() < MaximumLength)
+  {
+    const DecodedInstruction* const instruction =
+      machine->decodeCache(machine->mem, pc);
+    if (instruction == nullptr) break;
+
+    block->instructions.push_back(*instruction);
+    block->hasStores = block->hasStores || isStore(*instruction);
+    pc += sizeof(std::uint32_t);
+
+    if (isControlTransfer(*instruction)) break;
+  }
+
+  if (block->instructions.empty()) return nullptr;
+
+  block->endAddress = pc;
+
+  TranslatedBlock* const translated = block.get();
+  const std::uint32_t lastPage = (pc - 1) >> MemoryBlock::CodePageBits;
+  for (std::uint32_t page = address >> MemoryBlock::CodePageBits;
+       page <= lastPage; ++page)
+  {
+    pages[page].push_back(translated);
+  }
+  blocks[address] = std::move(block);
+  return translated;
+}
+
+void dlx::hardware::BlockCache::retire(TranslatedBlock* block)
+{
+  block->valid = false;
+
+  const auto unlink = [block](std::vector<TranslatedBlock*>& list)
+    {
+      list.erase(std::remove(list.begin(), list.end(), block), list.end());
+    };
+
+  for (int i = 0; i < 2; ++i)
+  {
+    if (block->successors[i]) unlink(block->successors[i]->predecessors);
+  }
+  for (auto predecessor = block->predecessors.begin();
+       predecessor != block->predecessors.end(); ++predecessor)
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      if ((*predecessor)->successors[i] == block)
+      {
+        (*predecessor)->successors[i] = nullptr;
+        (*predecessor)->successorAddresses[i] = 0;
+      }
+    }
+  }
+
+  const std::uint32_t lastPage =
+    (block->endAddress - 1) >> MemoryBlock::CodePageBits;
+  for (std::uint32_t page = block->startAddress >> MemoryBlock::CodePageBits;
+       page <= lastPage; ++page)
+  {
+    const auto entry = pages.find(page);
+    if (entry == pages.end()) continue;
+    unlink(entry->second);
+    if (entry->second.empty()) pages.erase(entry);
+  }
+
+  const auto entry = blocks.find(block->startAddress);
+  retired.push_back(std::move(entry->second));
+  blocks.erase(entry);
+}
+
+void dlx::hardware::BlockCache::invalidate(
+  std::uint32_t startAddress, std::uint32_t endAddress)
+{
+  const std::uint32_t lastPage = (endAddress - 1) >> MemoryBlock::CodePageBits;
+  for (std::uint32_t page = startAddress >> MemoryBlock::CodePageBits;
+       page <= lastPage; ++page)
+  {
+    const auto entry = pages.find(page);
+    if (entry == pages.end()) continue;
+
+    // Retiring a block removes it from the page, so the page is copied.
+    const std::vector<TranslatedBlock*> candidates = entry->second;
+    for (auto block = candidates.begin(); block != candidates.end(); ++block)
+    {
+      if ((*block)->startAddress < endAddress &&
+          startAddress < (*block)->endAddress)
+      {
+        retire(*block);
+      }
+    }
+  }
+}
+
+void dlx::hardware::BlockCache::clear()
+{
+  for (auto block = blocks.begin(); block != blocks.end(); ++block)
+  {
+    block->second->valid = false;
+    retired.push_back(std::move(block->second));
+  }
+  blocks.clear();
+  pages.clear();
+}
+
+const dlx::hardware::DecodedInstruction* dlx::hardware::ExecuteBlock(
+  DLXMachine* machine, TranslatedBlock* block)
+{
+  Register* const programCounter = &machine->programCounter;
+  std::uint64_t* const instructionCount = &machine->instructionCount;
+
+  // Stop part way through the block if it would pass the instruction limit.
+  const std::uint64_t remaining =
+    machine->instructionLimit - machine->instructionCount;
+  const DecodedInstruction* instruction = block->instructions.data();
+  const DecodedInstruction* const end =
+    instruction + std::min<std::uint64_t>(block->instructions.size(),
+                                          remaining);
+
+  // The count includes the whole block while it runs, so it is right for the
+  // trap or jump that ends it as it is for step(), and is corrected after.
+  const std::uint64_t startCount = *instructionCount;
+  *instructionCount += end - instruction;
+
+  // The profile counts the block as a whole, from where it starts to where
+  // it leaves off.
+  Profile* const profile = machine->profile.get();
+  const std::uint32_t startAddress = programCounter->value;
+  if (profile) profile->enter(machine->mem, startAddress);
+
+  try
+  {
+    if (IsTracing())
+    {
+      for (; instruction != end; ++instruction)
+      {
+        TraceInstruction(*machine, programCounter->value, *instruction);
+        programCounter->value += 4;
+        instruction->execute(machine, *instruction);
+        TraceResult(*machine, *instruction);
+        if (!block->valid) { ++instruction; break; }
+      }
+    }
+    else if (block->hasStores)
+    {
+      for (; instruction != end; ++instruction)
+      {
+        programCounter->value += 4;
+        instruction->execute(machine, *instruction);
+        if (!block->valid) { ++instruction; break; }
+      }
+    }
+    else
+    {
+      for (; instruction != end; ++instruction)
+      {
+        programCounter->value += 4;
+        instruction->execute(machine, *instruction);
+      }
+    }
+  }
+  catch (...)
+  {
+    // Count the instruction that raised the exception as well, as step()
+    // does.
+    const std::uint64_t executed =
+      (instruction - block->instructions.data()) + 1;
+    *instructionCount = startCount + executed;
+    if (profile) profile->leave(machine->mem, startAddress + executed * 4);
+    throw;
+  }
+
+  const std::uint64_t executed = instruction - block->instructions.data();
+  *instructionCount = startCount + executed;
+  if (profile) profile->leave(machine->mem, startAddress + executed * 4);
+  return instruction - 1;
+}
+
+const dlx::hardware::DecodedInstruction*
+dlx::hardware::RunBlocks(DLXMachine* machine)
+{
+  BlockCache& cache = machine->blocks;
+  TranslatedBlock* block = nullptr;
+
+  for (;;)
+  {
+    const std::uint32_t pc = machine->programCounter.value;
+
+    // Follow the link from the previous block, only looking up the block if
+    // this is the first time it has been reached from there.
+    TranslatedBlock* next =
+      (block && block->valid) ? block->successor(pc) : nullptr;
+    if (next == nullptr)
+    {
+      next = cache.lookup(machine, pc);
+      if (next == nullptr) return nullptr;
+
+      if (block && block->valid) block->link(pc, next);
+      cache.release();
+    }
+
+    block = next;
+
+    const DecodedInstruction* const last = ExecuteBlock(machine, block);
+
+    const auto operation = last->operation;
+    if (operation == operationIndex(0, 1) || operation == 17)
+    {
+      // Halt or trap.
+      machine->instructionRegister.value = last->word;
+      return last;
+    }
+
+    if (machine->instructionCount >= machine->instructionLimit) return last;
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,134 @@
+#ifndef DLX_BLOCK_CACHE_HPP_
+#define DLX_BLOCK_CACHE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : BlockCache
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides execution of translated blocks of instructions.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : A block is a straight-line run of instructions which ends
+//                with a branch, jump, trap or halt. Once a block has been
+//                translated, it is linked to the blocks that follow it so
+//                a loop can go from block to block without looking them up.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Decoder.hpp"
+#include "Memory.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+
+    struct TranslatedBlock
+    {
+      std::uint32_t startAddress;
+      std::uint32_t endAddress; // The address after the last instruction.
+
+      std::vector<DecodedInstruction> instructions;
+
+      // The blocks that have followed this one, along with the address they
+      // were reached at. A conditional branch fills both, an indirect jump
+      // replaces the second with the latest target.
+      TranslatedBlock* successors[2];
+      std::uint32_t successorAddresses[2];
+
+      // The blocks which have this one as a successor, so they can be
+      // unlinked from it when it is invalidated.
+      std::vector<TranslatedBlock*> predecessors;
+
+      // True if any of the instructions store to memory, which means it may
+      // modify its own instructions.
+      bool hasStores;
+
+      // This is cleared when the memory the block was translated from has
+      // been modified.
+      bool valid;
+
+      // The number of times the block has been executed and the native code
+      // for it, see Jit.hpp.
+      std::uint32_t executionCount;
+      const void* native;
+      std::uint32_t nativeGeneration;
+
+      // Returns the block that was linked for the given address, otherwise
+      // nullptr.
+      TranslatedBlock* successor(std::uint32_t address) const
+      {
+        if (successorAddresses[0] == address) return successors[0];
+        if (successorAddresses[1] == address) return successors[1];
+        return nullptr;
+      }
+
+      // Link the block for the given address as a successor of this one.
+      void link(std::uint32_t address, TranslatedBlock* block);
+    };
+
+    class BlockCache
+    {
+      std::unordered_map<std::uint32_t, std::unique_ptr<TranslatedBlock>>
+        blocks;
+
+      // The blocks with instructions in each page of code, see
+      // MemoryBlock::code, by the address shifted by CodePageBits.
+      std::unordered_map<std::uint32_t, std::vector<TranslatedBlock*>> pages;
+
+      // Blocks which have been invalidated, these are kept until it is safe
+      // to free them as one of them may be executing.
+      std::vector<std::unique_ptr<TranslatedBlock>> retired;
+
+      // Invalidate the block, unlinking it from the blocks before and after
+      // it.
+      void retire(TranslatedBlock* block);
+
+    public:
+      // The most instructions in a block.
+      static const std::size_t MaximumLength = 64;
+
+      // Returns the block that starts at the given address, translating it if
+      // needed. Returns nullptr if the address is outside the memory.
+      TranslatedBlock* lookup(DLXMachine* machine, std::uint32_t address);
+
+      // Invalidate the blocks which contain instructions in the range
+      // [startAddress, endAddress). Only the blocks in the pages of the range
+      // are looked at.
+      void invalidate(std::uint32_t startAddress, std::uint32_t endAddress);
+
+      // Frees the blocks which have been invalidated, this must not be called
+      // while one of the blocks is executing.
+      void release() { retired.clear(); }
+
+      void clear();
+    };
+
+    // Executes the instructions of the block until its end or, if it may
+    // modify itself, an instruction leaves it invalid.
+    //
+    // Returns the last instruction executed.
+    const DecodedInstruction* ExecuteBlock(
+      DLXMachine* machine, TranslatedBlock* block);
+
+    // Keep executing blocks of instructions until a halt or trap instruction
+    // has been performed or the program counter leaves memory.
+    //
+    // The number of instructions executed is the same as if each one was
+    // stepped through.
+    //
+    // Returns the instruction that it stopped on, or nullptr if the program
+    // counter is outside the addressable range.
+    const DecodedInstruction* RunBlocks(DLXMachine* machine);
+  }
+}
+
+#endif
@@ -0,0 +1,381 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Checkpoint
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides saving the state of a machine to a file and
+//                restoring it from there.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements writing the header and the pages of the blocks,
+//                and mapping them back.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Checkpoint.hpp"
+
+#include "Machine.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#if DEMU_MMAP
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  using dlx::hardware::MemoryBlock;
+
+  // "DLXC" when read as a little-endian word.
+  const std::uint32_t CheckpointMagic = 0x43584C44;
+  const std::uint32_t CheckpointVersion = 2;
+
+  // The contents of the blocks start on a multiple of this, which is a
+  // multiple of the size of the host's pages so they can be mapped.
+  const std::uint64_t RegionAlignment = 64 * 1024;
+
+  const std::uint32_t MaxBlocks = 64;
+
+  struct Header
+  {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t complete; // Zero while a save is being written.
+    std::uint32_t blockCount;
+    std::uint64_t saves;
+    std::uint64_t instructionCount;
+    std::int32_t registers[32];
+    std::int32_t programCounter;
+    std::uint32_t instructionRegister;
+    std::int32_t processorStatusWord;
+    std::int32_t exceptionAddress;
+    std::int32_t exceptionBase;
+    std::int32_t floatingPointStatus;
+    std::int32_t floatRegisters[32];
+
+    struct Block
+    {
+      std::uint32_t startAddress;
+      std::uint32_t reserved;
+      std::uint64_t endAddress;
+      std::uint64_t offset;
+      std::uint64_t size;
+    } blocks[MaxBlocks];
+  };
+
+  std::uint64_t Align(std::uint64_t offset)
+  {
+    return (offset + RegionAlignment - 1) & ~(RegionAlignment - 1);
+  }
+
+  // Returns true if the size bytes at data are all zero.
+  bool IsZero(const unsigned char* data, std::size_t size)
+  {
+    return std::all_of(data, data + size,
+                       [](unsigned char byte) { return byte == 0; });
+  }
+
+#if DEMU_MMAP
+  void WriteAll(int descriptor, const void* data, std::size_t size,
+                std::uint64_t offset)
+  {
+    const unsigned char* from = static_cast<const unsigned char*>(data);
+    while (size > 0)
+    {
+      const ssize_t written = pwrite(descriptor, from, size, offset);
+      if (written <= 0)
+      {
+        throw std::runtime_error("The checkpoint could not be written.");
+      }
+      from += written;
+      offset += written;
+      size -= written;
+    }
+  }
+#endif
+}
+
+dlx::hardware::Checkpoint::Checkpoint(
+  const char* filename, std::chrono::steady_clock::duration interval)
+: descriptor(-1),
+  interval(interval),
+  lastSave(std::chrono::steady_clock::now()),
+  saved(nullptr),
+  regions(),
+  saves(0),
+  pagesWritten(0)
+{
+#if DEMU_MMAP
+  // A machine restored from an earlier checkpoint of the same name keeps
+  // mapping the file it was restored from.
+  unlink(filename);
+  descriptor = open(filename, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (descriptor < 0)
+  {
+    throw std::runtime_error("The checkpoint could not be created.");
+  }
+#else
+  (void)filename;
+  throw std::runtime_error("Checkpoints are not supported on this host.");
+#endif
+}
+
+dlx::hardware::Checkpoint::~Checkpoint()
+{
+#if DEMU_MMAP
+  close(descriptor);
+#endif
+}
+
+bool dlx::hardware::Checkpoint::due() const
+{
+  return interval != std::chrono::steady_clock::duration::zero() &&
+         std::chrono::steady_clock::now() - lastSave >= interval;
+}
+
+std::uint64_t dlx::hardware::Checkpoint::writePages(
+  const Region& region, const std::vector<bool>& pages, bool full)
+{
+#if DEMU_MMAP
+  const unsigned char* const storage = region.block->storage.get();
+  const std::size_t pageSize = MemoryBlock::DirtyPageBytes;
+
+  // A full save leaves the pages which are zero as holes, while any other
+  // must write them as they may not have been zero in the previous save.
+  const auto wanted = [&](std::size_t page)
+  {
+    return pages[page] && !(full && IsZero(storage + page * pageSize,
+                                           pageSize));
+  };
+
+  // Consecutive pages are written together.
+  std::uint64_t written = 0;
+  for (std::size_t page = 0; page < pages.size();)
+  {
+    if (!wanted(page))
+    {
+      ++page;
+      continue;
+    }
+
+    std::size_t end = page + 1;
+    while (end < pages.size() && wanted(end)) ++end;
+    WriteAll(descriptor, storage + page * pageSize, (end - page) * pageSize,
+             region.offset + page * pageSize);
+    written += end - page;
+    page = end;
+  }
+  return written;
+#else
+  (void)region;
+  (void)pages;
+  (void)full;
+  (void)IsZero;
+  return 0;
+#endif
+}
+
+void dlx::hardware::Checkpoint::save(DLXMachine& machine)
+{
+#if DEMU_MMAP
+  const std::vector<std::unique_ptr<MemoryBlock>>& blocks = machine.mem.blocks;
+  if (blocks.size() > MaxBlocks)
+  {
+    throw std::runtime_error(
+      "The machine has too many memory blocks to checkpoint.");
+  }
+
+  // The dirty pages are only those since the previous save of the same
+  // machine with the same blocks, otherwise it is saved in full.
+  bool full = saved != &machine || regions.size() != blocks.size();
+  for (std::size_t i = 0; !full && i < blocks.size(); ++i)
+  {
+    full = regions[i].block != blocks[i].get();
+  }
+
+  if (full)
+  {
+    regions.clear();
+    std::uint64_t offset = Align(sizeof(Header));
+    for (auto block = blocks.begin(); block != blocks.end(); ++block)
+    {
+      const Region region = {
+        block->get(), offset, (*block)->storage.get_deleter().size
+      };
+      regions.push_back(region);
+      offset = Align(offset + region.size);
+    }
+
+    // Discard what was saved before, which leaves holes that read as zero.
+    if (ftruncate(descriptor, 0) != 0 || ftruncate(descriptor, offset) != 0)
+    {
+      throw std::runtime_error("The checkpoint could not be written.");
+    }
+  }
+
+  Header header = {};
+  header.magic = CheckpointMagic;
+  header.version = CheckpointVersion;
+  header.complete = 0;
+  header.blockCount = static_cast<std::uint32_t>(regions.size());
+  header.saves = saves + 1;
+  header.instructionCount = machine.instructionCount;
+  for (int i = 0; i < 32; ++i)
+  {
+    header.registers[i] = machine.registers[i].value;
+  }
+  header.programCounter = machine.programCounter.value;
+  header.instructionRegister = machine.instructionRegister.value;
+  header.processorStatusWord = machine.processorStatusWord.value;
+  header.exceptionAddress = machine.exceptionAddress.value;
+  header.exceptionBase = machine.exceptionBase.value;
+  header.floatingPointStatus = machine.floatingPointStatus.value;
+  for (unsigned int i = 0; i < 32; ++i)
+  {
+    header.floatRegisters[i] = machine.floatRegisters.at<std::int32_t>(i);
+  }
+  for (std::size_t i = 0; i < regions.size(); ++i)
+  {
+    header.blocks[i].startAddress = regions[i].block->startAddress;
+    header.blocks[i].endAddress = regions[i].block->endAddress;
+    header.blocks[i].offset = regions[i].offset;
+    header.blocks[i].size = regions[i].size;
+  }
+  WriteAll(descriptor, &header, sizeof(header), 0);
+
+  pagesWritten = 0;
+  for (std::size_t i = 0; i < regions.size(); ++i)
+  {
+    MemoryBlock& block = *blocks[i];
+    std::vector<bool> pages;
+    if (full)
+    {
+      pages = FindWrittenPages(block);
+    }
+    else
+    {
+      pages.resize(block.dirty.size() * 64);
+      for (std::size_t page = 0; page < pages.size(); ++page)
+      {
+        pages[page] = (block.dirty[page >> 6] >> (page & 63)) & 1;
+      }
+    }
+    pages.resize(std::min<std::size_t>(
+      pages.size(), regions[i].size / MemoryBlock::DirtyPageBytes));
+
+    pagesWritten += writePages(regions[i], pages, full);
+    std::fill(block.dirty.begin(), block.dirty.end(), 0);
+  }
+
+  // The pages must be in the file before the header says they all are.
+  if (fdatasync(descriptor) != 0)
+  {
+    throw std::runtime_error("The checkpoint could not be written.");
+  }
+  header.complete = 1;
+  WriteAll(descriptor, &header, sizeof(header), 0);
+
+  saved = &machine;
+  ++saves;
+  lastSave = std::chrono::steady_clock::now();
+#else
+  (void)machine;
+#endif
+}
+
+std::unique_ptr<dlx::hardware::DLXMachine>
+dlx::hardware::RestoreCheckpoint(const char* filename)
+{
+#if DEMU_MMAP
+  const int descriptor = open(filename, O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (descriptor < 0 || fstat(descriptor, &status) != 0)
+  {
+    if (descriptor >= 0) close(descriptor);
+    throw std::runtime_error("The checkpoint could not be read.");
+  }
+
+  // The blocks hold a copy of the descriptor, so it is closed however this
+  // ends.
+  struct Closer
+  {
+    int descriptor;
+    ~Closer() { close(descriptor); }
+  } closer = { descriptor };
+
+  Header header;
+  if (pread(descriptor, &header, sizeof(header), 0) !=
+        static_cast<ssize_t>(sizeof(header)) ||
+      header.magic != CheckpointMagic)
+  {
+    throw std::invalid_argument("The file is not a DLX checkpoint.");
+  }
+  if (header.version != CheckpointVersion)
+  {
+    throw std::invalid_argument(
+      "The version of the checkpoint is not supported.");
+  }
+  if (header.complete != 1)
+  {
+    throw std::invalid_argument(
+      "The checkpoint is incomplete as its last save was interrupted.");
+  }
+  if (header.blockCount == 0 || header.blockCount > MaxBlocks)
+  {
+    throw std::invalid_argument("The checkpoint has no memory blocks.");
+  }
+
+  std::shared_ptr<MemorySnapshot> memory(new MemorySnapshot());
+  for (std::uint32_t i = 0; i < header.blockCount; ++i)
+  {
+    const Header::Block& block = header.blocks[i];
+    if (block.endAddress <= block.startAddress ||
+        block.endAddress > (std::uint64_t(1) << 32) ||
+        block.size < block.endAddress - block.startAddress ||
+        block.offset % RegionAlignment != 0 ||
+        block.offset + block.size >
+          static_cast<std::uint64_t>(status.st_size))
+    {
+      throw std::invalid_argument(
+        "A memory block of the checkpoint is not valid.");
+    }
+
+    const MemorySnapshot::Block snapshotBlock = {
+      block.startAddress, block.endAddress,
+      std::make_shared<const PageFile>(
+        descriptor, static_cast<std::size_t>(block.offset),
+        static_cast<std::size_t>(block.size))
+    };
+    memory->blocks.push_back(snapshotBlock);
+  }
+
+  MachineSnapshot snapshot;
+  snapshot.memory = memory;
+  for (int i = 0; i < 32; ++i)
+  {
+    snapshot.registers[i] = header.registers[i];
+  }
+  snapshot.programCounter = header.programCounter;
+  snapshot.instructionRegister.value = header.instructionRegister;
+  snapshot.processorStatusWord = header.processorStatusWord;
+  snapshot.exceptionAddress = header.exceptionAddress;
+  snapshot.exceptionBase = header.exceptionBase;
+  snapshot.floatingPointStatus = header.floatingPointStatus;
+  for (unsigned int i = 0; i < 32; ++i)
+  {
+    snapshot.floatRegisters.at<std::int32_t>(i) = header.floatRegisters[i];
+  }
+  snapshot.instructionCount = header.instructionCount;
+  return std::unique_ptr<DLXMachine>(new DLXMachine(snapshot));
+#else
+  (void)filename;
+  throw std::runtime_error("Checkpoints are not supported on this host.");
+#endif
+}
+
+//===--------------------------- End of the file --------------------------===//
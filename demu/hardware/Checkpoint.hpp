@@ -0,0 +1,111 @@
+#ifndef DLX_CHECKPOINT_HPP_
+#define DLX_CHECKPOINT_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Checkpoint
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides saving the state of a machine to a file and
+//                restoring it from there.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The file starts with a header holding the registers and the
+//                layout of the memory blocks, followed by the contents of each
+//                block at an offset aligned to 64 KiB, in which the pages that
+//                are zero are left as holes.
+//
+//                The first save writes every page which may not be zero, and
+//                each one after it only the pages marked dirty since, see
+//                MemoryBlock::markDirty(). The header is marked incomplete
+//                while a save is being written, so one which is interrupted
+//                can't be restored as a mix of two states.
+//
+//                Restoring maps the contents of the blocks privately from the
+//                file, so the pages are read as the program touches them.
+//
+//                The header is in the byte order of the host, as a checkpoint
+//                is for resuming on the machine it was taken on.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Memory.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+
+    class Checkpoint
+    {
+      int descriptor;
+
+      // Save when run() has been going this long since the previous save, or
+      // only when save() is called if it is zero.
+      std::chrono::steady_clock::duration interval;
+      std::chrono::steady_clock::time_point lastSave;
+
+      // Where each block of the machine last saved is in the file.
+      struct Region
+      {
+        const MemoryBlock* block;
+        std::uint64_t offset;
+        std::uint64_t size;
+      };
+
+      const DLXMachine* saved;
+      std::vector<Region> regions;
+
+      std::uint64_t saves;
+      std::uint64_t pagesWritten;
+
+      // Writes the pages of the block with a flag set, and returns how many.
+      std::uint64_t writePages(const Region& region,
+                               const std::vector<bool>& pages, bool full);
+
+    public:
+      // Creates the file to save the checkpoints in, replacing any file of
+      // that name. The file is replaced rather than overwritten as a machine
+      // restored from it maps it.
+      //
+      // Throws std::runtime_error if it can't be created.
+      explicit Checkpoint(const char* filename,
+                          std::chrono::steady_clock::duration interval =
+                            std::chrono::steady_clock::duration::zero());
+      ~Checkpoint();
+
+      // Returns true if a save is due as the interval has passed.
+      bool due() const;
+
+      // Saves the registers and memory of the machine, which must not be
+      // running. Only one checkpoint should save a given machine, as saving
+      // clears its dirty pages.
+      //
+      // Throws std::runtime_error if it can't be written.
+      void save(DLXMachine& machine);
+
+      // The number of saves made, and the pages written by the last of them.
+      std::uint64_t Saves() const { return saves; }
+      std::uint64_t PagesWritten() const { return pagesWritten; }
+
+    private:
+      Checkpoint(const Checkpoint&);
+      Checkpoint& operator=(const Checkpoint&);
+    };
+
+    // Creates a machine with the registers and memory saved in the file.
+    //
+    // Throws std::runtime_error if it can't be read, or std::invalid_argument
+    // if it is not a complete checkpoint.
+    std::unique_ptr<DLXMachine> RestoreCheckpoint(const char* filename);
+  }
+}
+
+#endif
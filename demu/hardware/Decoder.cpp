@@ -0,0 +1,252 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Decoder
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides decoding of instructions and a cache of the result.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements decode(), which splits an instruction word into
+//                its operands and the function that performs it, and the
+//                DecodeCache, which decodes an instruction the first time it
+//                is fetched and finds the runs of instructions to fuse.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Decoder.hpp"
+
+#include "Instruction.hpp"
+
+#include <algorithm>
+
+// Returns true if the opcode is for a long-immediate instruction.
+static bool IsFormatL(unsigned int opcode)
+{
+  return opcode == 2 || opcode == 3 || opcode == 16 || opcode == 17;
+}
+
+// Returns true if the opcode is for an instruction whose immediate is
+// unsigned, being andi, ori, xori and lhi (12 to 15) and the shifts by an
+// immediate, slai, srli and srai (20, 22 and 23).
+static bool IsUnsignedImmediate(unsigned int opcode)
+{
+  return (opcode >= 12 && opcode <= 15) || opcode == 20 || opcode == 22 ||
+         opcode == 23;
+}
+
+const dlx::hardware::FusionPattern
+dlx::hardware::FusionPatterns[FusionCount] = {
+  { "slti+bnez", 2, { 26, 5 } },
+  { "slti+beqz", 2, { 26, 4 } },
+  { "addi+slti+bnez", 3, { 8, 26, 5 } },
+  { "lhi+ori", 2, { 15, 13 } },
+};
+
+int dlx::hardware::MatchFusion(
+  const DecodedInstruction* instructions, std::size_t count,
+  std::uint32_t enabled)
+{
+  int longest = -1;
+  for (unsigned int fusion = 0; fusion < FusionCount; ++fusion)
+  {
+    const FusionPattern& pattern = FusionPatterns[fusion];
+    if (!(enabled & (1u << fusion)) || pattern.length > count) continue;
+    if (longest >= 0 && pattern.length <= FusionPatterns[longest].length)
+    {
+      continue;
+    }
+
+    unsigned int i = 0;
+    while (i < pattern.length &&
+           instructions[i].operation == pattern.operations[i])
+    {
+      ++i;
+    }
+    if (i == pattern.length) longest = static_cast<int>(fusion);
+  }
+  return longest;
+}
+
+dlx::hardware::DecodedInstruction dlx::hardware::decode(std::uint32_t word)
+{
+  Instruction encoding;
+  encoding.value = word;
+
+  DecodedInstruction instruction;
+  instruction.word = word;
+  instruction.immediate = 0;
+  instruction.ri = 0;
+  instruction.rj = 0;
+  instruction.rk = 0;
+  instruction.modifier = 0;
+
+  const auto opcode = encoding.formatR.opcode;
+  instruction.operation = operationIndex(opcode, encoding.formatR.modifier);
+  instruction.dispatch = instruction.operation;
+  if (opcode == 0 || opcode == 1)
+  {
+    instruction.ri = encoding.formatR.ri;
+    instruction.rj = encoding.formatR.rj;
+    instruction.rk = encoding.formatR.rk;
+    instruction.modifier = encoding.formatR.modifier;
+
+    // Look-up the register-to-register instruction now rather than going via
+    // the handler for opcode 0 or 1 each time it is executed.
+    instruction.execute = (opcode == 0) ?
+      InstructionsFormatR[instruction.modifier] :
+      InstructionsFormatF[instruction.modifier];
+  }
+  else if (IsFormatL(opcode))
+  {
+    instruction.immediate = encoding.formatL.Lsgn;
+    instruction.execute = Instructions[opcode];
+  }
+  else
+  {
+    instruction.ri = encoding.formatI.ri;
+    instruction.rj = encoding.formatI.rj;
+
+    instruction.immediate = IsUnsignedImmediate(opcode) ?
+      static_cast<std::int32_t>(encoding.formatI.Kusn) :
+      static_cast<std::int32_t>(encoding.formatI.Ksgn);
+    instruction.execute = Instructions[opcode];
+  }
+
+  return instruction;
+}
+
+dlx::hardware::DecodeCache::DecodeCache()
+: regions(),
+  lastStart(0),
+  lastSize(0),
+  lastInstructions(nullptr),
+  fusions(DEMU_THREADED_DISPATCH ? AllFusions : 0)
+{
+}
+
+const dlx::hardware::DecodedInstruction*
+dlx::hardware::DecodeCache::miss(Memory& memory, std::uint32_t address)
+{
+  if (address % sizeof(std::uint32_t) != 0) return nullptr;
+
+  MemoryBlock* const block = memory[address];
+  if (block == nullptr) return nullptr;
+
+  const std::uint32_t size =
+    (block->endAddress - block->startAddress) / sizeof(std::uint32_t);
+
+  auto region = std::find_if(
+    regions.begin(), regions.end(),
+    [block](const Region& candidate) { return candidate.block == block; });
+  if (region == regions.end())
+  {
+    Region newRegion;
+    newRegion.block = block;
+    newRegion.instructions = AllocatePages<DecodedInstruction>(size);
+    regions.push_back(std::move(newRegion));
+    region = regions.end() - 1;
+  }
+
+  lastStart = block->startAddress;
+  lastSize = size * sizeof(std::uint32_t);
+  lastInstructions = region->instructions.get();
+
+  const std::uint32_t index =
+    (address - block->startAddress) / sizeof(std::uint32_t);
+  if (index >= size) return nullptr;
+
+  // A store to the page must now invalidate the instruction.
+  const auto decodeAt = [block, this](std::uint32_t at)
+    {
+      const std::uint32_t instructionAddress =
+        block->startAddress + at * sizeof(std::uint32_t);
+      block->markCode(instructionAddress);
+      lastInstructions[at] =
+        decode(block->load<std::uint32_t>(instructionAddress));
+    };
+
+  DecodedInstruction& instruction = lastInstructions[index];
+  if (!instruction.execute)
+  {
+    decodeAt(index);
+
+    // The instructions after one which may begin a fusion are needed to tell
+    // whether it does.
+    bool candidate = false;
+    for (unsigned int fusion = 0; fusion < FusionCount; ++fusion)
+    {
+      candidate = candidate ||
+        ((fusions & (1u << fusion)) &&
+         FusionPatterns[fusion].operations[0] == instruction.operation);
+    }
+
+    if (candidate)
+    {
+      const std::uint32_t count =
+        std::min<std::uint32_t>(size - index, MaximumFusionLength);
+      // Those which haven't been executed yet are left looking undecoded,
+      // so they are checked for fusions of their own when they are.
+      for (std::uint32_t i = 1; i < count; ++i)
+      {
+        DecodedInstruction& following = lastInstructions[index + i];
+        if (following.execute) continue;
+        decodeAt(index + i);
+        following.execute = nullptr;
+      }
+
+      const int fusion = MatchFusion(&instruction, count, fusions);
+      if (fusion >= 0) instruction.dispatch = OperationCount + fusion;
+    }
+  }
+  return &instruction;
+}
+
+void dlx::hardware::DecodeCache::invalidate(std::uint32_t address)
+{
+  for (auto region = regions.begin(); region != regions.end(); ++region)
+  {
+    if (region->block->contains(address))
+    {
+      const std::uint32_t index =
+        (address - region->block->startAddress) / sizeof(std::uint32_t);
+      const std::uint32_t size =
+        (region->block->endAddress - region->block->startAddress) /
+        sizeof(std::uint32_t);
+      if (index >= size) return;
+
+      DecodedInstruction* const instructions = region->instructions.get();
+      instructions[index].execute = nullptr;
+
+      // Those before it which were fused with it are decoded again too.
+      for (std::uint32_t before = 1;
+           before < MaximumFusionLength && before <= index; ++before)
+      {
+        DecodedInstruction& fused = instructions[index - before];
+        if (fused.execute && fused.dispatch >= OperationCount &&
+            FusionPatterns[fused.dispatch - OperationCount].length > before)
+        {
+          fused.execute = nullptr;
+        }
+      }
+      return;
+    }
+  }
+}
+
+void dlx::hardware::DecodeCache::setFusions(std::uint32_t enabled)
+{
+  fusions = enabled;
+  clear();
+}
+
+void dlx::hardware::DecodeCache::clear()
+{
+  regions.clear();
+  lastStart = 0;
+  lastSize = 0;
+  lastInstructions = nullptr;
+}
+
+//===--------------------------- End of the file --------------------------===//
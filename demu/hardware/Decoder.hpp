@@ -0,0 +1,244 @@
+#ifndef DLX_DECODER_HPP_
+#define DLX_DECODER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Decoder
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides decoding of instructions and a cache of the result.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : An instruction is decoded once into a DecodedInstruction,
+//                which holds the function that performs it along with the
+//                operands already extracted from the encoding.
+//
+//                The DecodeCache keeps the decoded instructions for each
+//                memory block indexed by (address - startAddress) / 4, so
+//                executing the same instruction again costs a single look-up.
+//
+//                When an instruction is decoded which begins one of the runs
+//                in FusionPatterns, the instructions after it are decoded too
+//                and it is marked to be performed along with them by a single
+//                handler of the threaded dispatch. Each of the instructions
+//                still has its own entry, so a branch to the middle of a run
+//                performs the rest of it one at a time.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Instructions.hpp"
+#include "Memory.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    struct DecodedInstruction
+    {
+      // The function that performs the instruction.
+      //
+      // This is nullptr if the instruction has yet to be decoded.
+      ExecuteInstruction execute;
+
+      // The instruction as it was encoded, in host byte order.
+      std::uint32_t word;
+
+      // The Ksgn/Kusn or Lsgn of the instruction extended to 32-bits.
+      std::int32_t immediate;
+
+      std::uint8_t ri;
+      std::uint8_t rj;
+      std::uint8_t rk;
+      std::uint8_t modifier;
+
+      // Identifies the instruction with a single index, see operationIndex().
+      std::uint8_t operation;
+
+      // The index the threaded dispatch jumps on, which is the operation or,
+      // if the instruction begins a run fused with those after it,
+      // OperationCount plus the Fusion.
+      std::uint8_t dispatch;
+
+      std::uint8_t opcode() const { return word >> 26; }
+    };
+
+    // Returns the index identifying the instruction with the given opcode and
+    // modifier. This is the opcode itself for format I and L instructions and
+    // 64 + modifier or 128 + modifier for opcode 0 and 1 respectively.
+    inline std::uint8_t operationIndex(unsigned int opcode,
+                                       unsigned int modifier)
+    {
+      return (opcode < 2) ? 64 * (opcode + 1) + modifier : opcode;
+    }
+
+    const unsigned int OperationCount = 192;
+
+    // The runs of instructions which are fused together. These are the
+    // hottest pairs in the profiles of the examples, see Profile::report(),
+    // where loops end by comparing a counter and branching on the result.
+    enum class Fusion : std::uint8_t
+    {
+      SltiBnez,     // slti then bnez.
+      SltiBeqz,     // slti then beqz.
+      AddiSltiBnez, // addi then slti then bnez.
+      LhiOri,       // lhi then ori, which loads a 32-bit constant.
+    };
+
+    const unsigned int FusionCount = 4;
+    const unsigned int MaximumFusionLength = 3;
+
+    // A bit for each Fusion.
+    const std::uint32_t AllFusions = (1u << FusionCount) - 1;
+
+    struct FusionPattern
+    {
+      const char* name; // The mnemonics joined by '+'.
+      unsigned int length;
+      std::uint8_t operations[MaximumFusionLength];
+    };
+
+    // Indexed by the Fusion.
+    extern const FusionPattern FusionPatterns[FusionCount];
+
+    // Returns the longest of the enabled fusions, given by a bit for each,
+    // which the count instructions in a row begin with, or -1 if there are
+    // none.
+    int MatchFusion(const DecodedInstruction* instructions, std::size_t count,
+                    std::uint32_t enabled);
+
+    // Returns true if the instruction may change the program counter other
+    // than by moving on to the next instruction, or stops the machine.
+    inline bool isControlTransfer(const DecodedInstruction& instruction)
+    {
+      switch (instruction.operation)
+      {
+        case 2:  // j
+        case 3:  // jal
+        case 4:  // beqz
+        case 5:  // bnez
+        case 6:  // bfpt
+        case 7:  // bfpf
+        case 16: // rfe
+        case 17: // trap
+        case 18: // jr
+        case 19: // jalr
+        case 65: // halt
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    // Returns true if the instruction stores to memory.
+    inline bool isStore(const DecodedInstruction& instruction)
+    {
+      return instruction.operation >= 40 && instruction.operation <= 47;
+    }
+
+    // Returns true if the instruction loads from memory.
+    inline bool isLoad(const DecodedInstruction& instruction)
+    {
+      return instruction.operation >= 32 && instruction.operation <= 39;
+    }
+
+    // Returns the integer register the instruction writes to, or 0 if there
+    // is none as r0 is never written.
+    inline unsigned int destinationRegister(
+      const DecodedInstruction& instruction)
+    {
+      const auto operation = instruction.operation;
+      if (operation == 3 || operation == 19) return 31; // jal and jalr
+      if ((operation >= 8 && operation <= 15) ||
+          (operation >= 20 && operation <= 37) ||
+          (operation >= 48 && operation <= 53))
+      {
+        return isStore(instruction) ? 0 : instruction.rj;
+      }
+      if (operation >= 64 && operation < 128 && instruction.modifier > 2 &&
+          instruction.modifier != 48 && // movi2s writes a special register,
+          instruction.modifier != 50 && // and movf, movd and movi2fp write
+          instruction.modifier != 51 && // floating point registers.
+          instruction.modifier != 53)
+      {
+        return instruction.rk;
+      }
+      if (operation == 142 || operation == 143 || // mult and div
+          operation == 150 || operation == 151)   // multu and divu
+      {
+        return instruction.rk;
+      }
+      return 0;
+    }
+
+    // Decodes the instruction given by word, which is in host byte order.
+    DecodedInstruction decode(std::uint32_t word);
+
+    class DecodeCache
+    {
+      struct Region
+      {
+        const MemoryBlock* block;
+        // This is reserved for the whole block but, as the memory is only
+        // committed when touched, costs only as much as what is decoded.
+        std::unique_ptr<DecodedInstruction[], PageDeleter> instructions;
+      };
+
+      std::vector<Region> regions;
+
+      // The region used by the previous look-up, as the next instruction is
+      // almost always in the same block.
+      std::uint32_t lastStart;
+      std::uint64_t lastSize;
+      DecodedInstruction* lastInstructions;
+
+      // The fusions which are made, a bit for each Fusion.
+      std::uint32_t fusions;
+
+      // Handles the look-up when the address is not in the last region or
+      // the instruction has yet to be decoded.
+      const DecodedInstruction* miss(Memory& memory, std::uint32_t address);
+
+    public:
+      DecodeCache();
+
+      // Returns the decoded instruction at the given address, decoding it if
+      // this is the first time it has been seen.
+      //
+      // Returns nullptr if the address is misaligned or outside the memory,
+      // for the caller to raise the exception with Memory::fault().
+      const DecodedInstruction* operator()(Memory& memory,
+                                           std::uint32_t address)
+      {
+        const std::uint32_t offset = address - lastStart;
+        if (offset < lastSize && (offset & 3) == 0)
+        {
+          const DecodedInstruction& instruction =
+            lastInstructions[offset / sizeof(std::uint32_t)];
+          if (instruction.execute) return &instruction;
+        }
+        return miss(memory, address);
+      }
+
+      // Discard the decoded instruction at the given address, and any fused
+      // with it, such that it is decoded again the next time it is executed.
+      void invalidate(std::uint32_t address);
+
+      // Set the fusions to make, with a bit for each Fusion, which discards
+      // all decoded instructions. All of them are made by default when the
+      // dispatch is threaded, and none otherwise as only it performs them.
+      void setFusions(std::uint32_t enabled);
+      std::uint32_t Fusions() const { return fusions; }
+
+      // Discard all decoded instructions.
+      void clear();
+    };
+  }
+}
+
+#endif
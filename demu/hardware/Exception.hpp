@@ -0,0 +1,60 @@
+#ifndef DLX_EXCEPTION_HPP_
+#define DLX_EXCEPTION_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Exception
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides the exceptions raised by the instructions a program
+//                executes.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The machine has no handlers for exceptions, so one raised by
+//                an instruction stops the machine as the C++ exception
+//                GuestException. As with any other exception from run(), the
+//                instruction which raised it has been counted and the program
+//                counter is the address after it.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    enum class ExceptionCause
+    {
+      MisalignedAccess, // A load, store or fetch not aligned to its size.
+      OutsideMemory,    // A load, store or fetch outside the blocks of memory.
+      DivideByZero,     // A div or divu by zero.
+    };
+
+    class GuestException : public std::runtime_error
+    {
+      ExceptionCause exceptionCause;
+      std::uint32_t exceptionAddress;
+
+    public:
+      GuestException(ExceptionCause cause, std::uint32_t address,
+                     const std::string& message)
+      : std::runtime_error(message),
+        exceptionCause(cause),
+        exceptionAddress(address)
+      {
+      }
+
+      ExceptionCause cause() const { return exceptionCause; }
+
+      // The address of the memory the instruction accessed, which for a fetch
+      // or a divide by zero is the address of the instruction.
+      std::uint32_t address() const { return exceptionAddress; }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef DLX_FLOATINGPOINT_HPP_
+#define DLX_FLOATINGPOINT_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : FloatingPoint
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides the floating point registers.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : There are 32 single precision registers, f0 to f31, and each
+//                even/odd pair of them holds a double precision value, so
+//                f0 and f1 are the first double, f2 and f3 the second and so
+//                on. The even register of a pair is the upper half of the
+//                double, as it is the word stored first by sd.
+//
+//                The registers are stored as 16 host doubles, with each single
+//                placed in the half of the double that the host keeps it in,
+//                so a single or a double is read and written as a plain float
+//                or double without converting between them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Memory.hpp"
+
+#include <cstdint>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    // The index of the float within a double which holds the even register
+    // of the pair, that is the upper half of the double.
+#if DEMU_HOST_BIG_ENDIAN
+    const unsigned int UpperHalf = 0;
+#else
+    const unsigned int UpperHalf = 1;
+#endif
+
+    class FloatingPointRegisters
+    {
+      // This relies on the compiler allowing a union to be read as a member
+      // other than the one last written, as GCC, Clang and MSVC all do.
+      union
+      {
+        float singles[32];
+        double doubles[16];
+        std::int32_t words[32];
+        std::uint64_t pairs[16];
+      };
+
+    public:
+      FloatingPointRegisters() : pairs() {}
+
+      // Returns the register as a value of type T, which is float or
+      // std::int32_t for a single register and double or std::uint64_t for
+      // the pair it is in. The odd register of a pair gives the whole pair.
+      //
+      // The integer types give the bits of the register, for moving it
+      // without changing it and for the integers the conversions use.
+      template<typename T>
+      T& at(unsigned int index);
+
+      template<typename T>
+      const T& at(unsigned int index) const
+      {
+        return const_cast<FloatingPointRegisters*>(this)->at<T>(index);
+      }
+    };
+
+    template<>
+    inline float& FloatingPointRegisters::at<float>(unsigned int index)
+    {
+      return singles[index ^ UpperHalf];
+    }
+
+    template<>
+    inline std::int32_t&
+    FloatingPointRegisters::at<std::int32_t>(unsigned int index)
+    {
+      return words[index ^ UpperHalf];
+    }
+
+    template<>
+    inline double& FloatingPointRegisters::at<double>(unsigned int index)
+    {
+      return doubles[index >> 1];
+    }
+
+    template<>
+    inline std::uint64_t&
+    FloatingPointRegisters::at<std::uint64_t>(unsigned int index)
+    {
+      return pairs[index >> 1];
+    }
+  }
+}
+
+#endif
@@ -14,10 +14,18 @@
 
 #include "Instructions.hpp"
 
+#include "Decoder.hpp"
+#include "Exception.hpp"
 #include "Machine.hpp"
 #include "Instruction.hpp"
+#include "Trace.hpp"
 
+#include <cstdint>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <sstream>
 
 // Disable the warning about unused variables until all the instructions are
 // implemented.
@@ -26,16 +34,14 @@
 #pragma warning(disable : 4189)
 #endif
 
-static void HandleFormatRInstructions(dlx::hardware::DLXMachine* machine)
+static void HandleFormatRInstructions(
+  dlx::hardware::DLXMachine* machine,
+  const dlx::hardware::DecodedInstruction& instruction)
 {
-  const auto instruction =
-    machine->instruction(dlx::hardware::InstructionRegisterToRegister());
-  std::cout << "Executing a format R instruction modifier="
-            <<  instruction.modifier
-            << std::endl;
   if (dlx::hardware::InstructionsFormatR[instruction.modifier])
   {
-    dlx::hardware::InstructionsFormatR[instruction.modifier](machine);
+    dlx::hardware::InstructionsFormatR[instruction.modifier](
+      machine, instruction);
   }
   else
   {
@@ -43,17 +49,33 @@ static void HandleFormatRInstructions(dlx::hardware::DLXMachine* machine)
   }
 }
 
-static void HandleFormatFInstructions(dlx::hardware::DLXMachine*)
+static void HandleFormatFInstructions(
+  dlx::hardware::DLXMachine* machine,
+  const dlx::hardware::DecodedInstruction& instruction)
 {
-  std::cerr << "Floating point instructions are not supported." << std::endl;
+  dlx::hardware::InstructionsFormatF[instruction.modifier](
+    machine, instruction);
 }
 
-static void HandleIllegalInstruction(dlx::hardware::DLXMachine*)
+static void HandleIllegalInstruction(
+  dlx::hardware::DLXMachine*, const dlx::hardware::DecodedInstruction&)
 {
   std::cerr << "There is no instruction for this given opcode, making this an "
                "illegal instruction." << std::endl;
 }
 
+// Raises the exception for a div or divu by zero, which is the instruction
+// just performed.
+[[noreturn]] static void DivideByZero(dlx::hardware::DLXMachine* machine)
+{
+  const std::uint32_t address = machine->ProgramCounter() - 4;
+  std::ostringstream message;
+  message << "A division by zero at 0x" << std::hex << std::setfill('0')
+          << std::setw(8) << address << ".";
+  throw dlx::hardware::GuestException(
+    dlx::hardware::ExceptionCause::DivideByZero, address, message.str());
+}
+
 namespace dlx
 {
 	namespace instructions
@@ -62,942 +84,1289 @@ namespace dlx
 		struct Base
 		{
 		  typedef Format format_type;
-
-		  // Reurns the instruction encoding for the given instruction as read
-		  // from the machine.
-		  static format_type Instruction(hardware::DLXMachine* machine);
 		};
 
     struct add : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct addi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct addu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct addui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
-	  struct and : Base<hardware::InstructionRegisterToRegister>
+	  struct and_ : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct andi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct beqz : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct bnez : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
+	  };
+
+	  struct div : Base<hardware::InstructionRegisterToRegister>
+	  {
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
+	  };
+
+	  struct divu : Base<hardware::InstructionRegisterToRegister>
+	  {
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct halt : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct j : Base<hardware::InstructionLongImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct jal : Base<hardware::InstructionLongImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct jalr : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct jr : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lb : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lbu : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lh : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lhi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lhu : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct lw : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct movi2s : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct movs2i : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
+	  };
+
+	  struct mult : Base<hardware::InstructionRegisterToRegister>
+	  {
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
+	  };
+
+	  struct multu : Base<hardware::InstructionRegisterToRegister>
+	  {
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct nop : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
-	  struct or : Base<hardware::InstructionRegisterToRegister>
+	  struct or_ : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct ori : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct rfe : Base<hardware::InstructionLongImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sb : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct seq : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct seqi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sequ : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sequi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sge : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgei : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgeu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgeui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgt : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgti : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgtu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sgtui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sh : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sla : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct slai : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sle : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct slei : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sleu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sleui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sll : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct slli : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct slt : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct slti : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sltu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sltui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sne : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct snei : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sneu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sneui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sra : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct srai : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct srl : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct srli : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sub : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct subi : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct subu : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct subui : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct sw : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct trap : Base<hardware::InstructionLongImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct wait : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
-	  struct xor : Base<hardware::InstructionRegisterToRegister>
+	  struct xor_ : Base<hardware::InstructionRegisterToRegister>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 
 	  struct xori : Base<hardware::InstructionImmediate>
 	  {
-	    static void execute(hardware::DLXMachine* machine);
+	    static void execute(hardware::DLXMachine* machine,
+	                        const hardware::DecodedInstruction& instruction);
 	  };
 	}
 }
 
-template<typename Format>
-Format dlx::instructions::Base<Format>::Instruction(hardware::DLXMachine* machine)
+// The floating point instructions are the same for single and double
+// precision other than the type, T, they read the registers as, see
+// FloatingPoint.hpp. They are performed with the host's own floating point.
+namespace dlx
 {
-  return machine->instruction(Format());
+  namespace instructions
+  {
+    // Converts a value to the type To.
+    template<typename To>
+    struct Converted
+    {
+      template<typename From>
+      static To from(From value) { return static_cast<To>(value); }
+    };
+
+    // The conversion to an integer is rounded towards zero, and as C++ leaves
+    // it undefined for a value out of range or NaN, those give the most
+    // negative integer as they do on x86.
+    template<>
+    struct Converted<std::int32_t>
+    {
+      template<typename From>
+      static std::int32_t from(From value)
+      {
+        return (value > -2147483649.0 && value < 2147483648.0) ?
+          static_cast<std::int32_t>(value) :
+          std::numeric_limits<std::int32_t>::min();
+      }
+    };
+
+    // fk = fi <operation> fj
+    template<typename T, typename Operation>
+    struct FloatArithmetic : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        hardware::FloatingPointRegisters& f = machine->FloatRegisters();
+        f.at<T>(instruction.rk) =
+          Operation()(f.at<T>(instruction.ri), f.at<T>(instruction.rj));
+      }
+    };
+
+    // fk = fj converted from From to To, where an integer is held in a single
+    // register as std::int32_t.
+    template<typename From, typename To>
+    struct FloatConvert : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        hardware::FloatingPointRegisters& f = machine->FloatRegisters();
+        f.at<To>(instruction.rk) =
+          Converted<To>::from(f.at<From>(instruction.rj));
+      }
+    };
+
+    // fpsr = fi <compare> fj
+    template<typename T, typename Compare>
+    struct FloatCompare : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        const hardware::FloatingPointRegisters& f =
+          machine->ConstFloatRegisters();
+        machine->SetFloatingPointStatus(
+          Compare()(f.at<T>(instruction.ri), f.at<T>(instruction.rj)));
+      }
+    };
+
+    // fk = fj, copying the bits of a single or double unchanged.
+    template<typename T>
+    struct FloatMove : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        hardware::FloatingPointRegisters& f = machine->FloatRegisters();
+        f.at<T>(instruction.rk) = f.at<T>(instruction.rj);
+      }
+    };
+
+    // if fpsr == Status then pc = pc + SignExt(Ksgn)
+    template<bool Status>
+    struct FloatBranch : Base<hardware::InstructionImmediate>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        if (machine->FloatingPointStatus() == Status)
+        {
+          machine->SetProgramCounter(
+            machine->ProgramCounter() + instruction.immediate);
+        }
+      }
+    };
+
+    // fj = Memory[ri + SignExt(Ksgn)], of a single or a double.
+    template<typename T>
+    struct FloatLoad : Base<hardware::InstructionImmediate>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        machine->FloatRegisters().at<T>(instruction.rj) = machine->load<T>(
+          machine->ConstRegisters()[instruction.ri] + instruction.immediate);
+      }
+    };
+
+    // Memory[ri + SignExt(Ksgn)] = fj, of a single or a double.
+    template<typename T>
+    struct FloatStore : Base<hardware::InstructionImmediate>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        machine->store(
+          machine->ConstRegisters()[instruction.ri] + instruction.immediate,
+          machine->ConstFloatRegisters().at<T>(instruction.rj));
+      }
+    };
+
+    // rk = fj
+    struct movfp2i : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        machine->Registers()[instruction.rk] =
+          machine->ConstFloatRegisters().at<std::int32_t>(instruction.rj);
+      }
+    };
+
+    // fk = rj
+    struct movi2fp : Base<hardware::InstructionRegisterToRegister>
+    {
+      static void execute(hardware::DLXMachine* machine,
+                          const hardware::DecodedInstruction& instruction)
+      {
+        machine->FloatRegisters().at<std::int32_t>(instruction.rk) =
+          machine->ConstRegisters()[instruction.rj].value;
+      }
+    };
+
+    typedef FloatArithmetic<float, std::plus<float>> addf;
+    typedef FloatArithmetic<float, std::minus<float>> subf;
+    typedef FloatArithmetic<float, std::multiplies<float>> multf;
+    typedef FloatArithmetic<float, std::divides<float>> divf;
+    typedef FloatArithmetic<double, std::plus<double>> addd;
+    typedef FloatArithmetic<double, std::minus<double>> subd;
+    typedef FloatArithmetic<double, std::multiplies<double>> multd;
+    typedef FloatArithmetic<double, std::divides<double>> divd;
+
+    typedef FloatConvert<float, double> cvtf2d;
+    typedef FloatConvert<float, std::int32_t> cvtf2i;
+    typedef FloatConvert<double, float> cvtd2f;
+    typedef FloatConvert<double, std::int32_t> cvtd2i;
+    typedef FloatConvert<std::int32_t, float> cvti2f;
+    typedef FloatConvert<std::int32_t, double> cvti2d;
+
+    typedef FloatCompare<float, std::equal_to<float>> eqf;
+    typedef FloatCompare<float, std::not_equal_to<float>> nef;
+    typedef FloatCompare<float, std::less<float>> ltf;
+    typedef FloatCompare<float, std::greater<float>> gtf;
+    typedef FloatCompare<float, std::less_equal<float>> lef;
+    typedef FloatCompare<float, std::greater_equal<float>> gef;
+    typedef FloatCompare<double, std::equal_to<double>> eqd;
+    typedef FloatCompare<double, std::not_equal_to<double>> ned;
+    typedef FloatCompare<double, std::less<double>> ltd;
+    typedef FloatCompare<double, std::greater<double>> gtd;
+    typedef FloatCompare<double, std::less_equal<double>> led;
+    typedef FloatCompare<double, std::greater_equal<double>> ged;
+
+    typedef FloatMove<std::int32_t> movf;
+    typedef FloatMove<std::uint64_t> movd;
+    typedef FloatBranch<true> bfpt;
+    typedef FloatBranch<false> bfpf;
+    typedef FloatLoad<std::int32_t> lf;
+    typedef FloatLoad<std::uint64_t> ld;
+    typedef FloatStore<std::int32_t> sf;
+    typedef FloatStore<std::uint64_t> sd;
+  }
 }
 
 // Provides implementations for the instructions here.
-void dlx::instructions::add::execute(hardware::DLXMachine* machine)
+void dlx::instructions::add::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing add" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] +
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::addi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::addi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  const auto instruction = Instruction(machine);
-  std::cout << "Performing addi r" << instruction.rj
-            << " = r" << instruction.ri << " + " << instruction.Ksgn
-            << std::endl;
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] + instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] + instruction.immediate;
 }
 
-void dlx::instructions::addu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::addu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing addu" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] +
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::addui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::addui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing addui" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] + instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] + instruction.immediate;
 }
 
-void dlx::instructions::and::execute(hardware::DLXMachine* machine)
+void dlx::instructions::and_::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing and" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] &
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::andi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::andi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing andi" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] & instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] & instruction.immediate;
 }
 
-void dlx::instructions::beqz::execute(hardware::DLXMachine* machine)
+void dlx::instructions::beqz::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing beqz" << std::endl;
   // if ri == 0 then pc = pc + SignExt(Ksgn)
-  const auto instruction = Instruction(machine);
   if (machine->ConstRegisters()[instruction.ri].value ==0)
   {
-    machine->SetProgramCounter(machine->ProgramCounter() + instruction.Ksgn);
+    machine->SetProgramCounter(
+      machine->ProgramCounter() + instruction.immediate);
   }
 }
 
-void dlx::instructions::bnez::execute(hardware::DLXMachine* machine)
+void dlx::instructions::bnez::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing bnez" << std::endl;
   // if ri != 0 then pc = pc + SignExt(Ksgn)
-  const auto instruction = Instruction(machine);
   if (machine->ConstRegisters()[instruction.ri].value !=0)
   {
-    machine->SetProgramCounter(machine->ProgramCounter() + instruction.Ksgn);
+    machine->SetProgramCounter(
+      machine->ProgramCounter() + instruction.immediate);
   }
 }
 
-void dlx::instructions::halt::execute(hardware::DLXMachine*)
+void dlx::instructions::div::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
+{
+  // The quotient is rounded towards zero, and the one that doesn't fit wraps
+  // around as the other arithmetic does.
+  const auto riValue = machine->ConstRegisters()[instruction.ri].value;
+  const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
+  if (rjValue == 0) DivideByZero(machine);
+  machine->Registers()[instruction.rk] =
+    (rjValue == -1) ? static_cast<std::int32_t>(
+                        0u - static_cast<std::uint32_t>(riValue)) :
+                      riValue / rjValue;
+}
+
+void dlx::instructions::divu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
+{
+  const auto riValue = static_cast<std::uint32_t>(
+    machine->ConstRegisters()[instruction.ri].value);
+  const auto rjValue = static_cast<std::uint32_t>(
+    machine->ConstRegisters()[instruction.rj].value);
+  if (rjValue == 0) DivideByZero(machine);
+  machine->Registers()[instruction.rk] =
+    static_cast<std::int32_t>(riValue / rjValue);
+}
+
+void dlx::instructions::halt::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
-  std::cout << "Halting..." << std::endl;
 }
 
-void dlx::instructions::j::execute(hardware::DLXMachine* machine)
+void dlx::instructions::j::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing j" << std::endl;
-  const auto instruction = Instruction(machine);
+  // pc = pc + SignExt(Lsgn)
+  machine->SetProgramCounter(machine->ProgramCounter() + instruction.immediate);
 }
 
-void dlx::instructions::jal::execute(hardware::DLXMachine* machine)
+void dlx::instructions::jal::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing jal" << std::endl;
   // r31 = pc; pc = pc + SignExt(Lsgn)
-  const auto instruction = Instruction(machine);
   machine->Registers()[31] = machine->ProgramCounter();
-  machine->SetProgramCounter(machine->ProgramCounter() + instruction.Lsgn);
+  machine->SetProgramCounter(machine->ProgramCounter() + instruction.immediate);
 }
 
-void dlx::instructions::jalr::execute(hardware::DLXMachine* machine)
+void dlx::instructions::jalr::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing jalr" << std::endl;
-  const auto instruction = Instruction(machine);
+  // r31 = pc; pc = ri, where ri is read first as it may be r31.
+  const std::int32_t target = machine->ConstRegisters()[instruction.ri].value;
+  machine->Registers()[31] = machine->ProgramCounter();
+  machine->SetProgramCounter(target);
 }
 
-void dlx::instructions::jr::execute(hardware::DLXMachine* machine)
+void dlx::instructions::jr::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing jr" << std::endl;
   // pc = ri
-  const auto instruction = Instruction(machine);
   machine->SetProgramCounter(machine->ConstRegisters()[instruction.ri].value);
 }
 
-void dlx::instructions::lb::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lb::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lb" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] =
+    machine->load<std::int8_t>(
+      machine->ConstRegisters()[instruction.ri] + instruction.immediate);
 }
 
-void dlx::instructions::lbu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lbu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lbu" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] =
+    machine->load<std::uint8_t>(
+      machine->ConstRegisters()[instruction.ri] + instruction.immediate);
 }
 
-void dlx::instructions::lh::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lh::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lh" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] =
+    machine->load<std::int16_t>(
+      machine->ConstRegisters()[instruction.ri] + instruction.immediate);
 }
 
-void dlx::instructions::lhi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lhi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lhi" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] = static_cast<std::int32_t>(
+    static_cast<std::uint32_t>(instruction.immediate) << 16);
 }
 
-void dlx::instructions::lhu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lhu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lhu" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] =
+    machine->load<std::uint16_t>(
+      machine->ConstRegisters()[instruction.ri] + instruction.immediate);
 }
 
-void dlx::instructions::lw::execute(hardware::DLXMachine* machine)
+void dlx::instructions::lw::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing lw" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  machine->Registers()[instruction.rj] =
+    machine->load<std::int32_t>(
+      machine->ConstRegisters()[instruction.ri] + instruction.immediate);
 }
 
-void dlx::instructions::movi2s::execute(hardware::DLXMachine* machine)
+void dlx::instructions::movi2s::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
-  std::cout << "Performing movi2s" << std::endl;
-  const auto instruction = Instruction(machine);
 //  machine->Registers()[instruction.rk] =
 //    machine->ConstRegisters()[instruction.ri] OP
 //    machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::movs2i::execute(hardware::DLXMachine* machine)
+void dlx::instructions::movs2i::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
-  std::cout << "Performing movs2i" << std::endl;
-  const auto instruction = Instruction(machine);
 //  machine->Registers()[instruction.rk] =
 //    machine->ConstRegisters()[instruction.ri] OP
 //    machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::nop::execute(hardware::DLXMachine*)
+void dlx::instructions::mult::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
+{
+  // Only the low 32 bits of the product are kept, which are the same whether
+  // it is signed or not.
+  const auto riValue = static_cast<std::uint32_t>(
+    machine->ConstRegisters()[instruction.ri].value);
+  const auto rjValue = static_cast<std::uint32_t>(
+    machine->ConstRegisters()[instruction.rj].value);
+  machine->Registers()[instruction.rk] =
+    static_cast<std::int32_t>(riValue * rjValue);
+}
+
+void dlx::instructions::multu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
+{
+  mult::execute(machine, instruction);
+}
+
+void dlx::instructions::nop::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
 }
 
-void dlx::instructions::or::execute(hardware::DLXMachine* machine)
+void dlx::instructions::or_::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing or" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] |
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::ori::execute(hardware::DLXMachine* machine)
+void dlx::instructions::ori::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing ori" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] | instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] | instruction.immediate;
 }
 
-void dlx::instructions::rfe::execute(hardware::DLXMachine* machine)
+void dlx::instructions::rfe::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
-  std::cout << "Performing rfe" << std::endl;
-  const auto instruction = Instruction(machine);
-
 }
 
-void dlx::instructions::sb::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sb::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sb" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  const std::uint8_t value =
+    static_cast<std::uint8_t>(machine->ConstRegisters()[instruction.rj].value);
+  machine->store(
+    machine->ConstRegisters()[instruction.ri] + instruction.immediate, value);
 }
 
-void dlx::instructions::seq::execute(hardware::DLXMachine* machine)
+void dlx::instructions::seq::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing seq" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     (machine->ConstRegisters()[instruction.ri] ==
      machine->ConstRegisters()[instruction.rj]) ? 1 : 0;
 }
 
-void dlx::instructions::seqi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::seqi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing seqi" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    (machine->ConstRegisters()[instruction.ri] == instruction.Ksgn) ? 1 : 0;
+    (machine->ConstRegisters()[instruction.ri] == instruction.immediate) ?
+    1 : 0;
 }
 
-void dlx::instructions::sequ::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sequ::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sequ" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     (machine->ConstRegisters()[instruction.ri] ==
      machine->ConstRegisters()[instruction.rj]) ? 1 : 0;
 }
 
-void dlx::instructions::sequi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sequi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sequi" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   machine->Registers()[instruction.rj] =
-    (riValue == instruction.Ksgn) ? 1 : 0;
+    (riValue == instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sge::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sge::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sge" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue <= rjValue) ? 0 : 1;
 }
 
-void dlx::instructions::sgei::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgei::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgei" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   machine->Registers()[instruction.rj] =
-    (riValue >= instruction.Ksgn) ? 1 : 0;
+    (riValue >= instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sgeu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgeu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgeu" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue >= rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::sgeui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgeui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgeui" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   machine->Registers()[instruction.rj] =
-    (riValue >= instruction.Ksgn) ? 1 : 0;
+    (riValue >= instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sgt::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgt::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgt" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue > rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::sgti::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgti::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgti" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
-  machine->Registers()[instruction.rj] = (riValue > instruction.Ksgn) ? 1 : 0;
+  machine->Registers()[instruction.rj] =
+    (riValue > instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sgtu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgtu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgtu" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue > rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::sgtui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sgtui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sgtui" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
-  machine->Registers()[instruction.rj] = (riValue > instruction.Ksgn) ? 1 : 0;
+  machine->Registers()[instruction.rj] =
+    (riValue > instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sh::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sh::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sh" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  const std::uint16_t value =
+    static_cast<std::uint16_t>(machine->ConstRegisters()[instruction.rj].value);
+  machine->store(
+    machine->ConstRegisters()[instruction.ri] + instruction.immediate, value);
 }
 
-void dlx::instructions::sla::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sla::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sla" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = riValue << rjValue;
 }
 
-void dlx::instructions::slai::execute(hardware::DLXMachine* machine)
+void dlx::instructions::slai::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing slai" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri].value << instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri].value << instruction.immediate;
 }
 
-void dlx::instructions::sle::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sle::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sle" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue <= rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::slei::execute(hardware::DLXMachine* machine)
+void dlx::instructions::slei::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing slei" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   machine->Registers()[instruction.rj] =
-    (riValue <= instruction.Ksgn) ? 1 : 0;
+    (riValue <= instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sleu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sleu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sleu" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue <= rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::sleui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sleui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sleui" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   machine->Registers()[instruction.rj] =
-    (riValue <= instruction.Ksgn) ? 1 : 0;
+    (riValue <= instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sll::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sll::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sll" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = riValue << rjValue;
 }
 
-void dlx::instructions::slli::execute(hardware::DLXMachine* machine)
+void dlx::instructions::slli::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing slli" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
-  machine->Registers()[instruction.rj] = riValue << instruction.Kusn;
+  machine->Registers()[instruction.rj] = riValue << instruction.immediate;
 }
 
-void dlx::instructions::slt::execute(hardware::DLXMachine* machine)
+void dlx::instructions::slt::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing slt" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue < rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::slti::execute(hardware::DLXMachine* machine)
+void dlx::instructions::slti::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing slti" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
-  std::cout << std::dec << "slti (" << riValue << " < " << instruction.Ksgn << ")"
-            << std::endl;
   machine->Registers()[instruction.rj] =
-    (riValue < instruction.Ksgn) ? 1 : 0;
+    (riValue < instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sltu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sltu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sltu" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
   const auto rjValue = machine->ConstRegisters()[instruction.rj].value;
   machine->Registers()[instruction.rk] = (riValue < rjValue) ? 1 : 0;
 }
 
-void dlx::instructions::sltui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sltui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sltui" << std::endl;
-  const auto instruction = Instruction(machine);
   const auto riValue = machine->ConstRegisters()[instruction.ri].value;
-  machine->Registers()[instruction.rj] = (riValue < instruction.Ksgn) ? 1 : 0;
+  machine->Registers()[instruction.rj] =
+    (riValue < instruction.immediate) ? 1 : 0;
 }
 
-void dlx::instructions::sne::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sne::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sne" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     (machine->ConstRegisters()[instruction.ri] !=
      machine->ConstRegisters()[instruction.rj]) ? 1 : 0;
 }
 
-void dlx::instructions::snei::execute(hardware::DLXMachine* machine)
+void dlx::instructions::snei::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing snei" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    (machine->ConstRegisters()[instruction.ri] != instruction.Ksgn) ? 1 : 0;
+    (machine->ConstRegisters()[instruction.ri] != instruction.immediate) ?
+    1 : 0;
 }
 
-void dlx::instructions::sneu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sneu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sneu" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] !=
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::sneui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sneui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sneui" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    (machine->ConstRegisters()[instruction.ri] != instruction.Ksgn) ? 1 : 0;
+    (machine->ConstRegisters()[instruction.ri] != instruction.immediate) ?
+    1 : 0;
 }
 
-void dlx::instructions::sra::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sra::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sra" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri].value >>
     machine->ConstRegisters()[instruction.rj].value;
 }
 
-void dlx::instructions::srai::execute(hardware::DLXMachine* machine)
+void dlx::instructions::srai::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing srai" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri].value >> instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri].value >> instruction.immediate;
 }
 
-void dlx::instructions::srl::execute(hardware::DLXMachine* machine)
+void dlx::instructions::srl::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing srl" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri].value >>
     machine->ConstRegisters()[instruction.rj].value;
 }
 
-void dlx::instructions::srli::execute(hardware::DLXMachine* machine)
+void dlx::instructions::srli::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing srli" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri].value >> instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri].value >> instruction.immediate;
 }
 
-void dlx::instructions::sub::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sub::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sub" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk].value =
     machine->ConstRegisters()[instruction.ri] -
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::subi::execute(hardware::DLXMachine* machine)
+void dlx::instructions::subi::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing subi" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] - instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] - instruction.immediate;
 }
 
-void dlx::instructions::subu::execute(hardware::DLXMachine* machine)
+void dlx::instructions::subu::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing subu" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri] -
     machine->ConstRegisters()[instruction.rj];
 }
 
-void dlx::instructions::subui::execute(hardware::DLXMachine* machine)
+void dlx::instructions::subui::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing subui" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri] - instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri] - instruction.immediate;
 }
 
-void dlx::instructions::sw::execute(hardware::DLXMachine* machine)
+void dlx::instructions::sw::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing sw" << std::endl;
-  const auto instruction = Instruction(machine);
-//  machine->Registers()[instruction.rj] =
-//    machine->ConstRegisters()[instruction.ri] OP instruction.Ksgn;
+  const std::uint32_t value =
+    static_cast<std::uint32_t>(machine->ConstRegisters()[instruction.rj].value);
+  machine->store(
+    machine->ConstRegisters()[instruction.ri] + instruction.immediate, value);
 }
 
-void dlx::instructions::trap::execute(hardware::DLXMachine* machine)
+void dlx::instructions::trap::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing trap" << std::endl;
-  const auto instruction = Instruction(machine);
-
+  // The services of the host. The input is read through the machine so it
+  // can be recorded and replayed, see Replay.hpp.
+  switch (instruction.immediate)
+  {
+    case 1: // Read a byte from the console into r1, or -1 at the end.
+      machine->Registers()[1] =
+        machine->input(hardware::InputKind::Console);
+      break;
+    case 2: // Write the byte in r1 to the console.
+      std::cout.put(static_cast<char>(machine->ConstRegisters()[1].value));
+      break;
+    case 3: // Read the host's clock, in microseconds, into r1.
+      machine->Registers()[1] = machine->input(hardware::InputKind::Clock);
+      break;
+  }
 }
 
-void dlx::instructions::wait::execute(hardware::DLXMachine* machine)
+void dlx::instructions::wait::execute(
+  hardware::DLXMachine*, const hardware::DecodedInstruction&)
 {
-  std::cout << "Performing wait" << std::endl;
-  const auto instruction = Instruction(machine);
 }
 
-void dlx::instructions::xor::execute(hardware::DLXMachine* machine)
+void dlx::instructions::xor_::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing xor" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rk] =
     machine->ConstRegisters()[instruction.ri].value ^
     machine->ConstRegisters()[instruction.rj].value;
 }
 
-void dlx::instructions::xori::execute(hardware::DLXMachine* machine)
+void dlx::instructions::xori::execute(
+  hardware::DLXMachine* machine,
+  const hardware::DecodedInstruction& instruction)
 {
-  std::cout << "Performing xori" << std::endl;
-  const auto instruction = Instruction(machine);
   machine->Registers()[instruction.rj] =
-    machine->ConstRegisters()[instruction.ri].value ^ instruction.Ksgn;
+    machine->ConstRegisters()[instruction.ri].value ^ instruction.immediate;
 }
 
 // Define an array pointing to the execute function for the instructions.
-dlx::hardware::ExecuteInstruction dlx::hardware::Instructions[] = {
+dlx::hardware::ExecuteInstruction dlx::hardware::Instructions[64] = {
   HandleFormatRInstructions,
   HandleFormatFInstructions,
   dlx::instructions::j::execute,
   dlx::instructions::jal::execute,
   dlx::instructions::beqz::execute,
   dlx::instructions::bnez::execute,
-  HandleIllegalInstruction,
-  HandleIllegalInstruction,
+  dlx::instructions::bfpt::execute,
+  dlx::instructions::bfpf::execute,
   dlx::instructions::addi::execute,
   dlx::instructions::addui::execute,
   dlx::instructions::subi::execute,
@@ -1028,25 +1397,35 @@ dlx::hardware::ExecuteInstruction dlx::hardware::Instructions[] = {
   dlx::instructions::lw::execute,
   dlx::instructions::lbu::execute,
   dlx::instructions::lhu::execute,
-  HandleIllegalInstruction,
-  HandleIllegalInstruction,
+  dlx::instructions::lf::execute,
+  dlx::instructions::ld::execute,
   dlx::instructions::sb::execute,
   dlx::instructions::sh::execute,
   HandleIllegalInstruction,
   dlx::instructions::sw::execute,
   HandleIllegalInstruction,
   HandleIllegalInstruction,
-  HandleIllegalInstruction,
-  HandleIllegalInstruction,
+  dlx::instructions::sf::execute,
+  dlx::instructions::sd::execute,
   dlx::instructions::sequi::execute,
   dlx::instructions::sneui::execute,
   dlx::instructions::sltui::execute,
   dlx::instructions::sgtui::execute,
   dlx::instructions::sleui::execute,
   dlx::instructions::sgeui::execute,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
 };
 
-dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatR[] = {
+dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatR[64] = {
   dlx::instructions::nop::execute,
   dlx::instructions::halt::execute,
   dlx::instructions::wait::execute,
@@ -1083,9 +1462,9 @@ dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatR[] = {
   dlx::instructions::addu::execute,
   dlx::instructions::sub::execute,
   dlx::instructions::subu::execute,
-  dlx::instructions::and::execute,
-  dlx::instructions::or::execute,
-  dlx::instructions::xor::execute,
+  dlx::instructions::and_::execute,
+  dlx::instructions::or_::execute,
+  dlx::instructions::xor_::execute,
   HandleIllegalInstruction,
   dlx::instructions::seq::execute,
   dlx::instructions::sne::execute,
@@ -1097,6 +1476,73 @@ dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatR[] = {
   HandleIllegalInstruction,
   dlx::instructions::movi2s::execute,
   dlx::instructions::movs2i::execute,
+  dlx::instructions::movf::execute,
+  dlx::instructions::movd::execute,
+  dlx::instructions::movfp2i::execute,
+  dlx::instructions::movi2fp::execute,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+};
+
+dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatF[64] = {
+  dlx::instructions::addf::execute,
+  dlx::instructions::subf::execute,
+  dlx::instructions::multf::execute,
+  dlx::instructions::divf::execute,
+  dlx::instructions::addd::execute,
+  dlx::instructions::subd::execute,
+  dlx::instructions::multd::execute,
+  dlx::instructions::divd::execute,
+  dlx::instructions::cvtf2d::execute,
+  dlx::instructions::cvtf2i::execute,
+  dlx::instructions::cvtd2f::execute,
+  dlx::instructions::cvtd2i::execute,
+  dlx::instructions::cvti2f::execute,
+  dlx::instructions::cvti2d::execute,
+  dlx::instructions::mult::execute,
+  dlx::instructions::div::execute,
+  dlx::instructions::eqf::execute,
+  dlx::instructions::nef::execute,
+  dlx::instructions::ltf::execute,
+  dlx::instructions::gtf::execute,
+  dlx::instructions::lef::execute,
+  dlx::instructions::gef::execute,
+  dlx::instructions::multu::execute,
+  dlx::instructions::divu::execute,
+  dlx::instructions::eqd::execute,
+  dlx::instructions::ned::execute,
+  dlx::instructions::ltd::execute,
+  dlx::instructions::gtd::execute,
+  dlx::instructions::led::execute,
+  dlx::instructions::ged::execute,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
+  HandleIllegalInstruction,
   HandleIllegalInstruction,
   HandleIllegalInstruction,
   HandleIllegalInstruction,
@@ -1113,4 +1559,686 @@ dlx::hardware::ExecuteInstruction dlx::hardware::InstructionsFormatR[] = {
   HandleIllegalInstruction,
 };
 
+#if DEMU_THREADED_DISPATCH
+const dlx::hardware::DecodedInstruction*
+dlx::hardware::RunThreaded(DLXMachine* machine)
+{
+  // The address of the code that performs each operation, see
+  // operationIndex(). Anything without its own label is performed by calling
+  // through the table of functions.
+  const void* labels[OperationCount + FusionCount];
+  for (unsigned int i = 0; i < OperationCount; ++i) labels[i] = &&call;
+
+#define DLX_LABEL(NAME, OPCODE, MODIFIER) \
+  labels[operationIndex(OPCODE, MODIFIER)] = &&do_##NAME
+
+  DLX_LABEL(j, 2, 0);
+  DLX_LABEL(jal, 3, 0);
+  DLX_LABEL(beqz, 4, 0);
+  DLX_LABEL(bnez, 5, 0);
+  DLX_LABEL(addi, 8, 0);
+  DLX_LABEL(addui, 9, 0);
+  DLX_LABEL(subi, 10, 0);
+  DLX_LABEL(subui, 11, 0);
+  DLX_LABEL(andi, 12, 0);
+  DLX_LABEL(ori, 13, 0);
+  DLX_LABEL(xori, 14, 0);
+  DLX_LABEL(lhi, 15, 0);
+  DLX_LABEL(jr, 18, 0);
+  DLX_LABEL(slai, 20, 0);
+  DLX_LABEL(srli, 22, 0);
+  DLX_LABEL(srai, 23, 0);
+  DLX_LABEL(seqi, 24, 0);
+  DLX_LABEL(snei, 25, 0);
+  DLX_LABEL(slti, 26, 0);
+  DLX_LABEL(sgti, 27, 0);
+  DLX_LABEL(slei, 28, 0);
+  DLX_LABEL(sgei, 29, 0);
+  DLX_LABEL(lb, 32, 0);
+  DLX_LABEL(lh, 33, 0);
+  DLX_LABEL(lw, 35, 0);
+  DLX_LABEL(lbu, 36, 0);
+  DLX_LABEL(lhu, 37, 0);
+  DLX_LABEL(sb, 40, 0);
+  DLX_LABEL(sh, 41, 0);
+  DLX_LABEL(sw, 43, 0);
+  DLX_LABEL(sequi, 48, 0);
+  DLX_LABEL(sneui, 49, 0);
+  DLX_LABEL(sltui, 50, 0);
+  DLX_LABEL(sgtui, 51, 0);
+  DLX_LABEL(sleui, 52, 0);
+  DLX_LABEL(sgeui, 53, 0);
+  DLX_LABEL(nop, 0, 0);
+  DLX_LABEL(sll, 0, 4);
+  DLX_LABEL(srl, 0, 6);
+  DLX_LABEL(sra, 0, 7);
+  DLX_LABEL(sequ, 0, 16);
+  DLX_LABEL(sneu, 0, 17);
+  DLX_LABEL(sltu, 0, 18);
+  DLX_LABEL(sgtu, 0, 19);
+  DLX_LABEL(sleu, 0, 20);
+  DLX_LABEL(sgeu, 0, 21);
+  DLX_LABEL(add, 0, 32);
+  DLX_LABEL(addu, 0, 33);
+  DLX_LABEL(sub, 0, 34);
+  DLX_LABEL(subu, 0, 35);
+  DLX_LABEL(and_, 0, 36);
+  DLX_LABEL(or_, 0, 37);
+  DLX_LABEL(xor_, 0, 38);
+  DLX_LABEL(seq, 0, 40);
+  DLX_LABEL(sne, 0, 41);
+  DLX_LABEL(slt, 0, 42);
+  DLX_LABEL(sgt, 0, 43);
+  DLX_LABEL(sle, 0, 44);
+  DLX_LABEL(sge, 0, 45);
+  DLX_LABEL(mult, 1, 14);
+  DLX_LABEL(div, 1, 15);
+  DLX_LABEL(multu, 1, 22);
+  DLX_LABEL(divu, 1, 23);
+  DLX_LABEL(bfpt, 6, 0);
+  DLX_LABEL(bfpf, 7, 0);
+  DLX_LABEL(lf, 38, 0);
+  DLX_LABEL(ld, 39, 0);
+  DLX_LABEL(sf, 46, 0);
+  DLX_LABEL(sd, 47, 0);
+  DLX_LABEL(movf, 0, 50);
+  DLX_LABEL(movd, 0, 51);
+  DLX_LABEL(movfp2i, 0, 52);
+  DLX_LABEL(movi2fp, 0, 53);
+  DLX_LABEL(addf, 1, 0);
+  DLX_LABEL(subf, 1, 1);
+  DLX_LABEL(multf, 1, 2);
+  DLX_LABEL(divf, 1, 3);
+  DLX_LABEL(addd, 1, 4);
+  DLX_LABEL(subd, 1, 5);
+  DLX_LABEL(multd, 1, 6);
+  DLX_LABEL(divd, 1, 7);
+  DLX_LABEL(cvtf2d, 1, 8);
+  DLX_LABEL(cvtf2i, 1, 9);
+  DLX_LABEL(cvtd2f, 1, 10);
+  DLX_LABEL(cvtd2i, 1, 11);
+  DLX_LABEL(cvti2f, 1, 12);
+  DLX_LABEL(cvti2d, 1, 13);
+  DLX_LABEL(eqf, 1, 16);
+  DLX_LABEL(nef, 1, 17);
+  DLX_LABEL(ltf, 1, 18);
+  DLX_LABEL(gtf, 1, 19);
+  DLX_LABEL(lef, 1, 20);
+  DLX_LABEL(gef, 1, 21);
+  DLX_LABEL(eqd, 1, 24);
+  DLX_LABEL(ned, 1, 25);
+  DLX_LABEL(ltd, 1, 26);
+  DLX_LABEL(gtd, 1, 27);
+  DLX_LABEL(led, 1, 28);
+  DLX_LABEL(ged, 1, 29);
+  DLX_LABEL(halt, 0, 1);
+  DLX_LABEL(trap, 17, 0);
+
+#undef DLX_LABEL
+
+  // While profiling, the jumps and branches are performed by transfer, which
+  // tells the profile where the instructions executed in a row leave off and
+  // start again when they go elsewhere. The others aren't counted one by one.
+  Profile* const profile = machine->profile.get();
+  if (profile)
+  {
+    static const std::uint8_t transfers[] = { 2, 3, 4, 5, 6, 7, 16, 18, 19 };
+    for (auto operation : transfers) labels[operation] = &&transfer;
+  }
+
+  // The fused instructions are performed one at a time while tracing, as
+  // they are traced one at a time.
+  const bool fuse = !IsTracing();
+#define DLX_FUSED_LABEL(NAME, FUSION)                                    \
+  labels[OperationCount + static_cast<unsigned int>(Fusion::FUSION)] =   \
+    fuse ? &&fused_##NAME :                                              \
+    labels[FusionPatterns[static_cast<unsigned int>(Fusion::FUSION)]     \
+             .operations[0]]
+
+  DLX_FUSED_LABEL(slti_bnez, SltiBnez);
+  DLX_FUSED_LABEL(slti_beqz, SltiBeqz);
+  DLX_FUSED_LABEL(addi_slti_bnez, AddiSltiBnez);
+  DLX_FUSED_LABEL(lhi_ori, LhiOri);
+
+#undef DLX_FUSED_LABEL
+
+  const DecodedInstruction* instruction = nullptr;
+  std::uint64_t count = 0;
+  const std::uint64_t remaining =
+    machine->instructionLimit - machine->instructionCount;
+
+  // The instructions performed are added to the count however this returns,
+  // including by an instruction raising a GuestException.
+  struct CountGuard
+  {
+    DLXMachine* machine;
+    std::uint64_t& count;
+    ~CountGuard() { machine->instructionCount += count; }
+  } countGuard = { machine, count };
+
+  // The profile counts from here to wherever this leaves off, however it
+  // returns.
+  struct ProfileGuard
+  {
+    DLXMachine* machine;
+    Profile* profile;
+    ~ProfileGuard()
+    {
+      if (profile)
+      {
+        profile->leave(machine->mem, machine->programCounter.value);
+      }
+    }
+  } profileGuard = { machine, profile };
+  if (profile) profile->enter(machine->mem, machine->programCounter.value);
+
+  // Trace the instruction just performed, then fetch the next instruction and
+  // jump to the code that performs it.
+#define DLX_DISPATCH()                                                  \
+  if (instruction) TraceResult(*machine, *instruction);                 \
+  if (count == remaining) goto limit;                                   \
+  instruction =                                                         \
+    machine->decodeCache(machine->mem, machine->programCounter.value);  \
+  if (instruction == nullptr) goto fault;                               \
+  TraceInstruction(*machine, machine->programCounter.value,             \
+                   *instruction);                                       \
+  ++count;                                                              \
+  machine->programCounter.value += 4;                                   \
+  goto *labels[instruction->dispatch]
+
+  // Tell the profile the instructions executed in a row leave off at next
+  // if the one just performed went elsewhere.
+#define DLX_PROFILE_TRANSFER(NEXT)                                      \
+  if (profile && machine->programCounter.value != (NEXT))               \
+  {                                                                     \
+    profile->leave(machine->mem, (NEXT));                               \
+    profile->enter(machine->mem, machine->programCounter.value);        \
+  }
+
+  // Move on to the next of the fused instructions and perform it. Each fused
+  // handler first checks the limit leaves room for all of them, otherwise it
+  // performs just the first.
+#define DLX_FUSED_NEXT(NAME)                                            \
+  ++instruction;                                                        \
+  ++count;                                                              \
+  machine->programCounter.value += 4;                                   \
+  dlx::instructions::NAME::execute(machine, *instruction)
+
+  // Move on to the branch which ends the fused instructions and perform it.
+#define DLX_FUSED_BRANCH(NAME)                                          \
+  ++instruction;                                                        \
+  ++count;                                                              \
+  machine->programCounter.value += 4;                                   \
+  {                                                                     \
+    const std::int32_t next = machine->programCounter.value;            \
+    dlx::instructions::NAME::execute(machine, *instruction);            \
+    DLX_PROFILE_TRANSFER(next);                                         \
+  }
+
+  DLX_DISPATCH();
+
+call:
+  instruction->execute(machine, *instruction);
+  DLX_DISPATCH();
+
+transfer:
+  {
+    const std::int32_t next = machine->programCounter.value;
+    instruction->execute(machine, *instruction);
+    DLX_PROFILE_TRANSFER(next);
+  }
+  DLX_DISPATCH();
+
+do_j:
+  dlx::instructions::j::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_jal:
+  dlx::instructions::jal::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_beqz:
+  dlx::instructions::beqz::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_bnez:
+  dlx::instructions::bnez::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_addi:
+  dlx::instructions::addi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_addui:
+  dlx::instructions::addui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_subi:
+  dlx::instructions::subi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_subui:
+  dlx::instructions::subui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_andi:
+  dlx::instructions::andi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ori:
+  dlx::instructions::ori::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_xori:
+  dlx::instructions::xori::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lhi:
+  dlx::instructions::lhi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_jr:
+  dlx::instructions::jr::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_slai:
+  dlx::instructions::slai::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_srli:
+  dlx::instructions::srli::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_srai:
+  dlx::instructions::srai::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_seqi:
+  dlx::instructions::seqi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_snei:
+  dlx::instructions::snei::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_slti:
+  dlx::instructions::slti::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgti:
+  dlx::instructions::sgti::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_slei:
+  dlx::instructions::slei::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgei:
+  dlx::instructions::sgei::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lb:
+  dlx::instructions::lb::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lh:
+  dlx::instructions::lh::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lw:
+  dlx::instructions::lw::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lbu:
+  dlx::instructions::lbu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lhu:
+  dlx::instructions::lhu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sb:
+  dlx::instructions::sb::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sh:
+  dlx::instructions::sh::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sw:
+  dlx::instructions::sw::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sequi:
+  dlx::instructions::sequi::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sneui:
+  dlx::instructions::sneui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sltui:
+  dlx::instructions::sltui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgtui:
+  dlx::instructions::sgtui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sleui:
+  dlx::instructions::sleui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgeui:
+  dlx::instructions::sgeui::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_nop:
+  dlx::instructions::nop::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sll:
+  dlx::instructions::sll::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_srl:
+  dlx::instructions::srl::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sra:
+  dlx::instructions::sra::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sequ:
+  dlx::instructions::sequ::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sneu:
+  dlx::instructions::sneu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sltu:
+  dlx::instructions::sltu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgtu:
+  dlx::instructions::sgtu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sleu:
+  dlx::instructions::sleu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgeu:
+  dlx::instructions::sgeu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_add:
+  dlx::instructions::add::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_addu:
+  dlx::instructions::addu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sub:
+  dlx::instructions::sub::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_subu:
+  dlx::instructions::subu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_and_:
+  dlx::instructions::and_::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_or_:
+  dlx::instructions::or_::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_xor_:
+  dlx::instructions::xor_::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_seq:
+  dlx::instructions::seq::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sne:
+  dlx::instructions::sne::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_slt:
+  dlx::instructions::slt::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sgt:
+  dlx::instructions::sgt::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sle:
+  dlx::instructions::sle::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sge:
+  dlx::instructions::sge::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_mult:
+  dlx::instructions::mult::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_div:
+  dlx::instructions::div::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_multu:
+  dlx::instructions::multu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_divu:
+  dlx::instructions::divu::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_bfpt:
+  dlx::instructions::bfpt::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_bfpf:
+  dlx::instructions::bfpf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lf:
+  dlx::instructions::lf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ld:
+  dlx::instructions::ld::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sf:
+  dlx::instructions::sf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_sd:
+  dlx::instructions::sd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_movf:
+  dlx::instructions::movf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_movd:
+  dlx::instructions::movd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_movfp2i:
+  dlx::instructions::movfp2i::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_movi2fp:
+  dlx::instructions::movi2fp::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_addf:
+  dlx::instructions::addf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_subf:
+  dlx::instructions::subf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_multf:
+  dlx::instructions::multf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_divf:
+  dlx::instructions::divf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_addd:
+  dlx::instructions::addd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_subd:
+  dlx::instructions::subd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_multd:
+  dlx::instructions::multd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_divd:
+  dlx::instructions::divd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvtf2d:
+  dlx::instructions::cvtf2d::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvtf2i:
+  dlx::instructions::cvtf2i::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvtd2f:
+  dlx::instructions::cvtd2f::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvtd2i:
+  dlx::instructions::cvtd2i::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvti2f:
+  dlx::instructions::cvti2f::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_cvti2d:
+  dlx::instructions::cvti2d::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_eqf:
+  dlx::instructions::eqf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_nef:
+  dlx::instructions::nef::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ltf:
+  dlx::instructions::ltf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_gtf:
+  dlx::instructions::gtf::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_lef:
+  dlx::instructions::lef::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_gef:
+  dlx::instructions::gef::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_eqd:
+  dlx::instructions::eqd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ned:
+  dlx::instructions::ned::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ltd:
+  dlx::instructions::ltd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_gtd:
+  dlx::instructions::gtd::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_led:
+  dlx::instructions::led::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+do_ged:
+  dlx::instructions::ged::execute(machine, *instruction);
+  DLX_DISPATCH();
+
+fused_slti_bnez:
+  if (remaining - count < 1) goto do_slti;
+  dlx::instructions::slti::execute(machine, *instruction);
+  DLX_FUSED_BRANCH(bnez);
+  DLX_DISPATCH();
+
+fused_slti_beqz:
+  if (remaining - count < 1) goto do_slti;
+  dlx::instructions::slti::execute(machine, *instruction);
+  DLX_FUSED_BRANCH(beqz);
+  DLX_DISPATCH();
+
+fused_addi_slti_bnez:
+  if (remaining - count < 2) goto do_addi;
+  dlx::instructions::addi::execute(machine, *instruction);
+  DLX_FUSED_NEXT(slti);
+  DLX_FUSED_BRANCH(bnez);
+  DLX_DISPATCH();
+
+fused_lhi_ori:
+  if (remaining - count < 1) goto do_lhi;
+  dlx::instructions::lhi::execute(machine, *instruction);
+  DLX_FUSED_NEXT(ori);
+  DLX_DISPATCH();
+
+#undef DLX_FUSED_NEXT
+#undef DLX_FUSED_BRANCH
+#undef DLX_PROFILE_TRANSFER
+
+do_halt:
+  dlx::instructions::halt::execute(machine, *instruction);
+  goto stop;
+
+do_trap:
+  // The count is brought up to date first, as the input a trap reads is
+  // logged against it.
+  machine->instructionCount += count;
+  count = 0;
+  dlx::instructions::trap::execute(machine, *instruction);
+  goto stop;
+
+#undef DLX_DISPATCH
+
+stop:
+  TraceResult(*machine, *instruction);
+  machine->instructionRegister.value = instruction->word;
+  return instruction;
+
+limit:
+  return instruction;
+
+fault:
+  return nullptr;
+}
+#endif
+
 //===--------------------------- End of the file --------------------------===//
\ No newline at end of file
@@ -14,17 +14,30 @@
 //
 //===----------------------------------------------------------------------===//
 
+// Direct-threaded dispatch relies on labels as values, which is an extension
+// provided by GCC and Clang. Define DEMU_THREADED_DISPATCH as 0 to use the
+// portable dispatch through the function pointer tables instead.
+#ifndef DEMU_THREADED_DISPATCH
+#if defined(__GNUC__)
+#define DEMU_THREADED_DISPATCH 1
+#else
+#define DEMU_THREADED_DISPATCH 0
+#endif
+#endif
+
 namespace dlx
 {
   namespace hardware
   {
     class DLXMachine;
+    struct DecodedInstruction;
 
-    typedef void (*ExecuteInstruction)(DLXMachine*);
+    // Performs an instruction which has already been decoded, see Decoder.hpp.
+    typedef void (*ExecuteInstruction)(DLXMachine*, const DecodedInstruction&);
 
     // Provides an array of function pointers index by the opcode, which will
     // perform the specifed instruction in the emulator.
-    ExecuteInstruction Instructions[]; // 64
+    extern ExecuteInstruction Instructions[64];
 
     // Provides an array of function pointers index by the modifier, which will
     // perform the specifed format-R instruction in the emulator.
@@ -33,7 +46,24 @@ namespace dlx
     // have it look-up the modifier and index into another array.
     //
     // It depends on if the indirection needs to be avoided by the caller.
-    ExecuteInstruction InstructionsFormatR[];
+    extern ExecuteInstruction InstructionsFormatR[64];
+
+    // Provides an array of function pointers index by the modifier, which will
+    // perform the specifed instruction with opcode 1, the integer multiply and
+    // divide and the floating point instructions, in the emulator.
+    extern ExecuteInstruction InstructionsFormatF[64];
+
+#if DEMU_THREADED_DISPATCH
+    // Keep executing instructions until a halt or trap instruction has been
+    // performed or the program counter leaves the memory of the machine.
+    //
+    // The instructions are performed in-line with each one jumping directly to
+    // the code for the next, rather than calling through the tables above.
+    //
+    // Returns the instruction that it stopped on, or nullptr if the program
+    // counter is outside the addressable range.
+    const DecodedInstruction* RunThreaded(DLXMachine* machine);
+#endif
   }
 }
 
@@ -0,0 +1,551 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Jit
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides compiling of translated blocks to x86-64 code.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the Emitter, which writes the x86-64 code for a
+//                translated block into an executable buffer, and RunJit(),
+//                which compiles the blocks executed often enough and runs
+//                their code. The instructions without code of their own go
+//                through Jit::fallback(), and a full buffer is emptied with
+//                all the code in it marked out of date.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Jit.hpp"
+
+#include "BlockCache.hpp"
+#include "Decoder.hpp"
+#include "Machine.hpp"
+#include "Trace.hpp"
+
+#include <cstring>
+
+#if DEMU_JIT
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+  // The size of the buffer for the native code.
+  const std::size_t BufferSize = 16 * 1024 * 1024;
+
+  // The most bytes of code generated for a single instruction, plus the
+  // prologue and the end of the block.
+  const std::size_t MaximumInstructionSize = 64;
+  const std::size_t MaximumBlockOverhead = 64;
+
+  // Writes x86-64 machine code to a buffer.
+  class Emitter
+  {
+    unsigned char* code;
+
+  public:
+    Emitter(unsigned char* start) : code(start) {}
+
+    unsigned char* position() const { return code; }
+
+    void byte(unsigned int value)
+    {
+      *code++ = static_cast<unsigned char>(value);
+    }
+
+    void bytes(unsigned int a, unsigned int b)
+    {
+      byte(a);
+      byte(b);
+    }
+
+    void bytes(unsigned int a, unsigned int b, unsigned int c)
+    {
+      byte(a);
+      byte(b);
+      byte(c);
+    }
+
+    void imm32(std::uint32_t value)
+    {
+      std::memcpy(code, &value, sizeof(value));
+      code += sizeof(value);
+    }
+
+    void imm64(std::uint64_t value)
+    {
+      std::memcpy(code, &value, sizeof(value));
+      code += sizeof(value);
+    }
+
+    // The displacement from rbx of a guest register.
+    static unsigned int displacement(unsigned int index)
+    {
+      return index * sizeof(dlx::hardware::Register);
+    }
+
+    // mov eax, [rbx + 4 * index]
+    void loadEax(unsigned int index) { bytes(0x8B, 0x43, displacement(index)); }
+
+    // mov ecx, [rbx + 4 * index]
+    void loadEcx(unsigned int index) { bytes(0x8B, 0x4B, displacement(index)); }
+
+    // mov [rbx + 4 * index], eax
+    void storeEax(unsigned int index)
+    {
+      bytes(0x89, 0x43, displacement(index));
+    }
+
+    // <operation> eax, [rbx + 4 * index]
+    //
+    // Where operation is given by the opcode of its r32, r/m32 form.
+    void operateEax(unsigned int opcode, unsigned int index)
+    {
+      bytes(opcode, 0x43, displacement(index));
+    }
+
+    // <operation> eax, imm32
+    //
+    // Where operation is given by the opcode of its eax, imm32 form.
+    void operateEaxImmediate(unsigned int opcode, std::int32_t value)
+    {
+      byte(opcode);
+      imm32(static_cast<std::uint32_t>(value));
+    }
+
+    // setcc al; movzx eax, al
+    void setEax(unsigned int condition)
+    {
+      bytes(0x0F, condition, 0xC0);
+      bytes(0x0F, 0xB6, 0xC0);
+    }
+
+    // mov eax, imm32
+    void moveEax(std::uint32_t value)
+    {
+      byte(0xB8);
+      imm32(value);
+    }
+
+    // mov dword [r13], imm32
+    void storeExecuted(std::uint32_t count)
+    {
+      bytes(0x41, 0xC7, 0x45);
+      byte(0x00);
+      imm32(count);
+    }
+
+    void prologue()
+    {
+      byte(0x53);             // push rbx
+      bytes(0x41, 0x54);      // push r12
+      bytes(0x41, 0x55);      // push r13
+      bytes(0x48, 0x89, 0xFB); // mov rbx, rdi
+      bytes(0x49, 0x89, 0xF4); // mov r12, rsi
+      bytes(0x49, 0x89, 0xD5); // mov r13, rdx
+    }
+
+    // The size of the code written by exit().
+    static const unsigned int ExitSize = 14;
+
+    // Returns from the block with eax as the next program counter.
+    void exit(std::uint32_t executed)
+    {
+      storeExecuted(executed);
+      bytes(0x41, 0x5D);      // pop r13
+      bytes(0x41, 0x5C);      // pop r12
+      byte(0x5B);             // pop rbx
+      byte(0xC3);             // ret
+    }
+  };
+
+  // The condition codes for setcc.
+  enum Condition
+  {
+    Equal = 0x94,
+    NotEqual = 0x95,
+    Less = 0x9C,
+    GreaterOrEqual = 0x9D,
+    LessOrEqual = 0x9E,
+    Greater = 0x9F,
+  };
+
+  // Returns the opcode of the x86 instruction that computes the same as the
+  // given arithmetic or logical operation, in its r32, r/m32 form.
+  //
+  // The form with eax and an imm32 is this plus 2.
+  unsigned int ArithmeticOpcode(unsigned int operation)
+  {
+    switch (operation)
+    {
+      case 8: case 9: case 96: case 97: return 0x03; // add, addu
+      case 10: case 11: case 98: case 99: return 0x2B; // sub, subu
+      case 12: case 100: return 0x23; // and
+      case 13: case 101: return 0x0B; // or
+      case 14: case 102: return 0x33; // xor
+      default: return 0;
+    }
+  }
+
+  // Returns the condition for the given set-compare operation, or 0 if it is
+  // not one.
+  //
+  // These are the comparisons as the functions in Instructions.cpp make them,
+  // all of which are signed.
+  unsigned int CompareCondition(unsigned int operation)
+  {
+    switch (operation)
+    {
+      case 24: case 48: case 80: case 104: return Equal;
+      case 25: case 49: case 81: case 105: return NotEqual;
+      case 26: case 50: case 82: case 106: return Less;
+      case 27: case 51: case 83: case 107: return Greater;
+      case 28: case 52: case 84: case 108: return LessOrEqual;
+      case 29: case 53: case 85: return GreaterOrEqual;
+      case 109: return Greater; // sge
+      default: return 0;
+    }
+  }
+
+  // Emits the native code for the instruction, returning false if there is
+  // none for it.
+  bool EmitNative(Emitter& emitter,
+                  const dlx::hardware::DecodedInstruction& instruction)
+  {
+    const unsigned int operation = instruction.operation;
+    const bool isRegisterToRegister = operation >= 64 && operation < 128;
+
+    if (const unsigned int opcode = ArithmeticOpcode(operation))
+    {
+      emitter.loadEax(instruction.ri);
+      if (isRegisterToRegister)
+      {
+        emitter.operateEax(opcode, instruction.rj);
+        emitter.storeEax(instruction.rk);
+      }
+      else
+      {
+        emitter.operateEaxImmediate(opcode + 2, instruction.immediate);
+        emitter.storeEax(instruction.rj);
+      }
+      return true;
+    }
+
+    if (const unsigned int condition = CompareCondition(operation))
+    {
+      emitter.loadEax(instruction.ri);
+      if (isRegisterToRegister)
+      {
+        emitter.operateEax(0x3B, instruction.rj); // cmp eax, [rbx + rj]
+        emitter.setEax(condition);
+        emitter.storeEax(instruction.rk);
+      }
+      else
+      {
+        emitter.operateEaxImmediate(0x3D, instruction.immediate); // cmp
+        emitter.setEax(condition);
+        emitter.storeEax(instruction.rj);
+      }
+      return true;
+    }
+
+    switch (operation)
+    {
+      case 68: // sll
+      case 70: // srl
+      case 71: // sra
+        // The right shifts are both arithmetic as the registers are signed.
+        emitter.loadEax(instruction.ri);
+        emitter.loadEcx(instruction.rj);
+        emitter.bytes(0xD3, operation == 68 ? 0xE0 : 0xF8); // shl/sar eax, cl
+        emitter.storeEax(instruction.rk);
+        return true;
+      case 20: // slli
+      case 22: // srli
+      case 23: // srai
+        emitter.loadEax(instruction.ri);
+        emitter.bytes(0xC1, operation == 20 ? 0xE0 : 0xF8,
+                      instruction.immediate & 31); // shl/sar eax, imm8
+        emitter.storeEax(instruction.rj);
+        return true;
+      case 142: // mult
+      case 150: // multu
+        // The low 32 bits of the product are the same signed or not.
+        emitter.loadEax(instruction.ri);
+        emitter.bytes(0x0F, 0xAF, 0x43); // imul eax, [rbx + 4 * rj]
+        emitter.byte(Emitter::displacement(instruction.rj));
+        emitter.storeEax(instruction.rk);
+        return true;
+      case 64: // nop
+        return true;
+      default:
+        return false;
+    }
+  }
+}
+
+dlx::hardware::Jit::Jit()
+: buffer(nullptr),
+  capacity(0),
+  used(0),
+  generation(1),
+  pending()
+{
+#if DEMU_JIT
+  void* const memory = mmap(nullptr, BufferSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory != MAP_FAILED)
+  {
+    buffer = static_cast<unsigned char*>(memory);
+    capacity = BufferSize;
+  }
+#endif
+}
+
+dlx::hardware::Jit::~Jit()
+{
+#if DEMU_JIT
+  if (buffer) munmap(buffer, capacity);
+#endif
+}
+
+dlx::hardware::NativeBlock
+dlx::hardware::Jit::code(const TranslatedBlock& block) const
+{
+  if (block.native == nullptr || block.nativeGeneration != generation)
+  {
+    return nullptr;
+  }
+
+  return reinterpret_cast<NativeBlock>(const_cast<void*>(block.native));
+}
+
+std::uint64_t dlx::hardware::Jit::fallback(
+  DLXMachine* machine, const DecodedInstruction* instruction,
+  std::uint32_t programCounter, const TranslatedBlock* block)
+{
+  const std::uint64_t stop = std::uint64_t(1) << 63;
+
+  // The block's count is only added once it exits, so for the instruction
+  // the count includes those before it and itself, as it does for step().
+  const std::uint64_t executed = instruction - block->instructions.data() + 1;
+  machine->programCounter.value = programCounter;
+  machine->instructionCount += executed;
+  try
+  {
+    instruction->execute(machine, *instruction);
+  }
+  catch (...)
+  {
+    machine->instructionCount -= executed;
+    machine->jit->pending = std::current_exception();
+    return stop | static_cast<std::uint32_t>(machine->programCounter.value);
+  }
+  machine->instructionCount -= executed;
+
+  const std::uint32_t next = machine->programCounter.value;
+  return block->valid ? next : stop | next;
+}
+
+bool dlx::hardware::Jit::compile(TranslatedBlock* block)
+{
+#if DEMU_JIT
+  if (buffer == nullptr) return false;
+
+  const std::size_t size = block->instructions.size();
+  const std::size_t required =
+    MaximumBlockOverhead + size * MaximumInstructionSize;
+  if (required > capacity) return false;
+
+  if (mprotect(buffer, capacity, PROT_READ | PROT_WRITE) != 0) return false;
+
+  if (capacity - used < required)
+  {
+    // Start again with an empty buffer, which leaves the code of every block
+    // compiled so far out of date.
+    used = 0;
+    ++generation;
+  }
+
+  unsigned char* const start = buffer + used;
+  Emitter emitter(start);
+  emitter.prologue();
+
+  std::uint32_t pc = block->startAddress;
+  bool returned = false;
+  for (std::size_t i = 0; i < size; ++i)
+  {
+    const DecodedInstruction& instruction = block->instructions[i];
+    const std::uint32_t executed = static_cast<std::uint32_t>(i + 1);
+    const std::uint32_t next = pc + 4;
+    pc = next;
+
+    if (EmitNative(emitter, instruction)) continue;
+
+    const unsigned int operation = instruction.operation;
+    if (operation == 4 || operation == 5)
+    {
+      // beqz/bnez: eax = (ri == 0) ? target : next or the inverse.
+      emitter.loadEax(instruction.ri);
+      emitter.bytes(0x85, 0xC0);                  // test eax, eax
+      emitter.moveEax(next);
+      emitter.byte(0xB9);                         // mov ecx, target
+      emitter.imm32(next + instruction.immediate);
+      emitter.bytes(0x0F, operation == 4 ? 0x44 : 0x45, 0xC1); // cmovz/nz
+      emitter.exit(executed);
+      returned = true;
+    }
+    else if (operation == 3)
+    {
+      // jal: r31 = pc; pc = pc + Lsgn
+      emitter.bytes(0xC7, 0x43, Emitter::displacement(31));
+      emitter.imm32(next);
+      emitter.moveEax(next + instruction.immediate);
+      emitter.exit(executed);
+      returned = true;
+    }
+    else if (operation == 18)
+    {
+      // jr: pc = ri
+      emitter.loadEax(instruction.ri);
+      emitter.exit(executed);
+      returned = true;
+    }
+    else
+    {
+      // Call the function for the instruction via fallback().
+      emitter.bytes(0x4C, 0x89, 0xE7);            // mov rdi, r12
+      emitter.bytes(0x48, 0xBE);                  // mov rsi, instruction
+      emitter.imm64(reinterpret_cast<std::uintptr_t>(&instruction));
+      emitter.byte(0xBA);                         // mov edx, pc
+      emitter.imm32(next);
+      emitter.bytes(0x48, 0xB9);                  // mov rcx, block
+      emitter.imm64(reinterpret_cast<std::uintptr_t>(block));
+      emitter.bytes(0x48, 0xB8);                  // mov rax, fallback
+      emitter.imm64(reinterpret_cast<std::uintptr_t>(&Jit::fallback));
+      emitter.bytes(0xFF, 0xD0);                  // call rax
+
+      if (i + 1 == size)
+      {
+        // The program counter returned is where the block goes next.
+        emitter.exit(executed);
+        returned = true;
+      }
+      else
+      {
+        // test rax, rax; jns over the exit for when the block must stop.
+        emitter.bytes(0x48, 0x85, 0xC0);
+        emitter.bytes(0x79, Emitter::ExitSize);
+        emitter.exit(executed);
+      }
+    }
+  }
+
+  if (!returned)
+  {
+    // The block ended without a branch.
+    emitter.moveEax(pc);
+    emitter.exit(static_cast<std::uint32_t>(size));
+  }
+
+  used += emitter.position() - start;
+  block->native = start;
+  block->nativeGeneration = generation;
+
+  if (mprotect(buffer, capacity, PROT_READ | PROT_EXEC) != 0)
+  {
+    // None of the code can be run if the buffer isn't executable, so it is
+    // all dropped as when the buffer is full.
+    block->native = nullptr;
+    used = 0;
+    ++generation;
+    return false;
+  }
+  return true;
+#else
+  (void)block;
+  return false;
+#endif
+}
+
+void dlx::hardware::Jit::rethrow()
+{
+  if (pending)
+  {
+    std::exception_ptr exception = pending;
+    pending = nullptr;
+    std::rethrow_exception(exception);
+  }
+}
+
+const dlx::hardware::DecodedInstruction*
+dlx::hardware::RunJit(DLXMachine* machine)
+{
+  if (!machine->jit) machine->jit.reset(new Jit());
+
+  BlockCache& cache = machine->blocks;
+  Jit& jit = *machine->jit;
+  TranslatedBlock* block = nullptr;
+
+  for (;;)
+  {
+    const std::uint32_t pc = machine->programCounter.value;
+
+    TranslatedBlock* next =
+      (block && block->valid) ? block->successor(pc) : nullptr;
+    if (next == nullptr)
+    {
+      next = cache.lookup(machine, pc);
+      if (next == nullptr) return nullptr;
+
+      if (block && block->valid) block->link(pc, next);
+      cache.release();
+    }
+
+    block = next;
+
+    NativeBlock native = jit.code(*block);
+    if (native == nullptr && ++block->executionCount >= Jit::Threshold)
+    {
+      // Count again from zero, so a block which failed to compile, or whose
+      // code was dropped to make room, is only tried again once it has been
+      // executed as many times more.
+      block->executionCount = 0;
+      if (jit.compile(block)) native = jit.code(*block);
+    }
+
+    // The native code always runs the whole block, so near the instruction
+    // limit it is interpreted instead. It doesn't trace or count the
+    // instructions either.
+    const DecodedInstruction* last;
+    if (native && !IsTracing() && !machine->profile &&
+        machine->instructionLimit - machine->instructionCount >=
+        block->instructions.size())
+    {
+      std::uint32_t executed = 0;
+      machine->programCounter.value =
+        native(machine->registers, machine, &executed);
+      machine->instructionCount += executed;
+      jit.rethrow();
+      last = &block->instructions[executed - 1];
+    }
+    else
+    {
+      last = ExecuteBlock(machine, block);
+    }
+
+    const auto operation = last->operation;
+    if (operation == operationIndex(0, 1) || operation == 17)
+    {
+      // Halt or trap.
+      machine->instructionRegister.value = last->word;
+      return last;
+    }
+
+    if (machine->instructionCount >= machine->instructionLimit) return last;
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
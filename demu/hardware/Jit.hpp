@@ -0,0 +1,110 @@
+#ifndef DLX_JIT_HPP_
+#define DLX_JIT_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Jit
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides compiling of translated blocks to x86-64 code.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Once a translated block has been executed enough times it is
+//                compiled to native code. The integer arithmetic, logical,
+//                shift, set-compare and branch instructions are compiled
+//                directly and the rest call the function which performs them.
+//
+//                While a block runs, rbx holds the address of the machine's
+//                registers, so register ri is at [rbx + 4 * ri].
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+// The compiler is only available for x86-64 on Linux, elsewhere the blocks
+// are executed by calling the functions for each instruction.
+#ifndef DEMU_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define DEMU_JIT 1
+#else
+#define DEMU_JIT 0
+#endif
+#endif
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+    struct DecodedInstruction;
+    struct Register;
+    struct TranslatedBlock;
+
+    // The code generated for a block.
+    //
+    // Returns the address of the next instruction and sets executed to the
+    // number of instructions executed, which is fewer than in the block if
+    // an instruction raised an exception or invalidated the block.
+    typedef std::uint32_t (*NativeBlock)(
+      Register* registers, DLXMachine* machine, std::uint32_t* executed);
+
+    class Jit
+    {
+      unsigned char* buffer;
+      std::size_t capacity;
+      std::size_t used;
+
+      // This is incremented each time the buffer is emptied, which makes the
+      // code of any block compiled before then out of date.
+      std::uint32_t generation;
+
+      // An exception raised by an instruction called from native code, which
+      // is re-thrown once back out of it.
+      std::exception_ptr pending;
+
+      // Performs an instruction that has no native code.
+      //
+      // Returns the program counter afterwards with the top bit set if the
+      // block must stop, as the instruction raised an exception or modified
+      // the block.
+      static std::uint64_t fallback(
+        DLXMachine* machine, const DecodedInstruction* instruction,
+        std::uint32_t programCounter, const TranslatedBlock* block);
+
+    public:
+      // The number of times a block is executed before it is compiled.
+      static const std::uint32_t Threshold = 32;
+
+      Jit();
+      ~Jit();
+
+      // Returns the native code for the block if it has been compiled,
+      // otherwise nullptr.
+      NativeBlock code(const TranslatedBlock& block) const;
+
+      // Compiles the block to native code. Returns false if it could not be
+      // compiled.
+      bool compile(TranslatedBlock* block);
+
+      // Re-throws any exception raised while executing native code.
+      void rethrow();
+
+    private:
+      Jit(const Jit&);
+      Jit& operator=(const Jit&);
+    };
+
+    // Keep executing blocks of instructions until a halt or trap instruction
+    // has been performed or the program counter leaves memory, compiling the
+    // blocks that are executed often.
+    //
+    // Returns the instruction that it stopped on, or nullptr if the program
+    // counter is outside the addressable range.
+    const DecodedInstruction* RunJit(DLXMachine* machine);
+  }
+}
+
+#endif
@@ -0,0 +1,506 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Lockstep
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides running many machines with the same program at once.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the groups of lanes and the vector operations.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Lockstep.hpp"
+
+#include "Decoder.hpp"
+#include "Machine.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+#if DEMU_LOCKSTEP
+
+// Build the code which performs the instructions for AVX2 as well, which is
+// picked when the processor has it.
+#if defined(__x86_64__) && !defined(__clang__)
+#define DLX_VECTOR_TARGETS __attribute__((target_clones("avx2", "default")))
+#else
+#define DLX_VECTOR_TARGETS
+#endif
+
+namespace
+{
+  typedef std::int32_t Vector
+    __attribute__((vector_size(dlx::hardware::LockstepWidth * 4)));
+  typedef std::uint32_t UnsignedVector
+    __attribute__((vector_size(dlx::hardware::LockstepWidth * 4)));
+
+  // The vectors are only ever passed by reference as the AVX2 build of the
+  // code which performs the instructions passes them by value differently.
+
+  // Sets the lanes of the mask to -1 for the given lanes and 0 for the rest.
+  void LaneMask(unsigned int lanes, Vector* mask)
+  {
+    for (unsigned int lane = 0; lane < dlx::hardware::LockstepWidth; ++lane)
+    {
+      (*mask)[lane] = (lanes & (1u << lane)) ? -1 : 0;
+    }
+  }
+
+  // Returns the lanes of the vector which are non-zero, as a mask.
+  unsigned int LanesSet(const Vector& vector)
+  {
+    unsigned int lanes = 0;
+    for (unsigned int lane = 0; lane < dlx::hardware::LockstepWidth; ++lane)
+    {
+      if (vector[lane]) lanes |= 1u << lane;
+    }
+    return lanes;
+  }
+
+  // The addition, subtraction and multiplication are done unsigned so they
+  // wrap around.
+#define DLX_ADD(A, B) Vector(UnsignedVector(A) + UnsignedVector(B))
+#define DLX_SUBTRACT(A, B) Vector(UnsignedVector(A) - UnsignedVector(B))
+#define DLX_MULTIPLY(A, B) Vector(UnsignedVector(A) * UnsignedVector(B))
+
+  // The shift amount is taken modulo 32, as it is by the x86 shift
+  // instructions the interpreter's shifts compile to.
+#define DLX_SHIFT_LEFT(A, B) \
+  Vector(UnsignedVector(A) << UnsignedVector((B) & 31))
+#define DLX_SHIFT_RIGHT(A, B) ((A) >> ((B) & 31))
+
+  // Performs the instruction on the active lanes of the registers if it is
+  // one done with vectors, otherwise returns false without changing them.
+  //
+  // This is the only code built for AVX2 as well, as the functions picked
+  // between at run time must not throw: the exceptions would not be unwound
+  // through the function which picks them.
+  DLX_VECTOR_TARGETS
+  bool Compute(const dlx::hardware::DecodedInstruction& instruction,
+               const Vector& active, Vector* registers) noexcept
+  {
+    const Vector ri = registers[instruction.ri];
+    const Vector rj = registers[instruction.rj];
+    const Vector immediate = Vector{} + instruction.immediate;
+
+    // The value for rk of a format R instruction or rj of a format I one.
+    Vector result;
+    bool registerToRegister = true;
+
+    switch (instruction.operation)
+    {
+      case 64: return true; // nop
+
+      case 96: case 97: result = DLX_ADD(ri, rj); break;
+      case 98: case 99: result = DLX_SUBTRACT(ri, rj); break;
+      case 100: result = ri & rj; break;
+      case 101: result = ri | rj; break;
+      case 102: result = ri ^ rj; break;
+      case 68: result = DLX_SHIFT_LEFT(ri, rj); break;
+      case 70: case 71: result = DLX_SHIFT_RIGHT(ri, rj); break;
+      case 142: case 150: result = DLX_MULTIPLY(ri, rj); break;
+
+      // The set-compare instructions are all signed, with sge the same as
+      // sgt, as they are performed by Instructions.cpp.
+      case 80: case 104: result = (ri == rj) & 1; break;
+      case 81: case 105: result = (ri != rj) & 1; break;
+      case 82: case 106: result = (ri < rj) & 1; break;
+      case 83: case 107: case 109: result = (ri > rj) & 1; break;
+      case 84: case 108: result = (ri <= rj) & 1; break;
+      case 85: result = (ri >= rj) & 1; break;
+
+      default:
+        registerToRegister = false;
+        switch (instruction.operation)
+        {
+          case 8: case 9: result = DLX_ADD(ri, immediate); break;
+          case 10: case 11: result = DLX_SUBTRACT(ri, immediate); break;
+          case 12: result = ri & immediate; break;
+          case 13: result = ri | immediate; break;
+          case 14: result = ri ^ immediate; break;
+          case 20: result = DLX_SHIFT_LEFT(ri, immediate); break;
+          case 22: case 23: result = DLX_SHIFT_RIGHT(ri, immediate); break;
+
+          case 24: case 48: result = (ri == immediate) & 1; break;
+          case 25: case 49: result = (ri != immediate) & 1; break;
+          case 26: case 50: result = (ri < immediate) & 1; break;
+          case 27: case 51: result = (ri > immediate) & 1; break;
+          case 28: case 52: result = (ri <= immediate) & 1; break;
+          case 29: case 53: result = (ri >= immediate) & 1; break;
+
+          default: return false;
+        }
+    }
+
+    Vector& target =
+      registers[registerToRegister ? instruction.rk : instruction.rj];
+    target = (result & active) | (target & ~active);
+    return true;
+  }
+
+  // The lanes currently at the same program counter.
+  struct Group
+  {
+    std::uint32_t programCounter;
+    unsigned int lanes;
+
+    // The instructions executed by the group since it was formed, which is
+    // added to the count of each machine once the group is split.
+    std::uint64_t executed;
+
+    // The number of instructions the group can execute before one of the
+    // machines reaches its instruction limit.
+    std::uint64_t budget;
+  };
+}
+
+class dlx::hardware::Lockstep
+{
+  DLXMachine* const* machines;
+  unsigned int laneCount;
+  Vector registers[32];
+  std::vector<Group> groups;
+
+  // The exception raised by each lane, and the lanes which have stopped for
+  // one.
+  std::exception_ptr* errors;
+  unsigned int failed;
+
+public:
+  Lockstep(DLXMachine* const* machines, unsigned int count,
+           std::exception_ptr* errors)
+  : machines(machines),
+    laneCount(count),
+    groups(),
+    errors(errors),
+    failed(0)
+  {
+    for (unsigned int i = 0; i < 32; ++i) registers[i] = Vector{};
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      load(lane);
+      machines[lane]->instructionRegister.value = 0;
+    }
+  }
+
+  void run()
+  {
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      add(machines[lane]->programCounter.value, 1u << lane);
+    }
+
+    try
+    {
+      while (!groups.empty())
+      {
+        // Run the group furthest behind, which lets those that have branched
+        // ahead be caught up with.
+        const auto next = std::min_element(
+          groups.begin(), groups.end(),
+          [](const Group& a, const Group& b)
+          { return a.programCounter < b.programCounter; });
+        Group group = *next;
+        groups.erase(next);
+
+        runGroup(group);
+      }
+    }
+    catch (...)
+    {
+      storeAll();
+      throw;
+    }
+
+    storeAll();
+  }
+
+private:
+  // Copy the registers of the lane to and from its machine.
+  void load(unsigned int lane)
+  {
+    for (unsigned int i = 0; i < 32; ++i)
+    {
+      registers[i][lane] = machines[lane]->registers[i].value;
+    }
+  }
+
+  void store(unsigned int lane)
+  {
+    for (unsigned int i = 0; i < 32; ++i)
+    {
+      machines[lane]->registers[i].value = registers[i][lane];
+    }
+  }
+
+  // Copy the registers of the lanes which haven't failed to their machines,
+  // as those which have were stored when they did.
+  void storeAll()
+  {
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (!(failed & (1u << lane))) store(lane);
+    }
+  }
+
+  // Stop each lane of the group at its program counter with the exception,
+  // leaving the other lanes to carry on.
+  void fail(const Group& group, std::exception_ptr error)
+  {
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (!(group.lanes & (1u << lane))) continue;
+
+      machines[lane]->programCounter.value = group.programCounter;
+      store(lane);
+      errors[lane] = error;
+      failed |= 1u << lane;
+    }
+  }
+
+  // Add the lanes at the given program counter to the groups, merging them
+  // with the group already there.
+  //
+  // The lanes which have reached their instruction limit are left out.
+  void add(std::uint32_t programCounter, unsigned int lanes)
+  {
+    std::uint64_t budget = UINT64_MAX;
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (!(lanes & (1u << lane))) continue;
+
+      machines[lane]->programCounter.value = programCounter;
+      const DLXMachine& machine = *machines[lane];
+      if (machine.instructionCount >= machine.instructionLimit)
+      {
+        lanes &= ~(1u << lane);
+        continue;
+      }
+
+      budget = std::min(budget,
+                        machine.instructionLimit - machine.instructionCount);
+    }
+
+    if (lanes == 0) return;
+
+    for (auto group = groups.begin(); group != groups.end(); ++group)
+    {
+      if (group->programCounter == programCounter)
+      {
+        group->lanes |= lanes;
+        group->budget = std::min(group->budget, budget);
+        return;
+      }
+    }
+
+    const Group group = { programCounter, lanes, 0, budget };
+    groups.push_back(group);
+  }
+
+  // Add the instructions executed by the group to each of its machines.
+  void flush(Group& group)
+  {
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (group.lanes & (1u << lane))
+      {
+        machines[lane]->instructionCount += group.executed;
+      }
+    }
+    group.executed = 0;
+  }
+
+  // Add each lane of the group at the program counter of its machine.
+  void regroup(const Group& group)
+  {
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (group.lanes & (1u << lane))
+      {
+        add(machines[lane]->programCounter.value, 1u << lane);
+      }
+    }
+  }
+
+  // Runs the group until it reaches an instruction which may send its lanes
+  // different ways, after which the lanes are added back to the groups.
+  void runGroup(Group group)
+  {
+    Vector active;
+    LaneMask(group.lanes, &active);
+
+    // Any lane can fetch the instructions as they all have the same ones.
+    unsigned int first = 0;
+    while (!(group.lanes & (1u << first))) ++first;
+    DLXMachine* const fetcher = machines[first];
+
+    for (;;)
+    {
+      if (group.executed == group.budget)
+      {
+        flush(group);
+        add(group.programCounter, group.lanes);
+        return;
+      }
+
+      const DecodedInstruction* const instruction =
+        fetcher->decodeCache(fetcher->mem, group.programCounter);
+      if (instruction == nullptr)
+      {
+        flush(group);
+        try
+        {
+          Memory::fault(group.programCounter, 4, MemoryAccess::Fetch);
+        }
+        catch (...)
+        {
+          fail(group, std::current_exception());
+        }
+        return;
+      }
+
+      ++group.executed;
+      group.programCounter += 4;
+
+      if (!Compute(*instruction, active, registers))
+      {
+        control(group, *instruction, registers[instruction->ri]);
+        return;
+      }
+    }
+  }
+
+  // Performs an instruction which is not done with vectors.
+  void control(Group& group, const DecodedInstruction& instruction,
+               const Vector& ri)
+  {
+    flush(group);
+
+    switch (instruction.operation)
+    {
+      case 4: // beqz
+      case 5: // bnez
+      {
+        const Vector isZero = (ri == 0);
+        const unsigned int zero = LanesSet(isZero) & group.lanes;
+        const unsigned int taken =
+          (instruction.operation == 4) ? zero : group.lanes & ~zero;
+        add(group.programCounter + instruction.immediate, taken);
+        add(group.programCounter, group.lanes & ~taken);
+        return;
+      }
+
+      case 65: // halt
+        for (unsigned int lane = 0; lane < laneCount; ++lane)
+        {
+          if (group.lanes & (1u << lane))
+          {
+            machines[lane]->programCounter.value = group.programCounter;
+            machines[lane]->instructionRegister.value = instruction.word;
+          }
+        }
+        return;
+    }
+
+    // Perform it on each machine in turn, as the instructions may also use
+    // the special registers and memory.
+    for (unsigned int lane = 0; lane < laneCount; ++lane)
+    {
+      if (!(group.lanes & (1u << lane))) continue;
+
+      DLXMachine* const machine = machines[lane];
+      store(lane);
+      machine->programCounter.value = group.programCounter;
+      machine->instructionRegister.value = instruction.word;
+      try
+      {
+        instruction.execute(machine, instruction);
+      }
+      catch (...)
+      {
+        // The lane stops with its machine as the exception left it, and the
+        // rest of the group carries on without it.
+        errors[lane] = std::current_exception();
+        failed |= 1u << lane;
+        group.lanes &= ~(1u << lane);
+        continue;
+      }
+      load(lane);
+    }
+
+    regroup(group);
+  }
+};
+
+#undef DLX_ADD
+#undef DLX_SUBTRACT
+#undef DLX_MULTIPLY
+#undef DLX_SHIFT_LEFT
+#undef DLX_SHIFT_RIGHT
+
+#endif
+
+namespace
+{
+  // Runs each of the machines on its own as blocks.
+  void RunEach(dlx::hardware::DLXMachine* const* machines, std::size_t count,
+               std::exception_ptr* errors)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      try
+      {
+        machines[i]->run(dlx::hardware::Engine::Blocks);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    }
+  }
+}
+
+void dlx::hardware::RunLockstep(DLXMachine* const* machines, std::size_t count,
+                                std::exception_ptr* errors)
+{
+  std::vector<std::exception_ptr> caught;
+  if (errors == nullptr)
+  {
+    caught.resize(count);
+    errors = caught.data();
+  }
+
+  // The vectors don't trace, count or tell observers of the instructions.
+  const bool watched = std::any_of(
+    machines, machines + count,
+    [](const DLXMachine* machine)
+    { return machine->InstructionProfile() || machine->IsObserved(); });
+  if (IsTracing() || watched || !DEMU_LOCKSTEP)
+  {
+    RunEach(machines, count, errors);
+  }
+#if DEMU_LOCKSTEP
+  else
+  {
+    for (std::size_t start = 0; start < count; start += LockstepWidth)
+    {
+      const unsigned int width = static_cast<unsigned int>(
+        std::min<std::size_t>(LockstepWidth, count - start));
+      Lockstep(machines + start, width, errors + start).run();
+    }
+  }
+#endif
+
+  for (auto error = caught.begin(); error != caught.end(); ++error)
+  {
+    if (*error) std::rethrow_exception(*error);
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,67 @@
+#ifndef DLX_LOCKSTEP_HPP_
+#define DLX_LOCKSTEP_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Lockstep
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides running many machines with the same program at once.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The registers of the machines are held as one vector per
+//                register with a lane for each machine, so an instruction is
+//                performed for all the machines at the same program counter
+//                with a single vector operation.
+//
+//                When a branch sends the machines different ways they are
+//                split into groups by program counter. The group with the
+//                lowest program counter runs first so the others wait for it
+//                to catch up, at which point they are merged again.
+//
+//                Only the integer arithmetic, logical, shift and set-compare
+//                instructions are performed on the vectors. The rest are
+//                performed on each machine in turn.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <exception>
+
+// The vectors rely on the GCC vector extensions, elsewhere the machines are
+// run one after the other.
+#ifndef DEMU_LOCKSTEP
+#if defined(__GNUC__)
+#define DEMU_LOCKSTEP 1
+#else
+#define DEMU_LOCKSTEP 0
+#endif
+#endif
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+    class Lockstep;
+
+    // The number of machines in each vector.
+    const unsigned int LockstepWidth = 8;
+
+    // Runs each of the machines until it halts or reaches its instruction
+    // limit.
+    //
+    // The machines must have the same instructions in memory, but may differ
+    // in the contents of their registers and the rest of the memory.
+    //
+    // A machine which raises an exception stops there and the others carry
+    // on. The exception is stored at the machine's index in errors, which
+    // has an entry for each machine, or if it is null the first of them is
+    // rethrown once all the machines have stopped.
+    void RunLockstep(DLXMachine* const* machines, std::size_t count,
+                     std::exception_ptr* errors = nullptr);
+  }
+}
+
+#endif
@@ -15,11 +15,22 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "BlockCache.hpp"
+#include "Decoder.hpp"
+#include "FloatingPoint.hpp"
 #include "Instruction.hpp"
+#include "Jit.hpp"
+#include "Lockstep.hpp"
 #include "Memory.hpp"
+#include "Native.hpp"
+#include "Observer.hpp"
+#include "Profile.hpp"
 #include "Register.hpp"
+#include "Replay.hpp"
 
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace dlx
 {
@@ -28,13 +39,44 @@ namespace dlx
     struct Configuration
     {
       unsigned int startAddress;
-      unsigned int endAddress;
+      std::uint64_t endAddress; // Up to 2^32 for the whole address space.
+      PageSize pageSize;
+    };
+
+    // The ways the machine can execute instructions.
+    enum class Engine
+    {
+      Interpreter, // Each instruction is fetched and executed in turn.
+      Blocks,      // Blocks of instructions are translated and linked.
+      Jit,         // As Blocks, with the hot blocks compiled to native code.
+      Lockstep,    // As many machines at once, see Lockstep.hpp.
+      Native,      // With the code recompiled ahead of time, see Native.hpp.
+    };
+
+    class Checkpoint;
+    class DLXMachine;
+
+    // The state of a machine at the time the snapshot was taken, from which
+    // any number of machines can be created.
+    struct MachineSnapshot
+    {
+      std::shared_ptr<const MemorySnapshot> memory;
+      Register registers[32];
+      FloatingPointRegisters floatRegisters;
+      Register programCounter;
+      Instruction instructionRegister;
+      Register processorStatusWord;
+      Register exceptionAddress;
+      Register exceptionBase;
+      Register floatingPointStatus;
+      std::uint64_t instructionCount;
     };
 
     class DLXMachine
     {
       Memory mem;
       Register registers[32];
+      FloatingPointRegisters floatRegisters;
 
       // Special purpose registers.
       Register programCounter;         // pc
@@ -42,17 +84,113 @@ namespace dlx
       Register processorStatusWord;    // psw
       Register exceptionAddress;       // xar
       Register exceptionBase;          // xbr
+      Register floatingPointStatus;    // fpsr, set by the compares
+
+      // The instructions that have been decoded so far.
+      DecodeCache decodeCache;
+
+      // The blocks that have been translated so far.
+      BlockCache blocks;
+
+      // The number of instructions executed.
+      std::uint64_t instructionCount;
+
+      // Running stops once instructionCount reaches this.
+      std::uint64_t instructionLimit;
+
+#if DEMU_THREADED_DISPATCH
+      friend const DecodedInstruction* RunThreaded(DLXMachine* machine);
+#endif
+      // The compiler for blocks which are executed often, this is created the
+      // first time it is needed.
+      std::unique_ptr<Jit> jit;
+
+      // The code the program was recompiled to ahead of time, or nullptr if
+      // there is none, and whether the program has since written over it.
+      std::shared_ptr<const NativeCode> native;
+      bool nativeModified;
+
+      // The snapshot of the memory taken by snapshot(), which is reused
+      // until the memory may have been modified.
+      std::shared_ptr<const MemorySnapshot> memorySnapshot;
+
+      // The counts of the instructions executed, or nullptr if they are not
+      // being counted.
+      std::unique_ptr<Profile> profile;
+
+      // Told of each instruction executed, see Observer.hpp.
+      std::vector<Observer*> observers;
+
+      // Saved to as run() goes, or nullptr if there is none.
+      Checkpoint* checkpoint;
+
+      // The log of the input read from the host, or nullptr if it is neither
+      // being recorded nor replayed.
+      std::unique_ptr<InputLog> inputLog;
+
+      friend class BlockCache;
+      friend class Checkpoint;
+      friend class Jit;
+      friend class Lockstep;
+      friend class NativeCode;
+      friend const DecodedInstruction* ExecuteBlock(
+        DLXMachine* machine, TranslatedBlock* block);
+      friend const DecodedInstruction* RunBlocks(DLXMachine* machine);
+      friend const DecodedInstruction* RunJit(DLXMachine* machine);
+      friend const DecodedInstruction* RunNative(DLXMachine* machine);
 
     public:
       DLXMachine(const Configuration& configuration);
 
+      // Creates a machine with the registers and memory of the snapshot. The
+      // memory is shared with the snapshot until either modifies a page.
+      explicit DLXMachine(const MachineSnapshot& snapshot);
+
+      ~DLXMachine();
+
+      // Take a snapshot of the registers and memory of the machine.
+      //
+      // The memory is shared with the snapshot until it is modified. The
+      // snapshot is reused until then, otherwise taking one copies the pages
+      // of the memory in use, see Memory::snapshot().
+      MachineSnapshot snapshot();
+
+      // Creates a copy of this machine, which shares the memory with it until
+      // either modifies a page.
+      std::unique_ptr<DLXMachine> fork();
+
       // Access the machine's memory.
-      Memory& memory() { return mem; }
+      Memory& memory() { memorySnapshot.reset(); return mem; }
+
+      // Load and store a value of type T for an instruction, see
+      // Memory::load() and Memory::store(). Unlike memory(), a load keeps the
+      // snapshot of the memory as it can't have been modified. A store over
+      // instructions that have been decoded invalidates them.
+      template<typename T>
+      T load(std::uint32_t address) { return mem.load<T>(address); }
+
+      template<typename T>
+      void store(std::uint32_t address, T value)
+      {
+        memorySnapshot.reset();
+        if (mem.store<T>(address, value)) codeModified(address, sizeof(T));
+      }
 
       Register* Registers() { return registers; }
       //const Register* Registers() const { return registers; }
       const Register* ConstRegisters() const { return registers; }
 
+      FloatingPointRegisters& FloatRegisters() { return floatRegisters; }
+      const FloatingPointRegisters& ConstFloatRegisters() const
+      { return floatRegisters; }
+
+      // The result of the last floating point compare, which bfpt and bfpf
+      // branch on.
+      bool FloatingPointStatus() const
+      { return floatingPointStatus.value != 0; }
+      void SetFloatingPointStatus(bool status)
+      { floatingPointStatus.value = status ? 1 : 0; }
+
       // Provides access to the components of the instruction in the
       // instruction register.
       const InstructionRegisterToRegister&
@@ -69,20 +207,108 @@ namespace dlx
 
       MemoryBlock* block(unsigned int address) { return memory()[address]; }
 
+      // Discard any decoded instructions, this must be called if the memory
+      // containing instructions is modified after they have been executed,
+      // other than by the program's own stores which see to it themselves.
+      void invalidateDecodedInstructions()
+      {
+        decodeCache.clear();
+        blocks.clear();
+        nativeModified = native != nullptr;
+      }
+
+      // Discard any decoded instructions in the range [address, address +
+      // size) as that memory has been modified.
+      void codeModified(std::uint32_t address, std::uint32_t size);
+
+      std::uint64_t InstructionCount() const { return instructionCount; }
+
+      // Run with the native code when the engine is Engine::Native, which
+      // must have been recompiled from the program in the memory now. The
+      // pages it covers are marked as code so the program's stores over it
+      // are noticed.
+      void SetNativeCode(std::shared_ptr<const NativeCode> code);
+      const NativeCode* Native() const { return native.get(); }
+
+      // Set the runs of instructions which are fused, with a bit for each
+      // Fusion, see Decoder.hpp. Only the threaded dispatch performs them.
+      void SetFusions(std::uint32_t fusions)
+      { decodeCache.setFusions(fusions); }
+      std::uint32_t Fusions() const { return decodeCache.Fusions(); }
+
+      // Start counting the instructions executed by each address and each
+      // operation, see Profile.hpp.
+      //
+      // The JIT and lockstep engines execute the instructions as blocks while
+      // they are being counted.
+      void EnableProfile()
+      {
+        if (!profile) profile.reset(new Profile());
+      }
+
+      // Returns the counts of the instructions executed, or nullptr if
+      // EnableProfile() hasn't been called.
+      const Profile* InstructionProfile() const { return profile.get(); }
+
+      // Tell the observer of each instruction executed from now on, until it
+      // is removed. The machine does not take ownership of it.
+      void AddObserver(Observer* observer);
+      void RemoveObserver(Observer* observer);
+
+      bool IsObserved() const { return !observers.empty(); }
+
+      // Save to the checkpoint whenever it is due while running, see
+      // Checkpoint.hpp, or stop if it is nullptr. The machine does not take
+      // ownership of it.
+      //
+      // The machine then runs a slice of instructions at a time, checking in
+      // between whether a save is due, and saves once more when it stops.
+      void SetCheckpoint(Checkpoint* checkpoint)
+      { this->checkpoint = checkpoint; }
+
+      // Record the input read from the host to the log or replay it from
+      // there, see Replay.hpp. The machine takes ownership of it.
+      void SetInputLog(std::unique_ptr<InputLog> log)
+      { inputLog = std::move(log); }
+      const InputLog* Inputs() const { return inputLog.get(); }
+
+      // Returns the next input of the kind, which is read from the host and
+      // recorded or replayed from the log if there is one. It is logged
+      // against InstructionCount(), which includes the instruction reading
+      // it.
+      //
+      // Throws std::runtime_error if the replay has diverged from the run
+      // which was recorded.
+      std::int32_t input(InputKind kind);
+
+      // Returns true if the last instruction run() stopped on was a halt.
+      bool IsHalted() const
+      {
+        return instructionRegister.formatR.opcode == 0 &&
+               instructionRegister.formatR.modifier == 1;
+      }
+
+      // Limit run() to stop once the given number of instructions have been
+      // executed in total, rather than carrying on until a halt.
+      std::uint64_t InstructionLimit() const { return instructionLimit; }
+      void SetInstructionLimit(std::uint64_t limit)
+      { instructionLimit = limit; }
+
       unsigned int ProgramCounter() const { return programCounter.value; }
       void SetProgramCounter(unsigned int address)
       { programCounter.value = address; }
 
       // Execute the next instruction.
       void step();
-      // Throws std::out_of_range if the program counter points to an
-      // instruction outside the addressable range of memory in the machine.
+      // Throws GuestException if the program counter is misaligned or points
+      // to an instruction outside the addressable range of memory in the
+      // machine.
 
-      // Keep executing until a halt instruction is reached or an error
-      // occurs.
+      // Keep executing until a halt instruction is reached, the instruction
+      // limit is reached or an error occurs.
       //
-      // Throws std::out_of_range, see step() for details.
-      void run();
+      // Throws GuestException, see step() for details.
+      void run(Engine engine = Engine::Interpreter);
     };
   }
 }
@@ -8,30 +8,503 @@
 // COPYRIGHT    : (c) 2015 Sean Donnellan.
 // LICENSE      : The MIT License (see LICENSE.txt)
 // AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
-// DESCRIPTION  : TODO Document.
+// DESCRIPTION  : Implements the page table of the memory blocks and the
+//                snapshots of them.
 //
 //===----------------------------------------------------------------------===//
 
 #include "Memory.hpp"
 
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#if DEMU_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if DEMU_MEMFD
+#include <fcntl.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+  using dlx::hardware::MemoryBlock;
+  using dlx::hardware::PageFile;
+
+  // Returns true if the size bytes at data are all zero.
+  bool IsZero(const unsigned char* data, std::size_t size)
+  {
+    return std::all_of(data, data + size,
+                       [](unsigned char byte) { return byte == 0; });
+  }
+
+#if DEMU_MEMFD
+  // Marks the pages of the storage which this process holds privately, which
+  // are those written to since it was mapped.
+  //
+  // Returns false if this can't be found out.
+  bool FindPrivatePages(const unsigned char* storage, std::size_t pageSize,
+                        std::vector<bool>* pages)
+  {
+    const int pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (pagemap < 0) return false;
+
+    // Each page has an entry with bit 63 set if it is present, 62 if it is
+    // swapped and 61 if it belongs to a file or is shared.
+    const std::uint64_t Present = std::uint64_t(1) << 63;
+    const std::uint64_t Swapped = std::uint64_t(1) << 62;
+    const std::uint64_t Shared = std::uint64_t(1) << 61;
+
+    std::vector<std::uint64_t> entries(4096);
+    const std::size_t firstPage =
+      reinterpret_cast<std::uintptr_t>(storage) / pageSize;
+    for (std::size_t page = 0; page < pages->size(); page += entries.size())
+    {
+      const std::size_t count =
+        std::min(entries.size(), pages->size() - page);
+      const std::size_t bytes = count * sizeof(std::uint64_t);
+      if (pread(pagemap, entries.data(), bytes,
+                (firstPage + page) * sizeof(std::uint64_t)) !=
+          static_cast<ssize_t>(bytes))
+      {
+        close(pagemap);
+        return false;
+      }
+
+      for (std::size_t i = 0; i < count; ++i)
+      {
+        if ((entries[i] & (Present | Swapped)) && !(entries[i] & Shared))
+        {
+          (*pages)[page + i] = true;
+        }
+      }
+    }
+
+    close(pagemap);
+    return true;
+  }
+
+  // Marks the pages of the file which have been written to.
+  void FindFilePages(const PageFile& file, std::size_t pageSize,
+                     std::vector<bool>* pages)
+  {
+    const off_t start = file.offset();
+    const off_t end = start + file.size();
+    for (off_t offset = start; offset < end;)
+    {
+      const off_t data = lseek(file.get(), offset, SEEK_DATA);
+      if (data < 0 || data >= end) break;
+      const off_t hole = lseek(file.get(), data, SEEK_HOLE);
+      if (hole < 0) break;
+
+      for (std::size_t page = (data - start) / pageSize;
+           page < (std::min(hole, end) - start + pageSize - 1) / pageSize &&
+           page < pages->size();
+           ++page)
+      {
+        (*pages)[page] = true;
+      }
+      offset = hole;
+    }
+  }
+#endif
+
+  // Marks the pages of pageSize bytes of the block's storage which may have
+  // been modified since the block was created or mapped from its file, or
+  // every page if this can't be found out.
+  std::vector<bool> FindModifiedPages(const MemoryBlock& block,
+                                      std::size_t pageSize)
+  {
+    const std::size_t size = block.storage.get_deleter().size;
+    std::vector<bool> pages((size + pageSize - 1) / pageSize);
+#if DEMU_MEMFD
+    if (FindPrivatePages(block.storage.get(), pageSize, &pages))
+    {
+      if (block.file) FindFilePages(*block.file, pageSize, &pages);
+      return pages;
+    }
+#endif
+    pages.assign(pages.size(), true);
+    return pages;
+  }
+
+  // Copy the contents of the block to the file, which is empty. Only the
+  // pages which may have been modified since the block was created, or which
+  // hold data in the file it was mapped from, are considered. The file is
+  // not layered over the previous one, so all of the latter are copied
+  // again.
+  void CopyModifiedPages(const MemoryBlock& block, PageFile* file)
+  {
+    const unsigned char* const storage = block.storage.get();
+    const std::size_t size = file->size();
+
+#if DEMU_MEMFD
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    const std::vector<bool> pages = FindModifiedPages(block, pageSize);
+    for (std::size_t page = 0; page < pages.size(); ++page)
+    {
+      if (!pages[page]) continue;
+
+      const std::size_t offset = page * pageSize;
+      const std::size_t length = std::min(pageSize, size - offset);
+      if (!IsZero(storage + offset, length))
+      {
+        file->write(offset, storage + offset, length);
+      }
+    }
+#else
+    (void)IsZero;
+    file->write(0, storage, size);
+#endif
+  }
+}
+
+void dlx::hardware::PageDeleter::operator()(void* pages) const
+{
+#if DEMU_MMAP
+  munmap(pages, size);
+#else
+  delete[] static_cast<unsigned char*>(pages);
+#endif
+}
+
+void* dlx::hardware::ReservePages(std::size_t& size, PageSize pageSize)
+{
+#if DEMU_MMAP
+  // Anonymous mappings are zero-filled when a page is first touched, and with
+  // MAP_NORESERVE no swap is set aside for the pages that never are.
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+
+#ifdef MAP_HUGETLB
+  if (pageSize == PageSize::Huge)
+  {
+    const std::size_t hugePageSize = 2 * 1024 * 1024;
+    const std::size_t hugeSize =
+      (size + hugePageSize - 1) & ~(hugePageSize - 1);
+    // The huge pages are reserved now, rather than failing when touched,
+    // so this falls back to the transparent ones if the pool is too small.
+    void* const pages =
+      mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pages != MAP_FAILED)
+    {
+      size = hugeSize;
+      return pages;
+    }
+  }
+#endif
+
+  void* const pages =
+    mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (pages == MAP_FAILED) throw std::bad_alloc();
+
+#ifdef MADV_HUGEPAGE
+  if (pageSize != PageSize::Normal) madvise(pages, size, MADV_HUGEPAGE);
+#endif
+  return pages;
+#else
+  (void)pageSize;
+  return new unsigned char[size]();
+#endif
+}
+
+dlx::hardware::PageFile::PageFile(std::size_t size)
+#if DEMU_MEMFD
+: descriptor(memfd_create("demu", MFD_CLOEXEC)),
+  base(0),
+#else
+: contents(new unsigned char[size]()),
+#endif
+  length(size)
+{
+#if DEMU_MEMFD
+  if (descriptor < 0) throw std::bad_alloc();
+  if (ftruncate(descriptor, size) != 0)
+  {
+    close(descriptor);
+    throw std::bad_alloc();
+  }
+#endif
+}
+
+#if DEMU_MMAP
+dlx::hardware::PageFile::PageFile(
+  int file, std::size_t offset, std::size_t size)
+#if DEMU_MEMFD
+: descriptor(fcntl(file, F_DUPFD_CLOEXEC, 0)),
+  base(offset),
+#else
+: contents(new unsigned char[size]()),
+#endif
+  length(size)
+{
+#if DEMU_MEMFD
+  if (descriptor < 0)
+  {
+    throw std::runtime_error("The file could not be read.");
+  }
+#else
+  // Without memfd the contents are kept in memory, so it is read now.
+  for (std::size_t done = 0; done < size;)
+  {
+    const ssize_t read =
+      pread(file, contents.get() + done, size - done, offset + done);
+    if (read < 0)
+    {
+      throw std::runtime_error("The file could not be read.");
+    }
+    if (read == 0) break; // The rest is past the end of the file, so zero.
+    done += read;
+  }
+#endif
+}
+#endif
+
+dlx::hardware::PageFile::~PageFile()
+{
+#if DEMU_MEMFD
+  close(descriptor);
+#endif
+}
+
+void dlx::hardware::PageFile::write(
+  std::size_t offset, const unsigned char* data, std::size_t size)
+{
+#if DEMU_MEMFD
+  while (size > 0)
+  {
+    const ssize_t written = pwrite(descriptor, data, size, base + offset);
+    if (written <= 0) throw std::bad_alloc();
+    data += written;
+    offset += written;
+    size -= written;
+  }
+#else
+  std::memcpy(contents.get() + offset, data, size);
+#endif
+}
+
+std::unique_ptr<unsigned char[], dlx::hardware::PageDeleter>
+dlx::hardware::PageFile::map() const
+{
+#if DEMU_MEMFD
+  void* const pages = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, descriptor, base);
+  if (pages == MAP_FAILED) throw std::bad_alloc();
+
+  PageDeleter deleter = { length };
+  return std::unique_ptr<unsigned char[], PageDeleter>(
+    static_cast<unsigned char*>(pages), deleter);
+#else
+  std::unique_ptr<unsigned char[], PageDeleter> storage =
+    AllocatePages<unsigned char>(length);
+  std::memcpy(storage.get(), contents.get(), length);
+  return storage;
+#endif
+}
+
+void dlx::hardware::PageFile::remap(unsigned char* storage) const
+{
+#if DEMU_MEMFD
+  if (mmap(storage, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           descriptor, base) == MAP_FAILED)
+  {
+    throw std::runtime_error("The memory could not be remapped.");
+  }
+#else
+  // The storage is already a copy of the contents.
+  (void)storage;
+#endif
+}
+
+std::vector<bool> dlx::hardware::FindWrittenPages(const MemoryBlock& block)
+{
+#if DEMU_MMAP
+  const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+#else
+  const std::size_t pageSize = MemoryBlock::DirtyPageBytes;
+#endif
+  const std::vector<bool> pages = FindModifiedPages(block, pageSize);
+
+  // The host's pages are a whole number of the smaller pages.
+  const std::size_t ratio =
+    std::max<std::size_t>(pageSize / MemoryBlock::DirtyPageBytes, 1);
+  std::vector<bool> written(pages.size() * ratio);
+  for (std::size_t page = 0; page < written.size(); ++page)
+  {
+    written[page] = pages[page / ratio];
+  }
+  return written;
+}
+
+void dlx::hardware::Memory::fault(
+  std::uint32_t address, unsigned int size, MemoryAccess access)
+{
+  const bool misaligned = (address & (size - 1)) != 0;
+
+  std::ostringstream message;
+  if (access == MemoryAccess::Fetch)
+  {
+    message << "A fetch of the instruction at";
+  }
+  else
+  {
+    const bool write = access == MemoryAccess::Store;
+    message << (write ? "A store of " : "A load of ") << size
+            << (size == 1 ? " byte " : " bytes ") << (write ? "to" : "from");
+  }
+  message << " 0x" << std::hex << std::setfill('0') << std::setw(8) << address
+          << (misaligned ? " is misaligned." : " is outside the memory.");
+  throw GuestException(
+    misaligned ? ExceptionCause::MisalignedAccess :
+                 ExceptionCause::OutsideMemory,
+    address, message.str());
+}
+
 dlx::hardware::MemoryBlock*
-dlx::hardware::Memory::operator[](std::uint32_t address)
+dlx::hardware::Memory::find(std::uint32_t address)
 {
-  for (auto block = blocks.begin(); block != blocks.end(); ++block)
+  MemoryBlock* const block = lookup(address);
+  if (block) last = block;
+  return block;
+}
+
+dlx::hardware::MemoryBlock*
+dlx::hardware::Memory::lookup(std::uint32_t address) const
+{
+  const PageTable* const table =
+    directory[address >> (PageBits + TableBits)].get();
+  if (table == nullptr) return nullptr;
+
+  MemoryBlock* const block =
+    table->pages[(address >> PageBits) & ((1 << TableBits) - 1)];
+  if (block == nullptr) return nullptr;
+
+  if (block->contains(address)) return block;
+
+  // The page is shared with another block.
+  for (auto other = blocks.begin(); other != blocks.end(); ++other)
   {
-    if (block->contains(address)) return &(*block);
+    if ((*other)->contains(address)) return other->get();
   }
   return nullptr;
 }
 
-dlx::hardware::Memory::Memory(std::uint32_t start, std::uint32_t end)
-: blocks()
+dlx::hardware::Memory::Memory(
+  std::uint32_t start, std::uint64_t end, PageSize pageSize)
+: blocks(),
+  directory(),
+  last(nullptr)
+{
+  add(start, end, pageSize);
+}
+
+dlx::hardware::MemoryBlock*
+dlx::hardware::Memory::add(
+  std::uint32_t start, std::uint64_t end, PageSize pageSize)
 {
-  MemoryBlock block;
-  block.startAddress = start;
-  block.endAddress = end;
+  if (end <= start)
+  {
+    throw std::invalid_argument("The memory block must not be empty.");
+  }
+
+  if (end > (std::uint64_t(1) << 32))
+  {
+    throw std::invalid_argument(
+      "The memory block must be within the 32-bit address space.");
+  }
+
+  std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+  block->startAddress = start;
+  block->endAddress = end;
+  block->storage = AllocatePages<unsigned char>(end - start, pageSize);
+  return insert(std::move(block));
+}
+
+dlx::hardware::MemoryBlock*
+dlx::hardware::Memory::insert(std::unique_ptr<MemoryBlock> block)
+{
+  for (auto other = blocks.begin(); other != blocks.end(); ++other)
+  {
+    if (block->startAddress < (*other)->endAddress &&
+        (*other)->startAddress < block->endAddress)
+    {
+      throw std::invalid_argument("The memory block overlaps another.");
+    }
+  }
+
+  // Point each page the block covers at it, unless another block already has
+  // the page.
+  const std::uint32_t firstPage = block->startAddress >> PageBits;
+  const std::uint32_t lastPage =
+    static_cast<std::uint32_t>((block->endAddress - 1) >> PageBits);
+  for (std::uint32_t page = firstPage; page <= lastPage; ++page)
+  {
+    std::unique_ptr<PageTable>& table = directory[page >> TableBits];
+    if (!table) table.reset(new PageTable());
+
+    MemoryBlock*& entry = table->pages[page & ((1 << TableBits) - 1)];
+    if (entry == nullptr) entry = block.get();
+  }
+
+  const std::uint64_t dirtyPages =
+    ((block->endAddress - block->startAddress) + MemoryBlock::DirtyPageBytes -
+     1) >> MemoryBlock::DirtyPageBits;
+  block->dirty.assign((dirtyPages + 63) / 64, 0);
+
+  const std::uint64_t codePages =
+    ((block->endAddress - block->startAddress) + MemoryBlock::CodePageBytes -
+     1) >> MemoryBlock::CodePageBits;
+  block->code.assign((codePages + 63) / 64, 0);
+
   blocks.push_back(std::move(block));
-  blocks.back().storage.reset(new unsigned char[end - start]());
+  return blocks.back().get();
+}
+
+dlx::hardware::Memory::Memory(const MemorySnapshot& snapshot)
+: blocks(),
+  directory(),
+  last(nullptr)
+{
+  for (auto from = snapshot.blocks.begin(); from != snapshot.blocks.end();
+       ++from)
+  {
+    std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+    block->startAddress = from->startAddress;
+    block->endAddress = from->endAddress;
+    block->storage = from->file->map();
+    block->file = from->file;
+    insert(std::move(block));
+  }
+}
+
+dlx::hardware::MemorySnapshot dlx::hardware::Memory::snapshot()
+{
+  MemorySnapshot snapshot;
+  for (auto block = blocks.begin(); block != blocks.end(); ++block)
+  {
+    MemoryBlock& from = **block;
+    std::shared_ptr<PageFile> file(
+      new PageFile(from.storage.get_deleter().size));
+    CopyModifiedPages(from, file.get());
+
+    // The contents are the same, only now they are shared with the file.
+    file->remap(from.storage.get());
+    from.file = file;
+
+    const MemorySnapshot::Block snapshotBlock = {
+      from.startAddress, from.endAddress, file
+    };
+    snapshot.blocks.push_back(snapshotBlock);
+  }
+  return snapshot;
 }
 
 //===--------------------------- End of the file --------------------------===//
\ No newline at end of file
@@ -10,34 +10,241 @@
 // COPYRIGHT    : (c) 2015 Sean Donnellan.
 // LICENSE      : The MIT License (see LICENSE.txt)
 // AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
-// DESCRIPTION  : TODO Document.
+// DESCRIPTION  : The blocks of memory are found through a two-level page table
+//                over the 32-bit address space, with 4 KiB pages. The top ten
+//                bits of an address index the directory and the next ten
+//                index the page, which points to the block containing it.
+//
+//                The block found by the previous look-up is checked first, as
+//                successive accesses are almost always to the same block.
+//
+//                The storage of a block is reserved with mmap() and a page is
+//                only committed when it is first touched, so a large memory
+//                costs no more than the part of it a program uses.
+//
+//                A snapshot of the memory is kept in files (memfd) which the
+//                memory, and any created from the snapshot, map privately so
+//                they share each page until one of them writes to it.
+//
+//                The loads and stores of the instructions go through load()
+//                and store(), which convert between the guest's big-endian
+//                byte order and the host's. An access which is aligned and
+//                within the block found is inlined down to a copy and a byte
+//                swap, and any other goes to a single out-of-line path which
+//                raises the guest's exception.
+//
+//                Each block has a flag for every 1 KiB page that instructions
+//                have been decoded from, so a store can tell whether it wrote
+//                over code at the cost of a test of a bit, and only then do
+//                the decoded and translated instructions need invalidating.
 //
 //===----------------------------------------------------------------------===//
 
+#include "Exception.hpp"
+
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
+// Reserve the storage for memory with mmap() where it is available, elsewhere
+// it is allocated with new[].
+#ifndef DEMU_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define DEMU_MMAP 1
+#else
+#define DEMU_MMAP 0
+#endif
+#endif
+
+// Keep snapshots in anonymous files where memfd_create() is available,
+// elsewhere the contents are copied.
+#ifndef DEMU_MEMFD
+#if defined(__linux__)
+#define DEMU_MEMFD 1
+#else
+#define DEMU_MEMFD 0
+#endif
+#endif
+
+// The guest is big-endian, so the bytes of a value are swapped on a host which
+// is not.
+#ifndef DEMU_HOST_BIG_ENDIAN
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DEMU_HOST_BIG_ENDIAN 1
+#else
+#define DEMU_HOST_BIG_ENDIAN 0
+#endif
+#endif
+
 namespace dlx
 {
   namespace hardware
   {
+    // Converts a value between the guest's byte order and the host's, which
+    // is the same conversion in either direction.
+    inline std::uint8_t GuestOrder(std::uint8_t value) { return value; }
+
+    inline std::uint16_t GuestOrder(std::uint16_t value)
+    {
+#if DEMU_HOST_BIG_ENDIAN
+      return value;
+#elif defined(__GNUC__)
+      return __builtin_bswap16(value);
+#else
+      return static_cast<std::uint16_t>(value << 8 | value >> 8);
+#endif
+    }
+
+    inline std::uint32_t GuestOrder(std::uint32_t value)
+    {
+#if DEMU_HOST_BIG_ENDIAN
+      return value;
+#elif defined(__GNUC__)
+      return __builtin_bswap32(value);
+#else
+      value = (value & 0x0000FFFF) << 16 | (value & 0xFFFF0000) >> 16;
+      return (value & 0x00FF00FF) << 8 | (value & 0xFF00FF00) >> 8;
+#endif
+    }
+
+    inline std::uint64_t GuestOrder(std::uint64_t value)
+    {
+#if DEMU_HOST_BIG_ENDIAN
+      return value;
+#elif defined(__GNUC__)
+      return __builtin_bswap64(value);
+#else
+      const std::uint64_t lower = GuestOrder(static_cast<std::uint32_t>(value));
+      return lower << 32 | GuestOrder(static_cast<std::uint32_t>(value >> 32));
+#endif
+    }
+
+    // The size of the host pages backing the storage for memory.
+    enum class PageSize
+    {
+      Normal,      // The host's usual page size.
+      Transparent, // Ask for transparent huge pages (MADV_HUGEPAGE).
+      Huge,        // Use huge pages from the reserved pool (MAP_HUGETLB),
+                   // falling back to Transparent if there are none.
+    };
+
+    // Releases storage reserved by ReservePages().
+    struct PageDeleter
+    {
+      std::size_t size;
+
+      void operator()(void* pages) const;
+    };
+
+    // Reserves size bytes of zeroed storage, rounding the size up to a whole
+    // number of pages.
+    //
+    // Throws std::bad_alloc if it can't be reserved.
+    void* ReservePages(std::size_t& size, PageSize pageSize);
+
+    // Reserves storage for count zeroed values of type T.
+    template<typename T>
+    std::unique_ptr<T[], PageDeleter> AllocatePages(
+      std::uint64_t count, PageSize pageSize = PageSize::Normal)
+    {
+      PageDeleter deleter = { static_cast<std::size_t>(count * sizeof(T)) };
+      T* const pages = static_cast<T*>(ReservePages(deleter.size, pageSize));
+      return std::unique_ptr<T[], PageDeleter>(pages, deleter);
+    }
+
+    // Holds the contents of a memory block as it was when a snapshot was
+    // taken.
+    class PageFile
+    {
+#if DEMU_MEMFD
+      int descriptor;
+      std::size_t base; // The offset of the contents in the file.
+#else
+      std::unique_ptr<unsigned char[]> contents;
+#endif
+      std::size_t length;
+
+    public:
+      // Creates a file of size bytes, all of which are zero.
+      //
+      // Throws std::bad_alloc if it can't be created.
+      explicit PageFile(std::size_t size);
+
+#if DEMU_MMAP
+      // Holds the size bytes from the offset in the open file, which must be
+      // a multiple of the host's page size. The file is not modified by this
+      // or by the storage mapped from it.
+      //
+      // Throws std::runtime_error if it can't be read.
+      PageFile(int file, std::size_t offset, std::size_t size);
+#endif
+      ~PageFile();
+
+      std::size_t size() const { return length; }
+
+      // Copy size bytes from data to the given offset in the file.
+      void write(std::size_t offset, const unsigned char* data,
+                 std::size_t size);
+
+      // Returns a private copy of the contents of the file, of which a page
+      // is only copied when it is written to.
+      std::unique_ptr<unsigned char[], PageDeleter> map() const;
+
+      // Replace the storage, which must be the size of the file, with a
+      // private copy of the file without moving it.
+      void remap(unsigned char* storage) const;
+
+#if DEMU_MEMFD
+      int get() const { return descriptor; }
+      std::size_t offset() const { return base; }
+#endif
+
+    private:
+      PageFile(const PageFile&);
+      PageFile& operator=(const PageFile&);
+    };
+
     // Represents a contiguous block of memory.
     struct MemoryBlock
     {
       std::uint32_t startAddress;
-      std::uint32_t endAddress;
-      std::unique_ptr<unsigned char[]> storage;
+      std::uint64_t endAddress; // This is 2^32 for a block at the very end.
+      std::unique_ptr<unsigned char[], PageDeleter> storage;
+
+      // The file which the storage is a private copy of, or nullptr if it was
+      // not created from a snapshot.
+      std::shared_ptr<const PageFile> file;
+
+      // A bit for each page of DirtyPageBytes from the start of the block,
+      // which is set when the page is written to, see markDirty().
+      std::vector<std::uint64_t> dirty;
+      static const unsigned int DirtyPageBits = 12;
+      static const std::uint32_t DirtyPageBytes = 1 << DirtyPageBits;
+
+      // A bit for each page of CodePageBytes from the start of the block,
+      // which is set when an instruction in the page is decoded, see
+      // markCode(). A store to a page without it has no instructions to
+      // invalidate.
+      std::vector<std::uint64_t> code;
+      static const unsigned int CodePageBits = 10;
+      static const std::uint32_t CodePageBytes = 1 << CodePageBits;
 
       static_assert(sizeof(unsigned char) == 1,
                     "An unsigned char is expected to be a single byte.");
 
-      MemoryBlock() : startAddress(0), endAddress(0), storage() {}
+      MemoryBlock()
+      : startAddress(0), endAddress(0), storage(), file(), dirty(), code() {}
 
       MemoryBlock(MemoryBlock&& that)
       : startAddress(that.startAddress),
         endAddress(that.endAddress),
-        storage(std::move(that.storage))
+        storage(std::move(that.storage)),
+        file(std::move(that.file)),
+        dirty(std::move(that.dirty)),
+        code(std::move(that.code))
       {
       }
 
@@ -46,20 +253,211 @@ namespace dlx
       {
         return address >= startAddress && address < endAddress;
       }
+
+      // Returns the value of type T at the address, where all of its bytes
+      // must be in the block.
+      template<typename T>
+      T load(std::uint32_t address) const
+      {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        Unsigned value;
+        std::memcpy(&value, storage.get() + (address - startAddress),
+                    sizeof(value));
+        return static_cast<T>(GuestOrder(value));
+      }
+
+      // Writes the value of type T to the address, where all of its bytes
+      // must be in the block and in one page of code, and marks the page as
+      // dirty.
+      //
+      // Returns true if the page holds instructions that have been decoded.
+      template<typename T>
+      bool store(std::uint32_t address, T value)
+      {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+        const Unsigned swapped = GuestOrder(static_cast<Unsigned>(value));
+        std::memcpy(storage.get() + (address - startAddress), &swapped,
+                    sizeof(swapped));
+        markDirty(address, sizeof(swapped));
+        return hasCode(address);
+      }
+
+      // Note that the size bytes from the address, which must all be in the
+      // block, have been written to so the next checkpoint saves them. Only
+      // writes after the first checkpoint need noting, as it saves them all.
+      void markDirty(std::uint32_t address, std::uint32_t size)
+      {
+        const std::uint32_t first = (address - startAddress) >> DirtyPageBits;
+        const std::uint32_t last =
+          (address - startAddress + size - 1) >> DirtyPageBits;
+        for (std::uint32_t page = first; page <= last; ++page)
+        {
+          dirty[page >> 6] |= std::uint64_t(1) << (page & 63);
+        }
+      }
+
+      // Note that the instruction at the address, which must be in the
+      // block, has been decoded.
+      void markCode(std::uint32_t address)
+      {
+        const std::uint32_t page = (address - startAddress) >> CodePageBits;
+        code[page >> 6] |= std::uint64_t(1) << (page & 63);
+      }
+
+      // Returns true if an instruction in the page of the address, which
+      // must be in the block, has been decoded.
+      bool hasCode(std::uint32_t address) const
+      {
+        const std::uint32_t page = (address - startAddress) >> CodePageBits;
+        return (code[page >> 6] >> (page & 63)) & 1;
+      }
+    };
+
+    // Returns a flag for each page of DirtyPageBytes of the block's storage,
+    // set if the page may not be zero as it has been written to since the
+    // block was created or is in the file it was mapped from.
+    std::vector<bool> FindWrittenPages(const MemoryBlock& block);
+
+    // The contents of the memory at the time the snapshot was taken.
+    struct MemorySnapshot
+    {
+      struct Block
+      {
+        std::uint32_t startAddress;
+        std::uint64_t endAddress;
+        std::shared_ptr<const PageFile> file;
+      };
+
+      std::vector<Block> blocks;
+    };
+
+    // The ways the memory is accessed, for the exception one raises.
+    enum class MemoryAccess
+    {
+      Load,
+      Store,
+      Fetch, // Of an instruction.
     };
 
     // Represents the memory unit which knows about the indvidual memory
     // blocks. Provides access to the undyling blocks of memory.
     class Memory
     {
-      std::vector<MemoryBlock> blocks;
+    public:
+      static const unsigned int PageBits = 12;
+      static const unsigned int TableBits = 10;
+      static const unsigned int DirectoryBits = 32 - PageBits - TableBits;
+
+    private:
+      // The block that each page of a table is in. A page which is shared by
+      // more than one block, as they start or end part way through it, has
+      // the first of them.
+      struct PageTable
+      {
+        MemoryBlock* pages[1 << TableBits];
+      };
+
+      std::vector<std::unique_ptr<MemoryBlock>> blocks;
+      std::unique_ptr<PageTable> directory[1 << DirectoryBits];
+
+      // The block returned by the previous look-up.
+      MemoryBlock* last;
+
+      // Handles the look-up when the address is not in the last block.
+      MemoryBlock* find(std::uint32_t address);
+
+      friend class Checkpoint;
+
+      // Returns true if the value of type T at the address is aligned to its
+      // size and all in the block.
+      template<typename T>
+      static bool accessible(const MemoryBlock* block, std::uint32_t address)
+      {
+        return (address & (sizeof(T) - 1)) == 0 && block != nullptr &&
+               address + std::uint64_t(sizeof(T)) <= block->endAddress;
+      }
+
+      // Adds the block to the page table, and starts it with no dirty pages
+      // and no code.
+      //
+      // Throws std::invalid_argument if it overlaps any of the existing blocks.
+      MemoryBlock* insert(std::unique_ptr<MemoryBlock> block);
 
     public:
 
-      Memory(std::uint32_t start, std::uint32_t end);
+      // Raises the exception for an access of size bytes at the address which
+      // is misaligned or outside the memory.
+      [[noreturn]] static void fault(std::uint32_t address, unsigned int size,
+                                     MemoryAccess access);
+
+      Memory(std::uint32_t start, std::uint64_t end,
+             PageSize pageSize = PageSize::Normal);
+
+      // Creates a memory with the blocks and contents of the snapshot. It
+      // shares the pages of the snapshot until it writes to them.
+      explicit Memory(const MemorySnapshot& snapshot);
+
+      // Adds a block for the addresses start <= address < end, which must not
+      // overlap any of the existing blocks.
+      //
+      // Throws std::invalid_argument if it does.
+      MemoryBlock* add(std::uint32_t start, std::uint64_t end,
+                       PageSize pageSize = PageSize::Normal);
+
+      // Takes a snapshot of the contents of the memory, after which this
+      // shares its pages with the snapshot until it writes to them.
+      //
+      // Each snapshot is a new file, so this copies every page which holds
+      // data: those written since the memory was created, together with all
+      // of those in the file of the previous snapshot. The pages which were
+      // never written are left as holes, so the cost is that of the part of
+      // the memory in use rather than the size of the memory.
+      MemorySnapshot snapshot();
 
       // Return the block that contains the given address.
-      MemoryBlock* operator[](std::uint32_t address);
+      MemoryBlock* operator[](std::uint32_t address)
+      {
+        if (last && last->contains(address)) return last;
+        return find(address);
+      }
+
+      // Returns the value of type T at the address in the guest's byte order,
+      // which must be aligned to the size of T.
+      //
+      // Throws GuestException if it is misaligned or not all in one block.
+      template<typename T>
+      T load(std::uint32_t address)
+      {
+        const MemoryBlock* const block = (*this)[address];
+        if (!accessible<T>(block, address))
+        {
+          fault(address, sizeof(T), MemoryAccess::Load);
+        }
+        return block->load<T>(address);
+      }
+
+      // Writes the value of type T to the address in the guest's byte order,
+      // which must be aligned to the size of T.
+      //
+      // Returns true if it wrote over a page holding decoded instructions,
+      // which the caller must then invalidate.
+      //
+      // Throws GuestException if it is misaligned or not all in one block.
+      template<typename T>
+      bool store(std::uint32_t address, T value)
+      {
+        MemoryBlock* const block = (*this)[address];
+        if (!accessible<T>(block, address))
+        {
+          fault(address, sizeof(T), MemoryAccess::Store);
+        }
+        return block->store<T>(address, value);
+      }
+
+      // Return the block that contains the given address without remembering
+      // it for the next look-up, so unlike operator[] it may be called from
+      // several threads at once.
+      MemoryBlock* lookup(std::uint32_t address) const;
     };
   }
 }
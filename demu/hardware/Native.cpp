@@ -0,0 +1,210 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Native
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides running a program with the native code it was
+//                recompiled to ahead of time.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements loading the library and switching between its code
+//                and the instructions performed by the machine.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Native.hpp"
+
+#include "Machine.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#if DEMU_NATIVE
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+  // What the machine's half of the context points to while the native code
+  // runs.
+  struct NativeRun
+  {
+    dlx::hardware::DLXMachine* machine;
+
+    // An exception raised by an instruction called back from the native code,
+    // which is re-thrown once back out of it.
+    std::exception_ptr pending;
+  };
+}
+
+dlx::hardware::NativeCode::NativeCode(const char* filename)
+: library(nullptr),
+  runCode(nullptr),
+  imageHash(0),
+  ranges()
+{
+#if DEMU_NATIVE
+  library = dlopen(filename, RTLD_NOW | RTLD_LOCAL);
+  if (library == nullptr)
+  {
+    throw std::runtime_error(std::string("The library could not be loaded: ") +
+                             dlerror());
+  }
+
+  const auto version = static_cast<const std::uint32_t*>(
+    dlsym(library, "dlx_native_version"));
+  const auto hash = static_cast<const std::uint64_t*>(
+    dlsym(library, "dlx_native_hash"));
+  const auto code = static_cast<const std::uint32_t*>(
+    dlsym(library, "dlx_native_code"));
+  const auto codeCount = static_cast<const std::uint32_t*>(
+    dlsym(library, "dlx_native_code_count"));
+  runCode = reinterpret_cast<void (*)(NativeContext*)>(
+    dlsym(library, "dlx_native_run"));
+  if (version == nullptr || hash == nullptr || code == nullptr ||
+      codeCount == nullptr || runCode == nullptr ||
+      *version != NativeInterfaceVersion)
+  {
+    dlclose(library);
+    throw std::invalid_argument(
+      "The library was not recompiled for this version of demu.");
+  }
+
+  imageHash = *hash;
+  for (std::uint32_t i = 0; i < *codeCount; ++i)
+  {
+    ranges.emplace_back(code[2 * i], code[2 * i + 1]);
+  }
+  std::sort(ranges.begin(), ranges.end());
+#else
+  (void)filename;
+  throw std::runtime_error("Native code is not supported on this host.");
+#endif
+}
+
+dlx::hardware::NativeCode::~NativeCode()
+{
+#if DEMU_NATIVE
+  dlclose(library);
+#endif
+}
+
+bool dlx::hardware::NativeCode::covers(
+  std::uint32_t address, std::uint64_t endAddress) const
+{
+  // The last range starting before the end is the only one which can overlap
+  // it, as they don't overlap each other.
+  const auto after = std::upper_bound(
+    ranges.begin(), ranges.end(),
+    std::make_pair(static_cast<std::uint32_t>(
+                     std::min<std::uint64_t>(endAddress - 1, 0xFFFFFFFF)),
+                   std::uint32_t(0xFFFFFFFF)));
+  return after != ranges.begin() && std::prev(after)->second > address;
+}
+
+std::uint32_t dlx::hardware::NativeCode::execute(
+  NativeContext* context, std::uint32_t address)
+{
+  NativeRun* const run = static_cast<NativeRun*>(context->machine);
+  DLXMachine* const machine = run->machine;
+
+  // As with step(), the instruction is counted and the program counter moved
+  // past it before it is performed.
+  machine->programCounter.value = address + 4;
+  machine->instructionCount = context->instructionCount;
+  std::uint32_t stop = 0;
+  try
+  {
+    const DecodedInstruction* const instruction =
+      machine->decodeCache(machine->mem, address);
+    if (instruction == nullptr)
+    {
+      Memory::fault(address, 4, MemoryAccess::Fetch);
+    }
+    instruction->execute(machine, *instruction);
+  }
+  catch (...)
+  {
+    run->pending = std::current_exception();
+    stop = 1;
+  }
+
+  context->programCounter = machine->programCounter.value;
+  context->instructionCount = machine->instructionCount;
+  return stop | (machine->nativeModified ? 1 : 0);
+}
+
+const dlx::hardware::DecodedInstruction*
+dlx::hardware::RunNative(DLXMachine* machine)
+{
+  const NativeCode* const native = machine->native.get();
+  if (native == nullptr || machine->nativeModified || IsTracing() ||
+      machine->profile)
+  {
+    return RunBlocks(machine);
+  }
+
+  NativeRun run = { machine, nullptr };
+  NativeContext context = {};
+  context.registers = &machine->registers[0].value;
+  context.instructionLimit = machine->instructionLimit;
+  context.execute = NativeCode::execute;
+  context.machine = &run;
+  if (const MemoryBlock* const block =
+        machine->mem[machine->programCounter.value])
+  {
+    context.memoryStart = block->startAddress;
+    context.memorySize = block->endAddress - block->startAddress;
+    context.memory = block->storage.get();
+  }
+
+  for (;;)
+  {
+    if (machine->nativeModified) return RunBlocks(machine);
+
+    // The native code always leaves at least the last instruction before the
+    // limit to be performed here, so there is one to return.
+    context.programCounter = machine->programCounter.value;
+    context.instructionCount = machine->instructionCount;
+    native->runCode(&context);
+    machine->programCounter.value = context.programCounter;
+    machine->instructionCount = context.instructionCount;
+
+    if (run.pending)
+    {
+      std::exception_ptr exception = run.pending;
+      run.pending = nullptr;
+      std::rethrow_exception(exception);
+    }
+
+    // Perform the instruction the native code stopped at.
+    const DecodedInstruction* const instruction =
+      machine->decodeCache(machine->mem, machine->programCounter.value);
+    if (instruction == nullptr) return nullptr;
+
+    ++machine->instructionCount;
+    machine->programCounter.value += 4;
+    instruction->execute(machine, *instruction);
+
+    const auto operation = instruction->operation;
+    if (operation == operationIndex(0, 1) || operation == 17)
+    {
+      // Halt or trap.
+      machine->instructionRegister.value = instruction->word;
+      return instruction;
+    }
+
+    if (machine->instructionCount >= machine->instructionLimit)
+    {
+      return instruction;
+    }
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
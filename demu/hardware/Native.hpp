@@ -0,0 +1,132 @@
+#ifndef DLX_NATIVE_HPP_
+#define DLX_NATIVE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Native
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides running a program with the native code it was
+//                recompiled to ahead of time.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The recompiler turns the program into a shared library, see
+//                recompiler/Recompiler.hpp, which NativeCode loads. The code
+//                in the library only knows of the NativeContext, through which
+//                it reaches the registers and memory of the machine and calls
+//                back into the machine for any instruction it doesn't perform
+//                itself.
+//
+//                The library runs the program from the program counter until
+//                it reaches an address it has no code for, an instruction it
+//                leaves to the machine such as a trap or the instruction
+//                limit, and RunNative() then carries on from there by
+//                performing a single instruction.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Loading a library needs dlopen(), so is only available on POSIX hosts.
+#ifndef DEMU_NATIVE
+#if defined(__unix__) || defined(__APPLE__)
+#define DEMU_NATIVE 1
+#else
+#define DEMU_NATIVE 0
+#endif
+#endif
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+    struct DecodedInstruction;
+
+    // This is increased whenever the NativeContext or what a library exports
+    // changes, so a library recompiled for an older demu isn't loaded.
+    const std::uint32_t NativeInterfaceVersion = 1;
+
+    // The state shared by the machine and the code of a library. The
+    // recompiler writes the same structure into the source of each library.
+    struct NativeContext
+    {
+      std::int32_t* registers;
+      std::uint64_t instructionCount;
+      std::uint64_t instructionLimit;
+      std::uint32_t programCounter;
+
+      // The block of memory the program started in, from which the loads are
+      // read directly.
+      std::uint32_t memoryStart;
+      std::uint64_t memorySize;
+      const unsigned char* memory;
+
+      // Performs the instruction at the address, which the code has already
+      // counted, and updates programCounter and instructionCount.
+      //
+      // Returns non-zero if the code must stop, as the instruction raised an
+      // exception or wrote over the code.
+      std::uint32_t (*execute)(NativeContext* context, std::uint32_t address);
+      void* machine;
+    };
+
+    class NativeCode
+    {
+      void* library;
+      void (*runCode)(NativeContext* context);
+      std::uint64_t imageHash;
+
+      // The [start, end) of the runs of instructions the library has code for,
+      // in order.
+      std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+
+      // The function the library calls back for the instructions it doesn't
+      // perform itself, see NativeContext::execute.
+      static std::uint32_t execute(NativeContext* context,
+                                   std::uint32_t address);
+
+      friend const DecodedInstruction* RunNative(DLXMachine* machine);
+
+    public:
+      // Loads the library.
+      //
+      // Throws std::runtime_error if it can't be loaded, or
+      // std::invalid_argument if it wasn't made by the recompiler of this
+      // version of demu.
+      explicit NativeCode(const char* filename);
+      ~NativeCode();
+
+      // The hash of the image the library was recompiled from.
+      std::uint64_t ImageHash() const { return imageHash; }
+
+      const std::vector<std::pair<std::uint32_t, std::uint32_t>>&
+      Ranges() const { return ranges; }
+
+      // Returns true if any of [address, endAddress) has code in the library.
+      bool covers(std::uint32_t address, std::uint64_t endAddress) const;
+
+    private:
+      NativeCode(const NativeCode&);
+      NativeCode& operator=(const NativeCode&);
+    };
+
+    // Keep running the native code of the machine, and performing the
+    // instructions it has none for, until a halt or trap instruction has been
+    // performed or the program counter leaves memory.
+    //
+    // Without native code, or once the program has written over it, this
+    // runs as RunBlocks() does instead. So too while tracing or profiling, as
+    // the native code neither traces nor counts the instructions.
+    //
+    // Returns the instruction that it stopped on, or nullptr if the program
+    // counter is outside the addressable range.
+    const DecodedInstruction* RunNative(DLXMachine* machine);
+  }
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef DLX_OBSERVER_HPP_
+#define DLX_OBSERVER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Observer
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides watching each instruction the machine executes.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The models of the timing of the hardware, such as the
+//                pipeline, are observers which are told of each instruction
+//                once it has been performed.
+//
+//                While a machine has observers it executes the instructions
+//                one at a time with step(), whichever engine is asked for, so
+//                a machine without any runs at full speed.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    struct DecodedInstruction;
+
+    // An instruction which has been performed.
+    struct Execution
+    {
+      const DecodedInstruction* instruction;
+      std::uint32_t address;
+
+      // The program counter after the instruction, which is address + 4
+      // unless it branched or jumped.
+      std::uint32_t nextAddress;
+
+      // The address loaded from or stored to, or 0 if there is none.
+      std::uint32_t effectiveAddress;
+    };
+
+    class Observer
+    {
+    public:
+      virtual ~Observer() {}
+
+      virtual void executed(const Execution& execution) = 0;
+    };
+  }
+}
+
+#endif
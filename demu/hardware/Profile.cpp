@@ -0,0 +1,328 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Profile
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides counting of the instructions executed.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the look-up of the counts and the report.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Profile.hpp"
+
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#if DEMU_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  // The number of counts in a page, or 0 if the pages can't be checked.
+  std::uint64_t CountsPerPage()
+  {
+#if DEMU_MMAP
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    if (pageSize > 0) return pageSize / sizeof(std::uint64_t);
+#endif
+    return 0;
+  }
+
+  // Returns true if the page of counts has never been touched, so it is
+  // known to be all zero without reading it in.
+  bool Untouched(const std::uint64_t* counts)
+  {
+#if DEMU_MMAP
+    unsigned char resident = 0;
+    void* const page = const_cast<std::uint64_t*>(counts);
+    return mincore(page, 1, &resident) == 0 && (resident & 1) == 0;
+#else
+    (void)counts;
+    return false;
+#endif
+  }
+
+  // Writes the count along with it as a percentage of the total.
+  void WriteCount(std::ostream& output, std::uint64_t count,
+                  std::uint64_t total)
+  {
+    output << std::setw(12) << count << ' '
+           << std::setw(6) << std::fixed << std::setprecision(2)
+           << (total ? 100.0 * count / total : 0.0) << "%  ";
+  }
+}
+
+dlx::hardware::Profile::Profile()
+: regions(),
+  lastStart(0),
+  lastSize(0),
+  lastCounts(nullptr)
+{
+}
+
+void dlx::hardware::Profile::miss(Memory& memory, std::uint32_t address,
+                                  std::uint64_t change)
+{
+  const MemoryBlock* const block = memory[address];
+  if (block == nullptr) return;
+
+  const std::uint64_t size =
+    (block->endAddress - block->startAddress) / sizeof(std::uint32_t);
+
+  auto region = std::find_if(
+    regions.begin(), regions.end(),
+    [block](const Region& candidate) { return candidate.block == block; });
+  if (region == regions.end())
+  {
+    Region newRegion;
+    newRegion.block = block;
+    newRegion.counts = AllocatePages<std::uint64_t>(size);
+    regions.push_back(std::move(newRegion));
+    region = regions.end() - 1;
+  }
+
+  lastStart = block->startAddress;
+  lastSize = size * sizeof(std::uint32_t);
+  lastCounts = region->counts.get();
+
+  lastCounts[(address - lastStart) / sizeof(std::uint32_t)] += change;
+}
+
+template<typename Visit>
+void dlx::hardware::Profile::forEachExecuted(Visit visit) const
+{
+  std::vector<const Region*> ordered;
+  for (auto region = regions.begin(); region != regions.end(); ++region)
+  {
+    ordered.push_back(&*region);
+  }
+  std::sort(ordered.begin(), ordered.end(),
+            [](const Region* a, const Region* b)
+            { return a->block->startAddress < b->block->startAddress; });
+
+  // The instructions executed run on into the next block when it follows on
+  // straight after, and otherwise must have left off by the end.
+  const std::uint64_t perPage = CountsPerPage();
+  std::uint64_t executed = 0;
+  std::uint64_t previousEnd = 0;
+  for (auto region = ordered.begin(); region != ordered.end(); ++region)
+  {
+    const MemoryBlock* const block = (*region)->block;
+    const std::uint64_t* const counts = (*region)->counts.get();
+    const std::uint64_t size =
+      (block->endAddress - block->startAddress) / sizeof(std::uint32_t);
+    if (block->startAddress != previousEnd) executed = 0;
+    previousEnd = block->endAddress;
+
+    // The counts for the whole of a large block are mostly pages that have
+    // never been touched, so only those which are resident are looked at
+    // rather than reading them all in, unless they are part way through
+    // instructions that were executed.
+    const std::uint64_t step = perPage ? perPage : size;
+    for (std::uint64_t first = 0; first < size; first += step)
+    {
+      if (executed == 0 && step != size && Untouched(counts + first))
+      {
+        continue;
+      }
+
+      const std::uint64_t last = std::min(size, first + step);
+      for (std::uint64_t index = first; index < last; ++index)
+      {
+        executed += counts[index];
+        if (executed != 0)
+        {
+          visit(*block,
+                static_cast<std::uint32_t>(block->startAddress + index * 4),
+                executed);
+        }
+      }
+    }
+  }
+}
+
+std::uint64_t dlx::hardware::Profile::executed(std::uint32_t address) const
+{
+  std::uint64_t count = 0;
+  forEachExecuted(
+    [&](const MemoryBlock&, std::uint32_t at, std::uint64_t executed)
+    {
+      if (at == address) count = executed;
+    });
+  return count;
+}
+
+std::uint64_t dlx::hardware::Profile::executedOperation(
+  std::uint8_t operation) const
+{
+  std::uint64_t count = 0;
+  forEachExecuted(
+    [&](const MemoryBlock& block, std::uint32_t address,
+        std::uint64_t executed)
+    {
+      if (decode(block.load<std::uint32_t>(address)).operation == operation)
+      {
+        count += executed;
+      }
+    });
+  return count;
+}
+
+void dlx::hardware::Profile::report(std::ostream& output,
+                                    unsigned int hottest) const
+{
+  // The hottest addresses are kept in a heap with the least executed at the
+  // top, so it is the one replaced when a hotter one is found.
+  typedef std::pair<std::uint64_t, std::uint32_t> Hot;
+  std::vector<Hot> hot;
+  const auto hotter = [](const Hot& a, const Hot& b)
+  {
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+  };
+
+  // An instruction which doesn't transfer control is always followed by the
+  // one after it, so the pair is executed as often as the first of them.
+  // These are the candidates for fusing, see FusionPatterns.
+  std::map<std::pair<std::uint8_t, std::uint8_t>, std::uint64_t> pairs;
+
+  std::uint64_t total = 0;
+  std::uint64_t operations[OperationCount] = {};
+  forEachExecuted(
+    [&](const MemoryBlock& block, std::uint32_t address, std::uint64_t count)
+    {
+      const DecodedInstruction first =
+        decode(block.load<std::uint32_t>(address));
+      total += count;
+      operations[first.operation] += count;
+
+      const Hot candidate(count, address);
+      if (hot.size() < hottest)
+      {
+        hot.push_back(candidate);
+        std::push_heap(hot.begin(), hot.end(), hotter);
+      }
+      else if (hottest > 0 && hotter(candidate, hot.front()))
+      {
+        std::pop_heap(hot.begin(), hot.end(), hotter);
+        hot.back() = candidate;
+        std::push_heap(hot.begin(), hot.end(), hotter);
+      }
+
+      if (address + std::uint64_t(4) >= block.endAddress ||
+          isControlTransfer(first))
+      {
+        return;
+      }
+      const DecodedInstruction second =
+        decode(block.load<std::uint32_t>(address + 4));
+      pairs[std::make_pair(first.operation, second.operation)] += count;
+    });
+  std::sort_heap(hot.begin(), hot.end(), hotter);
+
+  const auto flags = output.flags();
+  const auto fill = output.fill();
+
+  output << "Hottest addresses of " << total << " instructions:\n"
+         << "  Address        Count  Percent  Instruction\n";
+  for (auto entry = hot.begin(); entry != hot.end(); ++entry)
+  {
+    const std::uint32_t address = entry->second;
+    output << "  " << std::hex << std::setfill('0') << std::setw(8)
+           << address << std::dec << std::setfill(' ') << ' ';
+    WriteCount(output, entry->first, total);
+
+    for (auto region = regions.begin(); region != regions.end(); ++region)
+    {
+      const MemoryBlock* const block = region->block;
+      if (!block->contains(address)) continue;
+
+      disassemble(output, decode(block->load<std::uint32_t>(address)));
+      break;
+    }
+    output << '\n';
+  }
+
+  // The operations are given by the opcode and modifier, which are the
+  // indices into Instructions and InstructionsFormatR.
+  std::vector<std::uint8_t> order;
+  for (unsigned int operation = 0; operation < OperationCount; ++operation)
+  {
+    if (operations[operation] != 0) order.push_back(operation);
+  }
+  std::stable_sort(
+    order.begin(), order.end(),
+    [&operations](std::uint8_t a, std::uint8_t b)
+    { return operations[a] > operations[b]; });
+
+  output << "Instruction mix:\n"
+         << "  Opcode  Modifier        Count  Percent  Instruction\n";
+  for (auto operation = order.begin(); operation != order.end(); ++operation)
+  {
+    const unsigned int opcode = (*operation < 64) ? *operation :
+                                (*operation < 128) ? 0 : 1;
+    output << "  " << std::setw(6) << opcode << "  " << std::setw(8);
+    if (*operation < 64) output << '-';
+    else output << (*operation % 64);
+    output << ' ';
+    WriteCount(output, operations[*operation], total);
+
+    const char* const name = mnemonic(*operation);
+    output << (name ? name : "unknown") << '\n';
+  }
+
+  typedef std::pair<std::uint64_t, std::pair<std::uint8_t, std::uint8_t>>
+    Pair;
+  std::vector<Pair> hotPairs;
+  for (auto pair = pairs.begin(); pair != pairs.end(); ++pair)
+  {
+    hotPairs.push_back(Pair(pair->second, pair->first));
+  }
+  std::stable_sort(
+    hotPairs.begin(), hotPairs.end(),
+    [](const Pair& a, const Pair& b) { return a.first > b.first; });
+  if (hotPairs.size() > hottest) hotPairs.resize(hottest);
+
+  output << "Hottest pairs:\n"
+         << "         Count  Percent  Instructions     Fused as\n";
+  for (auto pair = hotPairs.begin(); pair != hotPairs.end(); ++pair)
+  {
+    output << "  ";
+    WriteCount(output, pair->first, total);
+
+    const char* const first = mnemonic(pair->second.first);
+    const char* const second = mnemonic(pair->second.second);
+    const std::string names = std::string(first ? first : "unknown") +
+                              ", " + (second ? second : "unknown");
+    output << std::left << std::setw(17) << names << std::right;
+
+    const char* fused = "-";
+    for (unsigned int fusion = 0; fusion < FusionCount; ++fusion)
+    {
+      const FusionPattern& pattern = FusionPatterns[fusion];
+      if (pattern.operations[0] == pair->second.first &&
+          pattern.operations[1] == pair->second.second)
+      {
+        fused = pattern.name;
+        break;
+      }
+    }
+    output << fused << '\n';
+  }
+
+  output.flags(flags);
+  output.fill(fill);
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,123 @@
+#ifndef DLX_PROFILE_HPP_
+#define DLX_PROFILE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Profile
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides counting of the instructions executed.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Counts how many times the instruction at each address has
+//                been executed and how many times each operation has been.
+//
+//                Rather than counting each instruction, the engines tell the
+//                profile where each run of instructions executed one after
+//                the other starts and where it leaves off, which is only at
+//                the jumps and branches taken and where the engine stops. The
+//                start adds one to the address and where it leaves off takes
+//                one away, so the count for an address is the sum of those
+//                for it and the addresses before it.
+//
+//                These are kept in a flat array for each memory block indexed
+//                by (address - startAddress) / 4, in the same way as the
+//                DecodeCache. The operations are counted from the
+//                instructions in memory when the counts are read, so the code
+//                is assumed not to have changed since it was executed.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Decoder.hpp"
+#include "Memory.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class Profile
+    {
+      struct Region
+      {
+        const MemoryBlock* block;
+        // This is reserved for the whole block but only committed for the
+        // pages of counts which are used.
+        std::unique_ptr<std::uint64_t[], PageDeleter> counts;
+      };
+
+      std::vector<Region> regions;
+
+      // The region used by the previous change.
+      std::uint32_t lastStart;
+      std::uint64_t lastSize;
+      std::uint64_t* lastCounts;
+
+      // Adds to the count for the address, which wraps around to take away.
+      void add(Memory& memory, std::uint32_t address, std::uint64_t change)
+      {
+        const std::uint32_t offset = address - lastStart;
+        if (offset < lastSize)
+        {
+          lastCounts[offset / sizeof(std::uint32_t)] += change;
+        }
+        else
+        {
+          miss(memory, address, change);
+        }
+      }
+
+      // Handles the change when the address is not in the last region.
+      void miss(Memory& memory, std::uint32_t address, std::uint64_t change);
+
+      // Calls visit(block, address, count) for each address executed, in
+      // order of address.
+      template<typename Visit>
+      void forEachExecuted(Visit visit) const;
+
+    public:
+      Profile();
+
+      // Count the instructions from the given address on as executed, up to
+      // the address given to leave() after them.
+      void enter(Memory& memory, std::uint32_t address)
+      {
+        add(memory, address, 1);
+      }
+
+      // Stop counting the instructions as executed from the given address on,
+      // which is the one after the last executed.
+      void leave(Memory& memory, std::uint32_t address)
+      {
+        add(memory, address, ~std::uint64_t(0));
+      }
+
+      // Count the instruction at the given address as executed.
+      void count(Memory& memory, std::uint32_t address)
+      {
+        enter(memory, address);
+        leave(memory, address + 4);
+      }
+
+      // Returns the number of times the instruction at the given address has
+      // been executed.
+      std::uint64_t executed(std::uint32_t address) const;
+
+      // Returns the number of times the operation has been executed, see
+      // operationIndex().
+      std::uint64_t executedOperation(std::uint8_t operation) const;
+
+      // Writes the given number of the most executed addresses, followed by
+      // the number of times each operation was executed and the given number
+      // of the most executed pairs of operations, with the fusion for each.
+      void report(std::ostream& output, unsigned int hottest) const;
+    };
+  }
+}
+
+#endif
@@ -30,8 +30,8 @@ namespace dlx
 		  Register& operator=(std::int32_t new_value)
 		  { value = new_value; return *this; }
 
-		  Register& operator=(const Register& that)
-		  { value = that.value; return *this; }
+		  Register(const Register& that) = default;
+		  Register& operator=(const Register& that) = default;
 
 		  std::int32_t value;
 		};
@@ -0,0 +1,198 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Replay
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides recording the input a program reads from the host
+//                and replaying it in a later run.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements reading the host's input and encoding the log.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+  const unsigned char LogMagic[4] = { 'D', 'L', 'X', 'R' };
+  const unsigned char LogVersion = 1;
+
+  // The jobs of a batch run on many threads, which take turns at reading the
+  // console.
+  std::mutex consoleMutex;
+
+  std::string Diverged(std::uint64_t instructionCount, const char* reason)
+  {
+    std::ostringstream message;
+    message << "The replay has diverged from the recording at instruction "
+            << instructionCount << " as " << reason << ".";
+    return message.str();
+  }
+}
+
+std::int32_t dlx::hardware::ReadHostInput(InputKind kind)
+{
+  switch (kind)
+  {
+    case InputKind::Console:
+    {
+      std::lock_guard<std::mutex> lock(consoleMutex);
+      const std::istream::int_type character = std::cin.get();
+      return (character == std::istream::traits_type::eof()) ?
+        -1 : static_cast<std::int32_t>(character);
+    }
+    case InputKind::Clock:
+      return static_cast<std::int32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+  return 0;
+}
+
+dlx::hardware::InputLog::InputLog(const char* filename, Mode mode)
+: logMode(mode),
+  output(),
+  contents(),
+  position(0),
+  previous(0),
+  previousValues(),
+  events(0)
+{
+  if (mode == Mode::Record)
+  {
+    output.open(filename, std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(LogMagic), sizeof(LogMagic));
+    output.put(static_cast<char>(LogVersion));
+    if (!output)
+    {
+      throw std::runtime_error("The input log could not be created.");
+    }
+    return;
+  }
+
+  std::ifstream input(filename, std::ios::binary);
+  if (!input.is_open())
+  {
+    throw std::runtime_error("The input log could not be read.");
+  }
+  contents.assign(std::istreambuf_iterator<char>(input),
+                  std::istreambuf_iterator<char>());
+
+  if (contents.size() < sizeof(LogMagic) + 1 ||
+      !std::equal(LogMagic, LogMagic + sizeof(LogMagic), contents.begin()))
+  {
+    throw std::invalid_argument("The file is not an input log.");
+  }
+  if (contents[sizeof(LogMagic)] != LogVersion)
+  {
+    throw std::invalid_argument(
+      "The version of the input log is not supported.");
+  }
+  position = sizeof(LogMagic) + 1;
+}
+
+void dlx::hardware::InputLog::record(
+  std::uint64_t instructionCount, InputKind kind, std::int32_t value)
+{
+  const auto write = [this](std::uint64_t number)
+    {
+      while (number >= 0x80)
+      {
+        output.put(static_cast<char>((number & 0x7F) | 0x80));
+        number >>= 7;
+      }
+      output.put(static_cast<char>(number));
+    };
+
+  std::int32_t& previousValue =
+    previousValues[static_cast<std::size_t>(kind) % 3];
+  const std::int32_t difference = static_cast<std::int32_t>(
+    static_cast<std::uint32_t>(value) -
+    static_cast<std::uint32_t>(previousValue));
+  const std::uint32_t zigzag =
+    (static_cast<std::uint32_t>(difference) << 1) ^
+    static_cast<std::uint32_t>(difference >> 31);
+  previousValue = value;
+
+  write(instructionCount - previous);
+  output.put(static_cast<char>(kind));
+  write(zigzag);
+  if (!output)
+  {
+    throw std::runtime_error("The input log could not be written.");
+  }
+
+  previous = instructionCount;
+  ++events;
+}
+
+std::int32_t dlx::hardware::InputLog::replay(
+  std::uint64_t instructionCount, InputKind kind)
+{
+  if (AtEnd())
+  {
+    throw std::runtime_error(
+      Diverged(instructionCount, "there are no more inputs recorded"));
+  }
+
+  const auto read = [this](std::uint64_t* number)
+    {
+      *number = 0;
+      for (unsigned int shift = 0; position < contents.size() && shift < 64;
+           shift += 7)
+      {
+        const unsigned char byte = contents[position++];
+        *number |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+      }
+      return false;
+    };
+
+  std::uint64_t delta;
+  std::uint64_t zigzag;
+  if (!read(&delta) || position == contents.size())
+  {
+    throw std::runtime_error("The input log ends part way through.");
+  }
+  const InputKind recordedKind = static_cast<InputKind>(contents[position++]);
+  if (!read(&zigzag))
+  {
+    throw std::runtime_error("The input log ends part way through.");
+  }
+
+  if (previous + delta != instructionCount)
+  {
+    throw std::runtime_error(Diverged(
+      instructionCount, "the next input was recorded at another instruction"));
+  }
+  if (recordedKind != kind)
+  {
+    throw std::runtime_error(Diverged(
+      instructionCount, "the input recorded there is of another kind"));
+  }
+
+  const std::uint32_t encoded = static_cast<std::uint32_t>(zigzag);
+  const std::uint32_t difference = (encoded >> 1) ^ (0u - (encoded & 1));
+  std::int32_t& previousValue =
+    previousValues[static_cast<std::size_t>(kind) % 3];
+  previousValue = static_cast<std::int32_t>(
+    static_cast<std::uint32_t>(previousValue) + difference);
+
+  previous = instructionCount;
+  ++events;
+  return previousValue;
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,108 @@
+#ifndef DLX_REPLAY_HPP_
+#define DLX_REPLAY_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Replay
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides recording the input a program reads from the host
+//                and replaying it in a later run.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Everything else a program does is determined by its memory
+//                and registers, so a run can be repeated exactly by giving it
+//                the same input at the same instructions. The machine reads
+//                each input through DLXMachine::input(), which is the only
+//                place the log is touched, so recording costs nothing while
+//                no input is read.
+//
+//                The log starts with "DLXR" and the version, followed by an
+//                entry for each input of the number of instructions since the
+//                previous one, the kind and the difference from the previous
+//                value of that kind. The numbers are written seven bits to a
+//                byte with the top bit set on all but the last byte, and the
+//                difference is zig-zag encoded so small negative numbers are
+//                small too, which makes most entries three or four bytes.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    // The input which can differ from one run of a program to the next.
+    enum class InputKind : std::uint8_t
+    {
+      Console = 1, // A byte read from the console by trap 1, or -1.
+      Clock = 2,   // The host's clock in microseconds, read by trap 3.
+    };
+
+    // Returns the input of the kind from the host.
+    std::int32_t ReadHostInput(InputKind kind);
+
+    class InputLog
+    {
+    public:
+      enum class Mode
+      {
+        Record, // Log the input the host gives.
+        Replay, // Give the input from the log instead of the host.
+      };
+
+    private:
+      Mode logMode;
+      std::ofstream output;
+      std::vector<unsigned char> contents;
+      std::size_t position;
+
+      // The instruction count of the previous entry, and the previous value
+      // of each kind.
+      std::uint64_t previous;
+      std::int32_t previousValues[3];
+      std::uint64_t events;
+
+    public:
+      // Creates the log to record to, replacing any file of that name, or
+      // reads the log to replay.
+      //
+      // Throws std::runtime_error if the file can't be written or read, or
+      // std::invalid_argument if it isn't a log.
+      InputLog(const char* filename, Mode mode);
+
+      Mode mode() const { return logMode; }
+
+      // Adds the input read by the instruction with the given count, which
+      // is at least that of the input before it.
+      //
+      // Throws std::runtime_error if it can't be written.
+      void record(std::uint64_t instructionCount, InputKind kind,
+                  std::int32_t value);
+
+      // Returns the input logged for the instruction with the given count.
+      //
+      // Throws std::runtime_error if the next input in the log is for
+      // another instruction or of another kind, as the run has diverged from
+      // the one recorded, or if there are none left.
+      std::int32_t replay(std::uint64_t instructionCount, InputKind kind);
+
+      // The number of inputs recorded or replayed so far.
+      std::uint64_t Events() const { return events; }
+
+      // Returns true if every input in the log being replayed has been.
+      bool AtEnd() const { return position == contents.size(); }
+
+    private:
+      InputLog(const InputLog&);
+      InputLog& operator=(const InputLog&);
+    };
+  }
+}
+
+#endif
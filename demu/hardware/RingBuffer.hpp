@@ -0,0 +1,119 @@
+#ifndef DLX_RING_BUFFER_HPP_
+#define DLX_RING_BUFFER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : RingBuffer
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides a queue between a single producer and consumer.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The producer only writes the tail and the consumer only
+//                writes the head, so neither needs a lock. Each keeps its own
+//                copy of the other's index and only reads the shared one when
+//                that copy says the buffer is full or empty.
+//
+//                The capacity is a power of two so the indices can keep
+//                counting up and are reduced to a position with a mask.
+//
+//===----------------------------------------------------------------------===//
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    template<typename T>
+    class RingBuffer
+    {
+      // The indices are padded out to keep them on separate cache lines, so
+      // the producer and consumer don't keep taking the line from each other.
+      struct Index
+      {
+        std::atomic<std::size_t> value;
+        std::size_t cached; // The other side's index, as last read.
+        char padding[64];
+      };
+
+      const std::size_t mask;
+      const std::unique_ptr<T[]> items;
+      Index head; // The next item to be read.
+      Index tail; // The next item to be written.
+
+    public:
+      // Throws std::invalid_argument if capacity isn't a power of two.
+      explicit RingBuffer(std::size_t capacity)
+      : mask(capacity - 1),
+        items(new T[capacity])
+      {
+        if (capacity == 0 || (capacity & mask) != 0)
+        {
+          throw std::invalid_argument(
+            "The capacity of a ring buffer must be a power of two.");
+        }
+
+        head.value = 0;
+        head.cached = 0;
+        tail.value = 0;
+        tail.cached = 0;
+      }
+
+      std::size_t capacity() const { return mask + 1; }
+
+      // Adds the item to the end, returning false if the buffer is full.
+      //
+      // This must only be called by the producer.
+      bool push(const T& item)
+      {
+        const std::size_t position =
+          tail.value.load(std::memory_order_relaxed);
+        if (position - tail.cached == capacity())
+        {
+          tail.cached = head.value.load(std::memory_order_acquire);
+          if (position - tail.cached == capacity()) return false;
+        }
+
+        items[position & mask] = item;
+        tail.value.store(position + 1, std::memory_order_release);
+        return true;
+      }
+
+      // Returns the number of items which can be read from data without
+      // wrapping around, which is 0 if the buffer is empty.
+      //
+      // This must only be called by the consumer.
+      std::size_t peek(const T** data)
+      {
+        const std::size_t position =
+          head.value.load(std::memory_order_relaxed);
+        if (position == head.cached)
+        {
+          head.cached = tail.value.load(std::memory_order_acquire);
+        }
+
+        const std::size_t available = head.cached - position;
+        const std::size_t untilEnd = capacity() - (position & mask);
+        *data = &items[position & mask];
+        return (available < untilEnd) ? available : untilEnd;
+      }
+
+      // Removes the given number of items from the front, which must have
+      // been returned by peek().
+      //
+      // This must only be called by the consumer.
+      void consume(std::size_t count)
+      {
+        head.value.store(head.value.load(std::memory_order_relaxed) + count,
+                         std::memory_order_release);
+      }
+    };
+  }
+}
+
+#endif
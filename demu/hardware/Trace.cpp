@@ -0,0 +1,250 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Trace
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides tracing of the instructions as they are executed.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the text and binary traces.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Trace.hpp"
+
+#include "Decoder.hpp"
+#include "Machine.hpp"
+#include "TraceWriter.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+
+dlx::hardware::TraceLevel dlx::hardware::traceLevel =
+  dlx::hardware::TraceLevel::Off;
+std::ostream* dlx::hardware::traceOutput = &std::cout;
+
+namespace
+{
+  // The record of the instruction being traced.
+  dlx::hardware::TraceRecord record;
+
+  // The writer of the binary trace, while it is on.
+  std::unique_ptr<dlx::hardware::TraceWriter> writer;
+  std::uint64_t dropped = 0;
+}
+
+void dlx::hardware::SetTrace(TraceLevel level, std::ostream* output,
+                             TraceOverflow overflow)
+{
+  StopTrace();
+  traceLevel = level;
+  traceOutput = output;
+  if (std::is_same<TraceSink, BinaryTraceSink>::value &&
+      level != TraceLevel::Off)
+  {
+    writer.reset(new TraceWriter(output, overflow));
+  }
+}
+
+void dlx::hardware::StopTrace()
+{
+  traceLevel = TraceLevel::Off;
+  if (writer)
+  {
+    dropped += writer->droppedCount();
+    writer.reset();
+  }
+}
+
+std::uint64_t dlx::hardware::DroppedTraceRecords()
+{
+  return dropped + (writer ? writer->droppedCount() : 0);
+}
+
+void dlx::hardware::BeginTraceRecord(const DLXMachine& machine,
+                                     std::uint32_t address,
+                                     const DecodedInstruction& instruction)
+{
+  record.address = address;
+  record.word = instruction.word;
+  record.result = 0;
+  record.effectiveAddress = 0;
+
+  // The base register may be the one loaded into, so this is worked out
+  // before the instruction is performed.
+  if (isLoad(instruction) || isStore(instruction))
+  {
+    record.effectiveAddress =
+      machine.ConstRegisters()[instruction.ri].value + instruction.immediate;
+  }
+}
+
+void dlx::hardware::EndTraceRecord(const DLXMachine& machine,
+                                   const DecodedInstruction& instruction)
+{
+  record.result = machine.ConstRegisters()[destinationRegister(instruction)].value;
+  TraceSink::instruction(record, instruction);
+}
+
+const char* dlx::hardware::mnemonic(std::uint8_t operation)
+{
+  // Indexed by the operation index, so the opcodes come first followed by
+  // the modifiers of opcode 0 and then of opcode 1.
+  static const char* const names[OperationCount] = {
+    nullptr, nullptr, "j", "jal", "beqz", "bnez", "bfpt", "bfpf",
+    "addi", "addui", "subi", "subui", "andi", "ori", "xori", "lhi",
+    "rfe", "trap", "jr", "jalr", "slli", nullptr, "srli", "srai",
+    "seqi", "snei", "slti", "sgti", "slei", "sgei", nullptr, nullptr,
+    "lb", "lh", nullptr, "lw", "lbu", "lhu", "lf", "ld",
+    "sb", "sh", nullptr, "sw", nullptr, nullptr, "sf", "sd",
+    "sequi", "sneui", "sltui", "sgtui", "sleui", "sgeui", nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+
+    "nop", "halt", "wait", nullptr, "sll", nullptr, "srl", "sra",
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    "sequ", "sneu", "sltu", "sgtu", "sleu", "sgeu", nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    "add", "addu", "sub", "subu", "and", "or", "xor", nullptr,
+    "seq", "sne", "slt", "sgt", "sle", "sge", nullptr, nullptr,
+    "movi2s", "movs2i", "movf", "movd", "movfp2i", "movi2fp", nullptr, nullptr,
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+
+    "addf", "subf", "multf", "divf", "addd", "subd", "multd", "divd",
+    "cvtf2d", "cvtf2i", "cvtd2f", "cvtd2i", "cvti2f", "cvti2d", "mult", "div",
+    "eqf", "nef", "ltf", "gtf", "lef", "gef", "multu", "divu",
+    "eqd", "ned", "ltd", "gtd", "led", "ged",
+  };
+
+  return (operation < OperationCount) ? names[operation] : nullptr;
+}
+
+void dlx::hardware::TextTraceSink::instruction(
+  const TraceRecord& record, const DecodedInstruction& instruction)
+{
+  write(*traceOutput, record, instruction);
+}
+
+void dlx::hardware::disassemble(std::ostream& output,
+                                const DecodedInstruction& instruction)
+{
+  const char* const name = mnemonic(instruction.operation);
+  const unsigned int ri = instruction.ri;
+  const unsigned int rj = instruction.rj;
+  const unsigned int rk = instruction.rk;
+  const auto immediate = instruction.immediate;
+  const auto operation = instruction.operation;
+
+  // The floating point instructions, other than the integer multiply and
+  // divide which share their opcode. Those with two operands take fj.
+  const bool isFloatingPoint =
+    (operation >= 114 && operation <= 117) ||
+    (operation >= 128 && operation != 142 && operation != 143 &&
+     operation != 150 && operation != 151);
+
+  if (name == nullptr)
+  {
+    output << "unknown";
+  }
+  else if (isFloatingPoint && operation <= 135)
+  {
+    // The moves and the arithmetic.
+    output << name << ' ' << (operation == 116 ? 'r' : 'f') << rk << ", ";
+    if (operation >= 128) output << 'f' << ri << ", ";
+    output << (operation == 117 ? 'r' : 'f') << rj;
+  }
+  else if (isFloatingPoint && operation <= 141)
+  {
+    output << name << " f" << rk << ", f" << rj; // The conversions.
+  }
+  else if (isFloatingPoint)
+  {
+    output << name << " f" << ri << ", f" << rj; // The compares.
+  }
+  else if (operation == 38 || operation == 39)
+  {
+    output << name << " f" << rj << ", " << immediate << "(r" << ri << ')';
+  }
+  else if (operation == 46 || operation == 47)
+  {
+    output << name << ' ' << immediate << "(r" << ri << "), f" << rj;
+  }
+  else if (instruction.operation >= 64)
+  {
+    // Only nop, halt and wait have no operands.
+    output << name;
+    if (instruction.modifier > 2)
+    {
+      output << " r" << rk << ", r" << ri << ", r" << rj;
+    }
+  }
+  else if (instruction.operation == 2 || instruction.operation == 3 ||
+           instruction.operation == 6 || instruction.operation == 7 ||
+           instruction.operation == 16 || instruction.operation == 17)
+  {
+    output << name << ' ' << immediate;
+  }
+  else if (instruction.operation == 4 || instruction.operation == 5)
+  {
+    output << name << " r" << ri << ", " << immediate;
+  }
+  else if (instruction.operation == 18 || instruction.operation == 19)
+  {
+    output << name << " r" << ri;
+  }
+  else if (instruction.operation == 15)
+  {
+    output << name << " r" << rj << ", " << immediate;
+  }
+  else if (isStore(instruction))
+  {
+    output << name << ' ' << immediate << "(r" << ri << "), r" << rj;
+  }
+  else if (isLoad(instruction))
+  {
+    output << name << " r" << rj << ", " << immediate << "(r" << ri << ')';
+  }
+  else
+  {
+    output << name << " r" << rj << ", r" << ri << ", " << immediate;
+  }
+}
+
+void dlx::hardware::TextTraceSink::write(
+  std::ostream& output, const TraceRecord& record,
+  const DecodedInstruction& instruction)
+{
+  const auto flags = output.flags();
+  const auto fill = output.fill();
+  output << std::hex << std::setfill('0')
+         << std::setw(8) << record.address << ": "
+         << std::setw(8) << record.word << "  " << std::dec;
+  disassemble(output, instruction);
+
+  const unsigned int target = destinationRegister(instruction);
+  if (target != 0)
+  {
+    output << "  r" << target << '='
+           << static_cast<std::int32_t>(record.result);
+  }
+  if (isLoad(instruction) || isStore(instruction))
+  {
+    output << "  [" << std::hex << std::setw(8) << record.effectiveAddress
+           << ']';
+  }
+
+  output << '\n';
+  output.flags(flags);
+  output.fill(fill);
+}
+
+void dlx::hardware::BinaryTraceSink::instruction(
+  const TraceRecord& record, const DecodedInstruction&)
+{
+  writer->write(record);
+}
+
+//===--------------------------- End of the file --------------------------===//
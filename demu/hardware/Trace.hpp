@@ -0,0 +1,170 @@
+#ifndef DLX_TRACE_HPP_
+#define DLX_TRACE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Trace
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides tracing of the instructions as they are executed.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Where the trace goes is chosen when demu is built with
+//                DEMU_TRACE, as one of:
+//
+//                  0 None, the tracing compiles away to nothing (default).
+//                  1 Text, a line per instruction with its disassembly.
+//                  2 Binary, a TraceRecord per instruction, written on a
+//                    thread of its own by a TraceWriter.
+//
+//                In a build with tracing, it is switched on and off while
+//                running with SetTrace().
+//
+//                Each instruction is traced once it has been performed, as
+//                the record includes the value it wrote to a register.
+//
+//                Only the interpreter and translated blocks trace, so the
+//                native code of the JIT and the vectors of the lockstep
+//                engine are not used while tracing.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstdint>
+#include <iosfwd>
+
+#ifndef DEMU_TRACE
+#define DEMU_TRACE 0
+#endif
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+    struct DecodedInstruction;
+
+    enum class TraceLevel
+    {
+      Off,
+      Instructions, // Each instruction as it is performed.
+    };
+
+    // What the binary trace does when it can't keep up with the machine.
+    enum class TraceOverflow
+    {
+      Wait, // The machine waits for the records to be written.
+      Drop, // The records are dropped, see DroppedTraceRecords().
+    };
+
+    // The record of each instruction, which the binary trace writes in host
+    // byte order.
+    struct TraceRecord
+    {
+      std::uint32_t address;
+      std::uint32_t word;
+
+      // The value written to the destination register, or 0 if there is none.
+      std::uint32_t result;
+
+      // The address loaded from or stored to, or 0 if there is none.
+      std::uint32_t effectiveAddress;
+    };
+
+    struct NullTraceSink
+    {
+      static const bool Enabled = false;
+
+      static void instruction(const TraceRecord&, const DecodedInstruction&)
+      {
+      }
+    };
+
+    struct TextTraceSink
+    {
+      static const bool Enabled = true;
+
+      // Writes a line for the instruction to the trace output.
+      static void instruction(const TraceRecord& record,
+                              const DecodedInstruction& instruction);
+
+      static void write(std::ostream& output, const TraceRecord& record,
+                        const DecodedInstruction& instruction);
+    };
+
+    struct BinaryTraceSink
+    {
+      static const bool Enabled = true;
+
+      // Adds the record to the trace writer.
+      static void instruction(const TraceRecord& record,
+                              const DecodedInstruction& instruction);
+    };
+
+#if DEMU_TRACE == 2
+    typedef BinaryTraceSink TraceSink;
+#elif DEMU_TRACE == 1
+    typedef TextTraceSink TraceSink;
+#else
+    typedef NullTraceSink TraceSink;
+#endif
+
+    // The current level and where the trace is written, which are only used
+    // when built with tracing.
+    extern TraceLevel traceLevel;
+    extern std::ostream* traceOutput;
+
+    // Starts writing the trace at the given level to output, which must stay
+    // open until the trace is switched off.
+    //
+    // The trace is not synchronised, so only a single machine should be run
+    // at a time while it is on.
+    void SetTrace(TraceLevel level, std::ostream* output,
+                  TraceOverflow overflow = TraceOverflow::Wait);
+
+    // Switches off the trace, waiting for the binary trace to be written.
+    void StopTrace();
+
+    // Returns the number of records the binary trace has dropped.
+    std::uint64_t DroppedTraceRecords();
+
+    // Starts and finishes the record of the instruction, see below.
+    void BeginTraceRecord(const DLXMachine& machine, std::uint32_t address,
+                          const DecodedInstruction& instruction);
+    void EndTraceRecord(const DLXMachine& machine,
+                        const DecodedInstruction& instruction);
+
+    // Returns true if the instructions are to be traced, which is always
+    // false when built without tracing.
+    inline bool IsTracing()
+    {
+      return TraceSink::Enabled && traceLevel != TraceLevel::Off;
+    }
+
+    // Traces the instruction at the given address, which is about to be
+    // performed. This must be followed by TraceResult() once it has been.
+    inline void TraceInstruction(const DLXMachine& machine,
+                                 std::uint32_t address,
+                                 const DecodedInstruction& instruction)
+    {
+      if (IsTracing()) BeginTraceRecord(machine, address, instruction);
+    }
+
+    // Traces the result of the instruction which has just been performed.
+    inline void TraceResult(const DLXMachine& machine,
+                            const DecodedInstruction& instruction)
+    {
+      if (IsTracing()) EndTraceRecord(machine, instruction);
+    }
+
+    // Returns the name of the instruction with the given operation index, see
+    // operationIndex(), or nullptr if there is none.
+    const char* mnemonic(std::uint8_t operation);
+
+    // Writes the instruction in assembly, such as "addi r1, r2, 3".
+    void disassemble(std::ostream& output,
+                     const DecodedInstruction& instruction);
+  }
+}
+
+#endif
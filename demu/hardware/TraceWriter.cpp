@@ -0,0 +1,70 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : TraceWriter
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides writing of the binary trace on its own thread.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the thread which drains the buffer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TraceWriter.hpp"
+
+#include <chrono>
+#include <ostream>
+
+dlx::hardware::TraceWriter::TraceWriter(std::ostream* output,
+                                        TraceOverflow overflow)
+: buffer(Capacity),
+  output(output),
+  overflow(overflow),
+  dropped(0),
+  stopping(false),
+  thread(&TraceWriter::drain, this)
+{
+}
+
+dlx::hardware::TraceWriter::~TraceWriter()
+{
+  stopping = true;
+  thread.join();
+}
+
+void dlx::hardware::TraceWriter::drain()
+{
+  for (;;)
+  {
+    // Read this first, so once it is set the buffer is emptied at least
+    // once more after the last record was added.
+    const bool last = stopping;
+
+    const TraceRecord* records;
+    std::size_t count = buffer.peek(&records);
+
+    // Give the machine time to fill up a chunk rather than writing each few
+    // records as they arrive.
+    if (count < ChunkSize && !last)
+    {
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+      count = buffer.peek(&records);
+    }
+
+    if (count > 0)
+    {
+      output->write(reinterpret_cast<const char*>(records),
+                    count * sizeof(TraceRecord));
+      buffer.consume(count);
+    }
+    else if (last)
+    {
+      output->flush();
+      return;
+    }
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,85 @@
+#ifndef DLX_TRACE_WRITER_HPP_
+#define DLX_TRACE_WRITER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : TraceWriter
+// NAMESPACE    : dlx::hardware
+// PURPOSE      : Provides writing of the binary trace on its own thread.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The machine adds the records to a ring buffer, which a thread
+//                drains to the output in large writes so the machine never
+//                waits on the file.
+//
+//                If the thread falls behind and the buffer fills up, the
+//                machine either waits for there to be room or drops the
+//                record and counts it, depending on the TraceOverflow.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RingBuffer.hpp"
+#include "Trace.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <thread>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class TraceWriter
+    {
+      RingBuffer<TraceRecord> buffer;
+      std::ostream* output;
+      const TraceOverflow overflow;
+      std::uint64_t dropped;
+      std::atomic<bool> stopping;
+      std::thread thread;
+
+      // Writes the records to the output until stopped.
+      void drain();
+
+    public:
+      // The number of records in the buffer, which is 8 MiB of them.
+      static const std::size_t Capacity = 1 << 19;
+
+      // The writes are this many records at least, unless the machine is
+      // producing them slower than that.
+      static const std::size_t ChunkSize = 1 << 12;
+
+      // Starts the thread writing to output, which must stay open until the
+      // writer is destroyed.
+      TraceWriter(std::ostream* output, TraceOverflow overflow);
+
+      // Writes the records remaining in the buffer and stops the thread.
+      ~TraceWriter();
+
+      // Adds the record to the buffer.
+      //
+      // This must only be called from a single thread.
+      void write(const TraceRecord& record)
+      {
+        if (buffer.push(record)) return;
+
+        if (overflow == TraceOverflow::Drop)
+        {
+          ++dropped;
+          return;
+        }
+
+        while (!buffer.push(record)) std::this_thread::yield();
+      }
+
+      // Returns the number of records which were dropped as the buffer was
+      // full.
+      std::uint64_t droppedCount() const { return dropped; }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,410 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Absolute
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides loading programs from the .abs text format.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements splitting the text into chunks and decoding the
+//                lines of each.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Absolute.hpp"
+
+#include "../hardware/Machine.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if DEMU_SIMD_HEX
+#include <tmmintrin.h>
+#endif
+
+namespace
+{
+  using dlx::hardware::Memory;
+  using dlx::hardware::MemoryBlock;
+
+  // The value of each character as a hexadecimal digit, or -1 if it isn't
+  // one.
+  struct HexDigits
+  {
+    signed char values[256];
+
+    HexDigits()
+    {
+      std::fill(values, values + 256, -1);
+      for (int i = 0; i < 10; ++i) values['0' + i] = i;
+      for (int i = 0; i < 6; ++i) values['A' + i] = values['a' + i] = 10 + i;
+    }
+  };
+
+  const HexDigits hexDigits;
+
+  // The lines are split at '\n', so it is not white-space within a line.
+  bool IsSpace(unsigned char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  // Reads up to 8 hexadecimal digits, returning the character after them or
+  // nullptr if there are none.
+  const unsigned char* ReadAddress(const unsigned char* text,
+                                   const unsigned char* end,
+                                   std::uint32_t* address)
+  {
+    const unsigned char* const start = text;
+    *address = 0;
+    while (text != end && text - start < 8 && hexDigits.values[*text] >= 0)
+    {
+      *address = (*address << 4) | hexDigits.values[*text];
+      ++text;
+    }
+    return text == start ? nullptr : text;
+  }
+
+  // Finds where in memory the bytes go, remembering the block it was in.
+  class Output
+  {
+    const Memory& memory;
+    MemoryBlock* block;
+
+  public:
+    explicit Output(const Memory& memory) : memory(memory), block(nullptr) {}
+
+    // Returns where the size bytes from the address are stored, or nullptr
+    // if they are not all in the same block.
+    unsigned char* at(std::uint64_t address, std::uint64_t size)
+    {
+      if (address + size > (std::uint64_t(1) << 32)) return nullptr;
+      if (!block || !block->contains(static_cast<std::uint32_t>(address)))
+      {
+        block = memory.lookup(static_cast<std::uint32_t>(address));
+        if (!block) return nullptr;
+      }
+      if (address + size > block->endAddress) return nullptr;
+      return block->storage.get() + (address - block->startAddress);
+    }
+  };
+
+#if DEMU_SIMD_HEX
+  // A line as dasm writes it is the address, two spaces, then 16 bytes of
+  // two digits and a space, without the last space. The shuffles gather the
+  // first and second digits of each byte, and the spaces between them, from
+  // the 48 characters after the address.
+  struct Shuffles
+  {
+    __m128i high[3];
+    __m128i low[3];
+    __m128i spaces[3];
+
+    Shuffles()
+    {
+      for (int source = 0; source < 3; ++source)
+      {
+        alignas(16) unsigned char high[16], low[16], spaces[16];
+        for (int byte = 0; byte < 16; ++byte)
+        {
+          const auto index = [source](int position) -> unsigned char
+          {
+            const int offset = position - 16 * source;
+            return (offset >= 0 && offset < 16) ? offset : 0x80;
+          };
+          high[byte] = index(3 * byte);
+          low[byte] = index(3 * byte + 1);
+          spaces[byte] = byte < 15 ? index(3 * byte + 2) : 0x80;
+        }
+        this->high[source] = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(high));
+        this->low[source] = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(low));
+        this->spaces[source] = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(spaces));
+      }
+    }
+  };
+
+  const Shuffles shuffles;
+
+  // Converts the hexadecimal digits to their values, clearing the lanes of
+  // valid for those which aren't digits.
+  __attribute__((target("ssse3")))
+  __m128i Nibbles(__m128i digits, __m128i* valid)
+  {
+    const __m128i number = _mm_sub_epi8(digits, _mm_set1_epi8('0'));
+    const __m128i isNumber =
+      _mm_cmpeq_epi8(_mm_min_epu8(number, _mm_set1_epi8(9)), number);
+    const __m128i letter = _mm_sub_epi8(
+      _mm_or_si128(digits, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    const __m128i isLetter =
+      _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+    *valid = _mm_and_si128(*valid, _mm_or_si128(isNumber, isLetter));
+    return _mm_or_si128(
+      _mm_and_si128(isNumber, number),
+      _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+  }
+
+  // Decodes the 16 bytes of a line as dasm writes it, returning false without
+  // storing them if any of it is not as expected.
+  __attribute__((target("ssse3")))
+  bool DecodeSixteen(const unsigned char* text, unsigned char* to)
+  {
+    __m128i high = _mm_setzero_si128();
+    __m128i low = _mm_setzero_si128();
+    __m128i spaces = _mm_setzero_si128();
+    for (int source = 0; source < 3; ++source)
+    {
+      const __m128i characters = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(text + 16 * source));
+      high = _mm_or_si128(
+        high, _mm_shuffle_epi8(characters, shuffles.high[source]));
+      low = _mm_or_si128(
+        low, _mm_shuffle_epi8(characters, shuffles.low[source]));
+      spaces = _mm_or_si128(
+        spaces, _mm_shuffle_epi8(characters, shuffles.spaces[source]));
+    }
+
+    const int spaceMask =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(spaces, _mm_set1_epi8(' ')));
+    if ((spaceMask & 0x7FFF) != 0x7FFF) return false;
+
+    __m128i valid = _mm_set1_epi8(-1);
+    high = Nibbles(high, &valid);
+    low = Nibbles(low, &valid);
+    if (_mm_movemask_epi8(valid) != 0xFFFF) return false;
+
+    // The values are at most 15, so shifting the 16-bit lanes doesn't carry
+    // into the next byte.
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(to),
+                     _mm_or_si128(_mm_slli_epi16(high, 4), low));
+    return true;
+  }
+#endif
+
+  // A part of the text starting at a line, along with what was found in it.
+  struct Chunk
+  {
+    const unsigned char* begin;
+    const unsigned char* end;
+    std::uint64_t lines;
+
+    // The first error in the chunk, with its line counted from the start of
+    // the chunk.
+    const char* error;
+    bool outOfRange;
+    std::uint64_t errorLine;
+
+    // The last .start in the chunk.
+    bool hasStart;
+    std::uint32_t start;
+  };
+
+  // Decodes a line, returning the error or nullptr if it was valid.
+  const char* DecodeLine(const unsigned char* line, const unsigned char* end,
+                         const unsigned char* textEnd, bool simd,
+                         Output* output, Chunk* chunk)
+  {
+    const unsigned char* text = line;
+    while (text != end && IsSpace(*text)) ++text;
+    if (text == end) return nullptr;
+
+    std::uint32_t address;
+    if (*line == '.')
+    {
+      static const char start[] = ".start";
+      const std::size_t length = sizeof(start) - 1;
+      if (end - line < static_cast<std::ptrdiff_t>(length) ||
+          std::memcmp(line, start, length) != 0)
+      {
+        return "expected address of the form XXXXXXXX where X is a "
+               "hexadecimal digit or .start XXXXXXXX";
+      }
+
+      text = line + length;
+      while (text != end && IsSpace(*text)) ++text;
+      text = ReadAddress(text, end, &address);
+      while (text && text != end && IsSpace(*text)) ++text;
+      if (text != end) return "expected the start address after .start";
+
+      chunk->hasStart = true;
+      chunk->start = address;
+      return nullptr;
+    }
+
+    text = ReadAddress(line, end, &address);
+    if (text != line + 8)
+    {
+      return "expected address of the form XXXXXXXX where X is a "
+             "hexadecimal digit or .start XXXXXXXX";
+    }
+
+#if DEMU_SIMD_HEX
+    // The 48 characters after the address are read at once, the last being
+    // the end of the line.
+    const std::ptrdiff_t length = end - (line + 10);
+    if (simd && line[8] == ' ' && line[9] == ' ' &&
+        (length == 47 || (length == 48 && line[57] == '\r')) &&
+        line + 58 <= textEnd)
+    {
+      unsigned char* const to = output->at(address, 16);
+      if (to && DecodeSixteen(line + 10, to)) return nullptr;
+    }
+#else
+    (void)textEnd;
+    (void)simd;
+#endif
+
+    // Otherwise, or if it wasn't valid, go through it a character at a time
+    // to find what is wrong with it.
+    std::uint64_t to = address;
+    while (text != end)
+    {
+      if (IsSpace(*text))
+      {
+        ++text;
+        continue;
+      }
+
+      const int high = hexDigits.values[*text];
+      if (high < 0) return "expected a white-space or a hexadecimal digit.";
+
+      const int low = (text + 1 != end) ? hexDigits.values[text[1]] : -1;
+      if (low < 0) return "expected a hexadecimal digit.";
+      text += 2;
+
+      unsigned char* const byte = output->at(to, 1);
+      if (byte == nullptr)
+      {
+        chunk->outOfRange = true;
+        return "tried loading data outside any of the valid memory ranges.";
+      }
+      *byte = static_cast<unsigned char>((high << 4) | low);
+      ++to;
+    }
+    return nullptr;
+  }
+
+  void DecodeChunk(Chunk* chunk, const Memory* memory,
+                   const unsigned char* textEnd, bool simd)
+  {
+    Output output(*memory);
+    for (const unsigned char* line = chunk->begin; line < chunk->end;)
+    {
+      const unsigned char* end = static_cast<const unsigned char*>(
+        std::memchr(line, '\n', chunk->end - line));
+      if (end == nullptr) end = chunk->end;
+
+      ++chunk->lines;
+      chunk->error =
+        DecodeLine(line, end, textEnd, simd, &output, chunk);
+      if (chunk->error)
+      {
+        chunk->errorLine = chunk->lines;
+        return;
+      }
+      line = end + 1;
+    }
+  }
+}
+
+void dlx::loader::LoadAbsolute(const unsigned char* data, std::size_t size,
+                               hardware::DLXMachine* machine,
+                               unsigned int threads)
+{
+  const unsigned char* const end = data + size;
+  const unsigned char* newline =
+    static_cast<const unsigned char*>(std::memchr(data, '\n', size));
+  if (newline == nullptr) newline = end;
+
+  std::size_t headerLength = newline - data;
+  if (headerLength > 0 && data[headerLength - 1] == '\r') --headerLength;
+  if (headerLength != 4 || std::memcmp(data, ".abs", 4) != 0)
+  {
+    throw std::invalid_argument(
+      "line 1: it must have .abs on the first line.");
+  }
+
+  // The chunks are at least a megabyte, as it isn't worth starting a thread
+  // for less.
+  const unsigned char* const body = std::min(newline + 1, end);
+  const std::size_t bodySize = end - body;
+  if (threads == 0)
+  {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned int>(
+      std::min<std::size_t>(threads, bodySize / (1 << 20) + 1));
+  }
+
+  std::vector<Chunk> chunks;
+  const unsigned char* begin = body;
+  for (unsigned int i = 1; i <= threads && begin < end; ++i)
+  {
+    // Move the split on to the start of the next line.
+    const unsigned char* split = body + bodySize * i / threads;
+    if (split < begin) split = begin;
+    if (split < end)
+    {
+      split = static_cast<const unsigned char*>(
+        std::memchr(split, '\n', end - split));
+      split = split ? split + 1 : end;
+    }
+
+    const Chunk chunk = { begin, split, 0, nullptr, false, 0, false, 0 };
+    chunks.push_back(chunk);
+    begin = split;
+  }
+
+#if DEMU_SIMD_HEX
+  const bool simd = __builtin_cpu_supports("ssse3");
+#else
+  const bool simd = false;
+#endif
+
+  // The memory is looked up without remembering the last block, so the
+  // threads don't share anything they write to.
+  const Memory* const memory = &machine->memory();
+
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < chunks.size(); ++i)
+  {
+    workers.push_back(
+      std::thread(DecodeChunk, &chunks[i], memory, end, simd));
+  }
+  if (!chunks.empty()) DecodeChunk(&chunks[0], memory, end, simd);
+  for (auto& worker : workers) worker.join();
+
+  // The chunks before the first with an error have been counted entirely.
+  std::uint64_t line = 1;
+  for (const Chunk& chunk : chunks)
+  {
+    if (chunk.error)
+    {
+      const std::string message =
+        "line " + std::to_string(line + chunk.errorLine) + ": " + chunk.error;
+      if (chunk.outOfRange) throw std::out_of_range(message);
+      throw std::invalid_argument(message);
+    }
+    line += chunk.lines;
+  }
+
+  for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk)
+  {
+    if (chunk->hasStart)
+    {
+      machine->SetProgramCounter(chunk->start);
+      break;
+    }
+  }
+}
+
+//===--------------------------- End of the file --------------------------===//
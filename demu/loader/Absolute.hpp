@@ -0,0 +1,60 @@
+#ifndef DLX_ABSOLUTE_HPP_
+#define DLX_ABSOLUTE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Absolute
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides loading programs from the .abs text format.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The .abs format starts with a line of .abs, followed by lines
+//                of an address of 8 hexadecimal digits and the bytes to store
+//                from it as pairs of hexadecimal digits separated by white-
+//                space, and a line of .start and the address to start at.
+//
+//                The text is split into chunks at line boundaries which are
+//                decoded on threads of their own. A line as dasm writes it,
+//                with 16 bytes each followed by a single space, is decoded
+//                with SSSE3 shuffles where the host has them, and any other
+//                line a character at a time.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+
+// Decode the lines with SSSE3 on x86-64 when building with GCC or Clang, which
+// is checked for when loading as the build may not assume it.
+#ifndef DEMU_SIMD_HEX
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DEMU_SIMD_HEX 1
+#else
+#define DEMU_SIMD_HEX 0
+#endif
+#endif
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+  }
+
+  namespace loader
+  {
+    // Stores the bytes of the text in the memory of the machine and sets the
+    // program counter to the last .start address, using the given number of
+    // threads or one for each core and megabyte of text if it is 0.
+    //
+    // Throws std::invalid_argument if the text is not valid, or
+    // std::out_of_range if a line is outside the memory of the machine, with
+    // the number of the line in the message. When a line is not valid the
+    // lines before it have been loaded, and possibly some after it.
+    void LoadAbsolute(const unsigned char* data, std::size_t size,
+                      hardware::DLXMachine* machine, unsigned int threads = 0);
+  }
+}
+
+#endif
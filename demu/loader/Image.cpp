@@ -0,0 +1,130 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Image
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides loading programs from binary images.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements checking the image and copying its segments.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Image.hpp"
+
+#include "../hardware/Machine.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+  // Reads a little-endian number whatever the byte order of the host.
+  std::uint32_t ReadWord(const unsigned char* data)
+  {
+    return static_cast<std::uint32_t>(data[0]) |
+           static_cast<std::uint32_t>(data[1]) << 8 |
+           static_cast<std::uint32_t>(data[2]) << 16 |
+           static_cast<std::uint32_t>(data[3]) << 24;
+  }
+}
+
+bool dlx::loader::IsImage(const unsigned char* data, std::size_t size)
+{
+  return size >= 4 && ReadWord(data) == ImageMagic;
+}
+
+void dlx::loader::LoadImage(const unsigned char* data, std::size_t size,
+                            hardware::DLXMachine* machine)
+{
+  if (size < sizeof(ImageHeader) || !IsImage(data, size))
+  {
+    throw std::invalid_argument("The file is not a DLX image.");
+  }
+
+  ImageHeader header;
+  header.magic = ReadWord(data);
+  header.version = ReadWord(data + 4);
+  header.startAddress = ReadWord(data + 8);
+  header.segmentCount = ReadWord(data + 12);
+
+  if (header.version != ImageVersion)
+  {
+    throw std::invalid_argument("The version of the image is not supported.");
+  }
+
+  if (header.segmentCount >
+      (size - sizeof(ImageHeader)) / sizeof(ImageSegment))
+  {
+    throw std::invalid_argument(
+      "The segment table goes past the end of the image.");
+  }
+
+  // Check every segment before any is copied, so a bad image leaves the
+  // memory as it was.
+  const unsigned char* const table = data + sizeof(ImageHeader);
+  for (std::uint32_t i = 0; i < header.segmentCount; ++i)
+  {
+    const unsigned char* const entry = table + i * sizeof(ImageSegment);
+    const std::uint64_t address = ReadWord(entry);
+    const std::uint64_t length = ReadWord(entry + 4);
+    const std::uint64_t offset = ReadWord(entry + 8);
+    if (offset + length > size)
+    {
+      throw std::invalid_argument(
+        "A segment of the image goes past the end of the file.");
+    }
+    if (address + length > (std::uint64_t(1) << 32))
+    {
+      throw std::out_of_range(
+        "A segment of the image goes past the end of the address space.");
+    }
+
+    // The segment may span several blocks, though it must be all in memory.
+    for (std::uint64_t at = address; at < address + length;)
+    {
+      const hardware::MemoryBlock* const block =
+        machine->memory()[static_cast<std::uint32_t>(at)];
+      if (block == nullptr)
+      {
+        throw std::out_of_range(
+          "A segment of the image is outside any of the valid memory "
+          "ranges.");
+      }
+      at = block->endAddress;
+    }
+  }
+
+  for (std::uint32_t i = 0; i < header.segmentCount; ++i)
+  {
+    const unsigned char* const entry = table + i * sizeof(ImageSegment);
+    ImageSegment segment;
+    segment.address = ReadWord(entry);
+    segment.size = ReadWord(entry + 4);
+    segment.offset = ReadWord(entry + 8);
+    segment.flags = ReadWord(entry + 12);
+
+    const unsigned char* from = data + segment.offset;
+    std::uint64_t address = segment.address;
+    std::uint64_t remaining = segment.size;
+    while (remaining > 0)
+    {
+      hardware::MemoryBlock* const block =
+        machine->memory()[static_cast<std::uint32_t>(address)];
+      const std::uint64_t length =
+        std::min(remaining, block->endAddress - address);
+      std::memcpy(block->storage.get() + (address - block->startAddress),
+                  from, static_cast<std::size_t>(length));
+      from += length;
+      address += length;
+      remaining -= length;
+    }
+  }
+
+  machine->SetProgramCounter(header.startAddress);
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,83 @@
+#ifndef DLX_IMAGE_HPP_
+#define DLX_IMAGE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Image
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides loading programs from binary images.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : An image is the memory of a program as it is to be loaded,
+//                so loading it is no more than copying each segment into the
+//                memory block it belongs in. It is laid out as:
+//
+//                  ImageHeader
+//                  ImageSegment for each of ImageHeader::segmentCount
+//                  The contents of the segments
+//
+//                The fields of the header and the segment table are 32-bit
+//                little-endian numbers, whereas the contents are the bytes
+//                of memory in order, which is big-endian for the words.
+//
+//                The contents of a segment start at any offset in the file,
+//                though dasm puts them after the table on a 16 byte boundary.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class DLXMachine;
+  }
+
+  namespace loader
+  {
+    const std::uint32_t ImageMagic = 0x49584C44; // DLXI read as little-endian.
+    const std::uint32_t ImageVersion = 1;
+
+    struct ImageHeader
+    {
+      std::uint32_t magic;        // The bytes 'D' 'L' 'X' 'I'.
+      std::uint32_t version;
+      std::uint32_t startAddress; // The program counter to start at.
+      std::uint32_t segmentCount;
+    };
+
+    enum ImageSegmentFlags
+    {
+      SegmentExecutable = 1,
+      SegmentWritable = 2,
+    };
+
+    struct ImageSegment
+    {
+      std::uint32_t address; // Where the segment is loaded to.
+      std::uint32_t size;    // In bytes, in the file and in memory.
+      std::uint32_t offset;  // Of the contents from the start of the file.
+      std::uint32_t flags;   // ImageSegmentFlags.
+    };
+
+    static_assert(sizeof(ImageHeader) == 16 && sizeof(ImageSegment) == 16,
+                  "The header and segments must not be padded.");
+
+    // Returns true if the data starts with the magic number of an image.
+    bool IsImage(const unsigned char* data, std::size_t size);
+
+    // Copies the segments of the image into the memory of the machine and
+    // sets the program counter to its start address.
+    //
+    // Throws std::invalid_argument if it isn't a valid image, or
+    // std::out_of_range if a segment is outside the memory of the machine.
+    void LoadImage(const unsigned char* data, std::size_t size,
+                   hardware::DLXMachine* machine);
+  }
+}
+
+#endif
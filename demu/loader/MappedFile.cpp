@@ -0,0 +1,79 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : MappedFile
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides reading the whole of a file in place.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements mapping the file, or reading it where mmap() is
+//                not available.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if DEMU_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+dlx::loader::MappedFile::MappedFile(const char* filename)
+: contents(),
+  length(0)
+{
+#if DEMU_MMAP
+  const int descriptor = open(filename, O_RDONLY);
+  struct stat status;
+  if (descriptor < 0 || fstat(descriptor, &status) != 0)
+  {
+    if (descriptor >= 0) close(descriptor);
+    throw std::runtime_error("The file could not be read.");
+  }
+
+  // An empty file can't be mapped, and there is nothing to read from it.
+  length = static_cast<std::size_t>(status.st_size);
+  contents = nullptr;
+  if (length > 0)
+  {
+    contents = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (contents == MAP_FAILED)
+    {
+      close(descriptor);
+      throw std::runtime_error("The file could not be mapped.");
+    }
+
+    // It is read from start to end.
+    madvise(contents, length, MADV_SEQUENTIAL);
+  }
+  close(descriptor);
+#else
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+  {
+    throw std::runtime_error("The file could not be read.");
+  }
+
+  length = static_cast<std::size_t>(file.tellg());
+  contents.reset(new unsigned char[length ? length : 1]);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(contents.get()), length);
+#endif
+}
+
+dlx::loader::MappedFile::~MappedFile()
+{
+#if DEMU_MMAP
+  if (contents) munmap(contents, length);
+#endif
+}
+
+//===--------------------------- End of the file --------------------------===//
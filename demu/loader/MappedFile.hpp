@@ -0,0 +1,62 @@
+#ifndef DLX_MAPPEDFILE_HPP_
+#define DLX_MAPPEDFILE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : MappedFile
+// NAMESPACE    : dlx::loader
+// PURPOSE      : Provides reading the whole of a file in place.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The file is mapped read-only with mmap() where it is
+//                available, so the program is read straight from the page
+//                cache, elsewhere it is read into memory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../hardware/Memory.hpp"
+
+#include <cstddef>
+#include <memory>
+
+namespace dlx
+{
+  namespace loader
+  {
+    class MappedFile
+    {
+#if DEMU_MMAP
+      void* contents;
+#else
+      std::unique_ptr<unsigned char[]> contents;
+#endif
+      std::size_t length;
+
+    public:
+      // Throws std::runtime_error if the file can't be read.
+      explicit MappedFile(const char* filename);
+      ~MappedFile();
+
+      const unsigned char* data() const
+      {
+        return static_cast<const unsigned char*>(
+#if DEMU_MMAP
+          contents
+#else
+          contents.get()
+#endif
+          );
+      }
+
+      std::size_t size() const { return length; }
+
+    private:
+      MappedFile(const MappedFile&);
+      MappedFile& operator=(const MappedFile&);
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,803 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Recompiler
+// NAMESPACE    : dlx::recompiler
+// PURPOSE      : Provides recompiling a program ahead of time to a library of
+//                native code.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements finding the blocks and routines, writing the source
+//                for them and compiling it into the cache.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Recompiler.hpp"
+
+#include "../hardware/Decoder.hpp"
+#include "../hardware/Memory.hpp"
+#include "../hardware/Native.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#if DEMU_NATIVE
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  using dlx::hardware::DecodedInstruction;
+
+  // This is increased whenever the source written for a program changes, so
+  // the libraries cached by an older recompiler are not used.
+  const std::uint32_t RecompilerVersion = 4;
+
+  // Decodes the instruction at the address, returning false if it is outside
+  // the memory.
+  bool Fetch(const dlx::hardware::Memory& memory, std::uint32_t address,
+             DecodedInstruction* instruction)
+  {
+    const dlx::hardware::MemoryBlock* const block = memory.lookup(address);
+    if (block == nullptr || (address & 3) != 0 ||
+        address + std::uint64_t(4) > block->endAddress)
+    {
+      return false;
+    }
+    *instruction = dlx::hardware::decode(block->load<std::uint32_t>(address));
+    return true;
+  }
+
+  // Returns the address a branch or jal at the address goes to.
+  std::uint32_t Target(const DecodedInstruction& instruction,
+                       std::uint32_t address)
+  {
+    return address + 4 + static_cast<std::uint32_t>(instruction.immediate);
+  }
+
+  // Returns the addresses the program may go to after the last instruction
+  // of a block, without following a jal, jr or jalr.
+  std::vector<std::uint32_t> Successors(const DecodedInstruction& last,
+                                        std::uint32_t address)
+  {
+    switch (last.operation)
+    {
+      case 2: // j
+        return { Target(last, address) };
+      case 4: // beqz
+      case 5: // bnez
+      case 6: // bfpt
+      case 7: // bfpf
+        return { Target(last, address), address + 4 };
+      case 18: // jr
+      case 19: // jalr
+      case 65: // halt
+        return {};
+      default:
+        return { address + 4 };
+    }
+  }
+
+  std::string Hex(std::uint32_t value)
+  {
+    std::ostringstream text;
+    text << "0x" << std::hex << std::uppercase << std::setw(8)
+         << std::setfill('0') << value << "u";
+    return text.str();
+  }
+
+  std::string Label(std::uint32_t address)
+  {
+    return "b_" + Hex(address).substr(2, 8);
+  }
+
+  std::string RoutineName(std::uint32_t entry)
+  {
+    return "routine_" + Hex(entry).substr(2, 8);
+  }
+
+  std::string R(unsigned int index)
+  {
+    return "r[" + std::to_string(index) + "]";
+  }
+
+  // Writes the code for the blocks of a routine.
+  class RoutineWriter
+  {
+    std::ostream& output;
+    const dlx::hardware::Memory& memory;
+    const std::vector<std::uint32_t>& blocks;
+
+    // The instructions of the block counted so far.
+    unsigned int counted;
+
+  public:
+    RoutineWriter(std::ostream& output, const dlx::hardware::Memory& memory,
+                  const dlx::recompiler::Routine& routine)
+    : output(output), memory(memory), blocks(routine.blocks), counted(0)
+    {
+    }
+
+    void block(std::uint32_t start, std::uint32_t end);
+
+  private:
+    // Adds the instructions up to the given number to the count.
+    void count(unsigned int instructions)
+    {
+      if (instructions > counted)
+      {
+        output << "  c->instructionCount += " << (instructions - counted)
+               << ";\n";
+        counted = instructions;
+      }
+    }
+
+    // Calls back into the machine for the instruction at the address.
+    void callBack(std::uint32_t address)
+    {
+      output << "  if (c->execute(c, " << Hex(address) << ")) "
+             << "return Stop | c->programCounter;\n";
+    }
+
+    void jump(std::uint32_t address)
+    {
+      if (std::binary_search(blocks.begin(), blocks.end(), address))
+      {
+        output << "  goto " << Label(address) << ";\n";
+      }
+      else
+      {
+        output << "  return " << Hex(address) << ";\n";
+      }
+    }
+
+    // Writes the instruction if it is one compiled directly, returning false
+    // otherwise.
+    bool arithmetic(const DecodedInstruction& instruction);
+    bool load(const DecodedInstruction& instruction, std::uint32_t address,
+              unsigned int index);
+    bool divide(const DecodedInstruction& instruction, std::uint32_t address,
+                unsigned int index);
+  };
+
+  bool RoutineWriter::arithmetic(const DecodedInstruction& instruction)
+  {
+    const std::string ri = R(instruction.ri);
+    const std::string rj = R(instruction.rj);
+    const std::string rk = R(instruction.rk);
+    const std::string immediate =
+      "I(" + Hex(static_cast<std::uint32_t>(instruction.immediate)) + ")";
+
+    // The set-compares are as the interpreter performs them.
+    const char* compare = nullptr;
+    switch (instruction.operation)
+    {
+      case 8:  // addi
+      case 9:  // addui
+        output << "  " << rj << " = add(" << ri << ", " << immediate << ");\n";
+        return true;
+      case 10: // subi
+      case 11: // subui
+        output << "  " << rj << " = sub(" << ri << ", " << immediate << ");\n";
+        return true;
+      case 12: // andi
+        output << "  " << rj << " = " << ri << " & " << immediate << ";\n";
+        return true;
+      case 13: // ori
+        output << "  " << rj << " = " << ri << " | " << immediate << ";\n";
+        return true;
+      case 14: // xori
+        output << "  " << rj << " = " << ri << " ^ " << immediate << ";\n";
+        return true;
+      case 15: // lhi
+        output << "  " << rj << " = I(" << Hex(static_cast<std::uint32_t>(
+                    instruction.immediate) << 16) << ");\n";
+        return true;
+      case 24: compare = "=="; break; // seqi
+      case 25: compare = "!="; break; // snei
+      case 26: compare = "<"; break;  // slti
+      case 27: compare = ">"; break;  // sgti
+      case 28: compare = "<="; break; // slei
+      case 29: compare = ">="; break; // sgei
+      case 64: // nop
+        return true;
+      case 96: // add
+      case 97: // addu
+        output << "  " << rk << " = add(" << ri << ", " << rj << ");\n";
+        return true;
+      case 98: // sub
+      case 99: // subu
+        output << "  " << rk << " = sub(" << ri << ", " << rj << ");\n";
+        return true;
+      case 100: // and
+        output << "  " << rk << " = " << ri << " & " << rj << ";\n";
+        return true;
+      case 101: // or
+        output << "  " << rk << " = " << ri << " | " << rj << ";\n";
+        return true;
+      case 102: // xor
+        output << "  " << rk << " = " << ri << " ^ " << rj << ";\n";
+        return true;
+      case 104: // seq
+      case 105: // sne
+      case 106: // slt
+      case 107: // sgt
+      case 108: // sle
+      {
+        static const char* const compares[] = { "==", "!=", "<", ">", "<=" };
+        output << "  " << rk << " = (" << ri << " "
+               << compares[instruction.operation - 104] << " " << rj
+               << ") ? 1 : 0;\n";
+        return true;
+      }
+      case 109: // sge
+        output << "  " << rk << " = (" << ri << " <= " << rj
+               << ") ? 0 : 1;\n";
+        return true;
+      case 142: // mult
+      case 150: // multu
+        output << "  " << rk << " = mul(" << ri << ", " << rj << ");\n";
+        return true;
+      default:
+        return false;
+    }
+
+    output << "  " << rj << " = (" << ri << " " << compare << " "
+           << immediate << ") ? 1 : 0;\n";
+    return true;
+  }
+
+  bool RoutineWriter::load(const DecodedInstruction& instruction,
+                           std::uint32_t address, unsigned int index)
+  {
+    // The size and the type the value is converted through.
+    unsigned int size;
+    const char* type;
+    switch (instruction.operation)
+    {
+      case 32: size = 1; type = "std::int8_t"; break;    // lb
+      case 33: size = 2; type = "std::int16_t"; break;   // lh
+      case 35: size = 4; type = "std::int32_t"; break;   // lw
+      case 36: size = 1; type = "std::uint8_t"; break;   // lbu
+      case 37: size = 2; type = "std::uint16_t"; break;  // lhu
+      default: return false;
+    }
+
+    // A load outside the block of memory is left to the machine, which
+    // raises the exception if it is outside the memory altogether, so the
+    // count must be up to date either way.
+    count(index + 1);
+    output << "  a = static_cast<std::uint32_t>(add(" << R(instruction.ri)
+           << ", I(" << Hex(static_cast<std::uint32_t>(instruction.immediate))
+           << ")));\n"
+           << "  if (inside(c, a, " << size << ")) " << R(instruction.rj)
+           << " = static_cast<" << type << ">(load(c, a, " << size
+           << "));\n"
+           << "  else if (c->execute(c, " << Hex(address) << ")) "
+           << "return Stop | c->programCounter;\n";
+    return true;
+  }
+
+  bool RoutineWriter::divide(const DecodedInstruction& instruction,
+                             std::uint32_t address, unsigned int index)
+  {
+    const auto operation = instruction.operation;
+    if (operation != 143 && operation != 151) return false; // div and divu
+
+    // A divide by zero is left to the machine, which raises the exception,
+    // so the count must be up to date either way.
+    count(index + 1);
+
+    const std::string ri = R(instruction.ri);
+    const std::string rj = R(instruction.rj);
+    const std::string rk = R(instruction.rk);
+    if (operation == 143)
+    {
+      // The quotient which doesn't fit wraps around, as with the interpreter.
+      output << "  if (" << rj << " != 0) " << rk << " = (" << rj
+             << " == -1) ? sub(0, " << ri << ") : " << ri << " / " << rj
+             << ";\n";
+    }
+    else
+    {
+      output << "  if (" << rj << " != 0) " << rk
+             << " = I(static_cast<std::uint32_t>(" << ri
+             << ") / static_cast<std::uint32_t>(" << rj << "));\n";
+    }
+    output << "  else if (c->execute(c, " << Hex(address) << ")) "
+           << "return Stop | c->programCounter;\n";
+    return true;
+  }
+
+  void RoutineWriter::block(std::uint32_t start, std::uint32_t end)
+  {
+    std::vector<DecodedInstruction> instructions((end - start) / 4);
+    for (std::size_t i = 0; i < instructions.size(); ++i)
+    {
+      Fetch(memory, start + 4 * static_cast<std::uint32_t>(i),
+            &instructions[i]);
+    }
+
+    // A halt or trap at the end is left to the machine, so isn't counted.
+    const DecodedInstruction& last = instructions.back();
+    const bool stops =
+      last.operation == dlx::hardware::operationIndex(0, 1) ||
+      last.operation == 17;
+    const unsigned int size =
+      static_cast<unsigned int>(instructions.size()) - (stops ? 1 : 0);
+
+    output << "\n" << Label(start) << ":\n";
+    if (size > 0)
+    {
+      // At least one instruction before the limit is left to the machine, so
+      // it has one to stop on.
+      output << "  if (c->instructionLimit - c->instructionCount <= " << size
+             << ") return Stop | " << Hex(start) << ";\n";
+    }
+
+    counted = 0;
+    for (unsigned int i = 0; i < size; ++i)
+    {
+      const DecodedInstruction& instruction = instructions[i];
+      const std::uint32_t address = start + 4 * i;
+      if (dlx::hardware::isControlTransfer(instruction)) break;
+      if (arithmetic(instruction) || load(instruction, address, i) ||
+          divide(instruction, address, i))
+      {
+        continue;
+      }
+
+      count(i + 1);
+      callBack(address);
+    }
+
+    const std::uint32_t address = end - 4;
+    if (stops)
+    {
+      count(size);
+      output << "  return Stop | " << Hex(address) << ";\n";
+      return;
+    }
+
+    count(size);
+    if (!dlx::hardware::isControlTransfer(last))
+    {
+      jump(end);
+      return;
+    }
+
+    switch (last.operation)
+    {
+      case 2: // j
+        jump(Target(last, address));
+        break;
+      case 3: // jal
+        output << "  r[31] = I(" << Hex(end) << ");\n";
+        jump(Target(last, address));
+        break;
+      case 4: // beqz
+      case 5: // bnez
+        output << "  if (" << R(last.ri)
+               << (last.operation == 4 ? " == 0)\n" : " != 0)\n")
+               << "  {\n  ";
+        jump(Target(last, address));
+        output << "  }\n";
+        jump(end);
+        break;
+      case 18: // jr
+        output << "  return static_cast<std::uint32_t>(" << R(last.ri)
+               << ");\n";
+        break;
+      case 19: // jalr
+        output << "  a = static_cast<std::uint32_t>(" << R(last.ri) << ");\n"
+               << "  r[31] = I(" << Hex(end) << ");\n"
+               << "  return a;\n";
+        break;
+      default:
+        // The machine performs the rest, which may go anywhere.
+        callBack(address);
+        output << "  return c->programCounter;\n";
+        break;
+    }
+  }
+
+  // The definitions the source for every program starts with. The context is
+  // as in hardware/Native.hpp.
+  const char* const Prelude = R"(
+#include <cstdint>
+
+namespace
+{
+  struct NativeContext
+  {
+    std::int32_t* registers;
+    std::uint64_t instructionCount;
+    std::uint64_t instructionLimit;
+    std::uint32_t programCounter;
+    std::uint32_t memoryStart;
+    std::uint64_t memorySize;
+    const unsigned char* memory;
+    std::uint32_t (*execute)(NativeContext* context, std::uint32_t address);
+    void* machine;
+  };
+
+  // A routine returns the address to carry on from, with this set if the
+  // machine must take over from there.
+  const std::uint64_t Stop = std::uint64_t(1) << 32;
+
+  inline std::int32_t I(std::uint32_t value)
+  {
+    return static_cast<std::int32_t>(value);
+  }
+
+  inline std::int32_t add(std::int32_t a, std::int32_t b)
+  {
+    return I(static_cast<std::uint32_t>(a) + static_cast<std::uint32_t>(b));
+  }
+
+  inline std::int32_t sub(std::int32_t a, std::int32_t b)
+  {
+    return I(static_cast<std::uint32_t>(a) - static_cast<std::uint32_t>(b));
+  }
+
+  inline std::int32_t mul(std::int32_t a, std::int32_t b)
+  {
+    return I(static_cast<std::uint32_t>(a) * static_cast<std::uint32_t>(b));
+  }
+
+  // Returns true if the load is aligned and in the block of memory.
+  inline bool inside(const NativeContext* c, std::uint32_t address,
+                     unsigned int size)
+  {
+    return (address & (size - 1)) == 0 &&
+           std::uint64_t(address - c->memoryStart) + size <= c->memorySize;
+  }
+
+  // Reads the big-endian value of the size at the address.
+  inline std::uint32_t load(const NativeContext* c, std::uint32_t address,
+                            unsigned int size)
+  {
+    const unsigned char* const bytes =
+      c->memory + (address - c->memoryStart);
+    std::uint32_t value = 0;
+    for (unsigned int i = 0; i < size; ++i) value = value << 8 | bytes[i];
+    return value;
+  }
+)";
+}
+
+dlx::recompiler::Program dlx::recompiler::RecoverProgram(
+  const hardware::Memory& memory, std::uint32_t startAddress)
+{
+  Program program;
+  program.startAddress = startAddress;
+  program.indirectJumps = 0;
+
+  // Walk the instructions from each address that starts a block, until a
+  // control transfer or an instruction already walked from elsewhere, which
+  // must then start a block too.
+  std::set<std::uint32_t> leaders;
+  std::set<std::uint32_t> entries;
+  std::set<std::uint32_t> walked;
+  std::vector<std::uint32_t> work(1, startAddress);
+  entries.insert(startAddress);
+  while (!work.empty())
+  {
+    const std::uint32_t from = work.back();
+    work.pop_back();
+    leaders.insert(from);
+
+    DecodedInstruction instruction;
+    for (std::uint32_t address = from; Fetch(memory, address, &instruction);
+         address += 4)
+    {
+      if (!walked.insert(address).second)
+      {
+        leaders.insert(address);
+        break;
+      }
+      if (!hardware::isControlTransfer(instruction)) continue;
+
+      if (instruction.operation == 3) // jal
+      {
+        entries.insert(Target(instruction, address));
+        work.push_back(Target(instruction, address));
+      }
+      else if (instruction.operation == 18)
+      {
+        ++program.indirectJumps;
+      }
+      else if (instruction.operation == 19)
+      {
+        // Where a jalr returns to is only reached through the routine it
+        // calls, so it starts a routine of its own.
+        ++program.indirectJumps;
+        entries.insert(address + 4);
+        work.push_back(address + 4);
+      }
+
+      const std::vector<std::uint32_t> next =
+        Successors(instruction, address);
+      work.insert(work.end(), next.begin(), next.end());
+      break;
+    }
+  }
+
+  for (auto leader = leaders.begin(); leader != leaders.end(); ++leader)
+  {
+    std::uint32_t end = *leader;
+    DecodedInstruction instruction;
+    while (walked.count(end) && Fetch(memory, end, &instruction))
+    {
+      end += 4;
+      if (hardware::isControlTransfer(instruction) || leaders.count(end))
+      {
+        break;
+      }
+    }
+    if (end != *leader) program.blocks[*leader] = end;
+  }
+
+  // A routine is the blocks reached from its entry, with a jal carrying on
+  // at the block after it once the routine it calls returns.
+  for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+  {
+    if (!program.blocks.count(*entry)) continue;
+
+    Routine routine;
+    routine.entry = *entry;
+    std::set<std::uint32_t> reached;
+    std::vector<std::uint32_t> pending(1, *entry);
+    while (!pending.empty())
+    {
+      const std::uint32_t start = pending.back();
+      pending.pop_back();
+      const auto block = program.blocks.find(start);
+      if (block == program.blocks.end() || !reached.insert(start).second)
+      {
+        continue;
+      }
+
+      DecodedInstruction last;
+      Fetch(memory, block->second - 4, &last);
+      const std::vector<std::uint32_t> next =
+        hardware::isControlTransfer(last) ?
+          Successors(last, block->second - 4) :
+          std::vector<std::uint32_t>(1, block->second);
+      pending.insert(pending.end(), next.begin(), next.end());
+    }
+    routine.blocks.assign(reached.begin(), reached.end());
+
+    // The routine starting at the start address comes first.
+    if (*entry == startAddress)
+    {
+      program.routines.insert(program.routines.begin(), routine);
+    }
+    else
+    {
+      program.routines.push_back(routine);
+    }
+  }
+
+  return program;
+}
+
+void dlx::recompiler::WriteSource(
+  std::ostream& output, const hardware::Memory& memory,
+  const Program& program, std::uint64_t hash)
+{
+  output << "// Recompiled by demu from the image with the hash 0x" << std::hex
+         << std::setw(16) << std::setfill('0') << hash << std::dec
+         << ", which starts\n// at " << Hex(program.startAddress)
+         << ". This is generated, so shouldn't be edited.\n"
+         << Prelude
+         << "\n  static_assert(sizeof(NativeContext) == "
+         << sizeof(hardware::NativeContext) << ",\n"
+         << "                \"The context must be as demu has it.\");\n"
+         << "}\n";
+
+  // The routine each block is entered through, which is the one it starts
+  // if there is one.
+  std::map<std::uint32_t, std::uint32_t> owners;
+  for (auto routine = program.routines.begin();
+       routine != program.routines.end(); ++routine)
+  {
+    owners[routine->entry] = routine->entry;
+  }
+  for (auto routine = program.routines.begin();
+       routine != program.routines.end(); ++routine)
+  {
+    output << "\nstatic std::uint64_t " << RoutineName(routine->entry)
+           << "(NativeContext* c, std::uint32_t pc)\n"
+           << "{\n"
+           << "  std::int32_t* const r = c->registers;\n"
+           << "  std::uint32_t a;\n"
+           << "  (void)a;\n"
+           << "  switch (pc)\n"
+           << "  {\n";
+    for (auto start = routine->blocks.begin(); start != routine->blocks.end();
+         ++start)
+    {
+      output << "    case " << Hex(*start) << ": goto " << Label(*start)
+             << ";\n";
+      owners.insert(std::make_pair(*start, routine->entry));
+    }
+    output << "    default: return Stop | pc;\n"
+           << "  }\n";
+
+    RoutineWriter writer(output, memory, *routine);
+    for (auto start = routine->blocks.begin(); start != routine->blocks.end();
+         ++start)
+    {
+      writer.block(*start, program.blocks.at(*start));
+    }
+    output << "}\n";
+  }
+
+  output << "\nextern \"C\" const std::uint32_t dlx_native_version = "
+         << hardware::NativeInterfaceVersion << ";\n"
+         << "extern \"C\" const std::uint64_t dlx_native_hash = 0x"
+         << std::hex << std::setw(16) << std::setfill('0') << hash
+         << std::dec << "u;\n";
+
+  // The runs of instructions with code, joining the blocks that follow on
+  // from each other.
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges;
+  for (auto block = program.blocks.begin(); block != program.blocks.end();
+       ++block)
+  {
+    if (!ranges.empty() && ranges.back().second == block->first)
+    {
+      ranges.back().second = block->second;
+    }
+    else
+    {
+      ranges.push_back(*block);
+    }
+  }
+  output << "extern \"C\" const std::uint32_t dlx_native_code_count = "
+         << ranges.size() << ";\n"
+         << "extern \"C\" const std::uint32_t dlx_native_code[] = {\n";
+  for (auto range = ranges.begin(); range != ranges.end(); ++range)
+  {
+    output << "  " << Hex(range->first) << ", " << Hex(range->second)
+           << ",\n";
+  }
+  if (ranges.empty()) output << "  0, 0,\n";
+  output << "};\n";
+
+  output << "\n"
+         << "extern \"C\" void dlx_native_run(NativeContext* c)\n"
+         << "{\n"
+         << "  std::uint64_t next = c->programCounter;\n"
+         << "  for (;;)\n"
+         << "  {\n"
+         << "    const std::uint32_t pc = static_cast<std::uint32_t>(next);\n"
+         << "    switch (pc)\n"
+         << "    {\n";
+  for (auto owner = owners.begin(); owner != owners.end(); ++owner)
+  {
+    output << "      case " << Hex(owner->first) << ": next = "
+           << RoutineName(owner->second) << "(c, pc); break;\n";
+  }
+  output << "      default: c->programCounter = pc; return;\n"
+         << "    }\n"
+         << "    if (next & Stop)\n"
+         << "    {\n"
+         << "      c->programCounter = static_cast<std::uint32_t>(next);\n"
+         << "      return;\n"
+         << "    }\n"
+         << "  }\n"
+         << "}\n";
+}
+
+std::uint64_t dlx::recompiler::HashImage(
+  const unsigned char* data, std::size_t size, std::uint32_t startAddress)
+{
+  // FNV-1a, which is quick enough to hash the image each time it's run.
+  std::uint64_t hash = 14695981039346656037u;
+  const auto add = [&hash](unsigned char byte)
+    {
+      hash = (hash ^ byte) * 1099511628211u;
+    };
+
+  std::for_each(data, data + size, add);
+  const std::uint32_t words[] = {
+    startAddress, RecompilerVersion, hardware::NativeInterfaceVersion,
+  };
+  for (std::size_t i = 0; i < sizeof(words) / sizeof(words[0]); ++i)
+  {
+    for (int shift = 0; shift < 32; shift += 8) add(words[i] >> shift);
+  }
+  return hash;
+}
+
+std::string dlx::recompiler::Recompile(
+  const unsigned char* data, std::size_t size, const hardware::Memory& memory,
+  std::uint32_t startAddress)
+{
+#if DEMU_NATIVE
+  std::string directory;
+  if (const char* const cache = std::getenv("DEMU_CACHE"))
+  {
+    directory = cache;
+  }
+  else if (const char* const cache = std::getenv("XDG_CACHE_HOME"))
+  {
+    directory = std::string(cache) + "/demu";
+  }
+  else if (const char* const home = std::getenv("HOME"))
+  {
+    directory = std::string(home) + "/.cache/demu";
+  }
+  else
+  {
+    throw std::runtime_error("There is no directory to cache the recompiled "
+                             "programs in, see DEMU_CACHE.");
+  }
+
+  // Create each directory of the path which doesn't exist yet.
+  for (std::size_t slash = directory.find('/', 1);;
+       slash = directory.find('/', slash + 1))
+  {
+    mkdir(directory.substr(0, slash).c_str(), 0755);
+    if (slash == std::string::npos) break;
+  }
+
+  const std::uint64_t hash = HashImage(data, size, startAddress);
+  std::ostringstream base;
+  base << directory << '/' << std::hex << std::setw(16) << std::setfill('0')
+       << hash;
+  const std::string library = base.str() + ".so";
+  if (access(library.c_str(), R_OK) == 0) return library;
+
+  // Another demu may be recompiling the same program, so each writes its own
+  // files and then renames them into place.
+  const std::string temporary = base.str() + "." + std::to_string(getpid());
+  const std::string source = base.str() + ".cpp";
+  {
+    std::ofstream output(temporary + ".cpp");
+    WriteSource(output, memory, RecoverProgram(memory, startAddress), hash);
+    if (!output)
+    {
+      throw std::runtime_error("The source of the program could not be "
+                               "written to " + directory + ".");
+    }
+  }
+
+  const char* compiler = std::getenv("CXX");
+  if (compiler == nullptr || *compiler == '\0') compiler = "c++";
+  const std::string command = std::string(compiler) +
+    " -std=c++11 -O2 -fPIC -shared -o '" + temporary + ".so' '" +
+    temporary + ".cpp'";
+  const bool compiled = std::system(command.c_str()) == 0 &&
+    std::rename((temporary + ".cpp").c_str(), source.c_str()) == 0 &&
+    std::rename((temporary + ".so").c_str(), library.c_str()) == 0;
+  if (!compiled)
+  {
+    std::remove((temporary + ".cpp").c_str());
+    std::remove((temporary + ".so").c_str());
+    throw std::runtime_error("The program could not be compiled with " +
+                             std::string(compiler) + ".");
+  }
+  return library;
+#else
+  (void)data;
+  (void)size;
+  (void)memory;
+  (void)startAddress;
+  throw std::runtime_error("Recompiling is not supported on this host.");
+#endif
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,105 @@
+#ifndef DLX_RECOMPILER_HPP_
+#define DLX_RECOMPILER_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Recompiler
+// NAMESPACE    : dlx::recompiler
+// PURPOSE      : Provides recompiling a program ahead of time to a library of
+//                native code.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : The instructions are found by following the branches and
+//                jumps from the start address, which splits them into basic
+//                blocks. Each target of a jal starts a routine, made up of the
+//                blocks reached from it other than through another jal, and
+//                each routine becomes a C++ function with a label for each of
+//                its blocks. The source is compiled by the system compiler
+//                into a shared library, which hardware::NativeCode loads.
+//
+//                The integer arithmetic, logical, set-compare, load and branch
+//                instructions are compiled directly, and the rest call back
+//                into the machine. A jal, jr or jalr returns its target from
+//                the function to the loop which calls the function holding
+//                each address, so a target that can't be worked out ahead of
+//                time still runs natively when it starts a block that was
+//                found, and is left to the machine when it doesn't.
+//
+//                The libraries are cached in a directory by a hash of the
+//                image, so a program is only compiled the first time it is
+//                run.
+//
+//===----------------------------------------------------------------------===//
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dlx
+{
+  namespace hardware
+  {
+    class Memory;
+  }
+
+  namespace recompiler
+  {
+    struct Routine
+    {
+      std::uint32_t entry;
+
+      // The start addresses of the blocks in the routine, in order.
+      std::vector<std::uint32_t> blocks;
+    };
+
+    struct Program
+    {
+      std::uint32_t startAddress;
+
+      // The [start, end) of each basic block, indexed by its start.
+      std::map<std::uint32_t, std::uint32_t> blocks;
+
+      // The routines, in order of their entries, the first of which starts at
+      // the start address.
+      std::vector<Routine> routines;
+
+      // The number of jr and jalr, whose targets are only known as the
+      // program runs.
+      std::size_t indirectJumps;
+    };
+
+    // Finds the instructions reachable from the start address in the memory.
+    Program RecoverProgram(const hardware::Memory& memory,
+                           std::uint32_t startAddress);
+
+    // Writes the C++ source for the program, which is in the memory, to the
+    // output. The hash identifies the image it was loaded from.
+    void WriteSource(std::ostream& output, const hardware::Memory& memory,
+                     const Program& program, std::uint64_t hash);
+
+    // Returns the hash of the image, the program in it starting at the start
+    // address, and the version of the recompiler.
+    std::uint64_t HashImage(const unsigned char* data, std::size_t size,
+                            std::uint32_t startAddress);
+
+    // Returns the filename of the library for the image, which has been
+    // loaded into the memory and starts at the start address, recompiling it
+    // unless the cache has it already.
+    //
+    // The cache is the directory given by DEMU_CACHE, otherwise demu in
+    // XDG_CACHE_HOME or ~/.cache, and the compiler is given by CXX,
+    // otherwise c++.
+    //
+    // Throws std::runtime_error if it can't be compiled or written.
+    std::string Recompile(const unsigned char* data, std::size_t size,
+                          const hardware::Memory& memory,
+                          std::uint32_t startAddress);
+  }
+}
+
+#endif
@@ -0,0 +1,446 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : BranchPredictor
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides models of predicting branches.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the predictors and keeps count of how they did.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BranchPredictor.hpp"
+
+#include "../hardware/Decoder.hpp"
+#include "../hardware/Trace.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+namespace
+{
+  // A 2-bit saturating counter predicts taken in its upper two states.
+  bool Taken(std::uint8_t counter)
+  {
+    return counter >= 2;
+  }
+
+  void Count(std::uint8_t& counter, bool taken)
+  {
+    if (taken && counter < 3) ++counter;
+    else if (!taken && counter > 0) --counter;
+  }
+
+  // The low bits of an instruction address are always zero.
+  std::uint32_t Index(std::uint32_t address)
+  {
+    return address >> 2;
+  }
+
+  class NotTaken : public dlx::timing::DirectionPredictor
+  {
+  public:
+    std::string Name() const override { return "not-taken"; }
+    bool predict(std::uint32_t) const override { return false; }
+    void update(std::uint32_t, bool) override {}
+  };
+
+  class Bimodal : public dlx::timing::DirectionPredictor
+  {
+    const unsigned int bits;
+    const std::uint32_t mask;
+    std::vector<std::uint8_t> counters;
+
+  public:
+    explicit Bimodal(unsigned int bits)
+    : bits(bits), mask((1u << bits) - 1), counters(1u << bits, 1) {}
+
+    std::string Name() const override
+    {
+      return "bimodal:" + std::to_string(bits);
+    }
+
+    bool predict(std::uint32_t address) const override
+    {
+      return Taken(counters[Index(address) & mask]);
+    }
+
+    void update(std::uint32_t address, bool taken) override
+    {
+      Count(counters[Index(address) & mask], taken);
+    }
+  };
+
+  class Gshare : public dlx::timing::DirectionPredictor
+  {
+    const unsigned int bits;
+    const std::uint32_t mask;
+    std::vector<std::uint8_t> counters;
+
+    // Whether each of the last branches was taken, the latest in bit 0.
+    std::uint32_t history;
+
+  public:
+    explicit Gshare(unsigned int bits)
+    : bits(bits), mask((1u << bits) - 1), counters(1u << bits, 1),
+      history(0) {}
+
+    std::string Name() const override
+    {
+      return "gshare:" + std::to_string(bits);
+    }
+
+    bool predict(std::uint32_t address) const override
+    {
+      return Taken(counters[(Index(address) ^ history) & mask]);
+    }
+
+    void update(std::uint32_t address, bool taken) override
+    {
+      Count(counters[(Index(address) ^ history) & mask], taken);
+      history = ((history << 1) | (taken ? 1 : 0)) & mask;
+    }
+  };
+
+  class Tournament : public dlx::timing::DirectionPredictor
+  {
+    const unsigned int bits;
+    const std::uint32_t mask;
+    Bimodal local;
+    Gshare global;
+
+    // Chooses gshare in the upper two states.
+    std::vector<std::uint8_t> choosers;
+
+  public:
+    explicit Tournament(unsigned int bits)
+    : bits(bits), mask((1u << bits) - 1), local(bits), global(bits),
+      choosers(1u << bits, 1) {}
+
+    std::string Name() const override
+    {
+      return "tournament:" + std::to_string(bits);
+    }
+
+    bool predict(std::uint32_t address) const override
+    {
+      return Taken(choosers[Index(address) & mask]) ?
+        global.predict(address) : local.predict(address);
+    }
+
+    void update(std::uint32_t address, bool taken) override
+    {
+      // The chooser only learns when one of them was right and the other
+      // wrong.
+      const bool localRight = local.predict(address) == taken;
+      const bool globalRight = global.predict(address) == taken;
+      if (localRight != globalRight)
+      {
+        Count(choosers[Index(address) & mask], globalRight);
+      }
+
+      local.update(address, taken);
+      global.update(address, taken);
+    }
+  };
+
+  void WriteAccuracy(std::ostream& output, std::uint64_t misses,
+                     std::uint64_t total)
+  {
+    output << std::setw(8) << std::fixed << std::setprecision(2)
+           << (total ? 100.0 * (total - misses) / total : 100.0) << '%';
+  }
+}
+
+std::unique_ptr<dlx::timing::DirectionPredictor> dlx::timing::CreatePredictor(
+  const std::string& name)
+{
+  const std::size_t colon = name.find(':');
+  const std::string kind = name.substr(0, colon);
+
+  unsigned long bits = 12;
+  if (colon != std::string::npos)
+  {
+    char* rest;
+    bits = std::strtoul(name.c_str() + colon + 1, &rest, 10);
+    if (kind == "not-taken" || colon + 1 == name.size() || *rest != '\0' ||
+        bits < 1 || bits > 24)
+    {
+      throw std::invalid_argument(
+        "The bits of the predictor " + name + " must be from 1 to 24.");
+    }
+  }
+
+  if (kind == "not-taken")
+  {
+    return std::unique_ptr<DirectionPredictor>(new NotTaken);
+  }
+  else if (kind == "bimodal")
+  {
+    return std::unique_ptr<DirectionPredictor>(new Bimodal(bits));
+  }
+  else if (kind == "gshare")
+  {
+    return std::unique_ptr<DirectionPredictor>(new Gshare(bits));
+  }
+  else if (kind == "tournament")
+  {
+    return std::unique_ptr<DirectionPredictor>(new Tournament(bits));
+  }
+
+  throw std::invalid_argument("Unknown branch predictor '" + name + "'.");
+}
+
+dlx::timing::TargetPredictor::TargetPredictor(unsigned int bufferEntries,
+                                              unsigned int stackDepth)
+: buffer(),
+  returns(),
+  top(0),
+  depth(0),
+  returnCount(0),
+  returnMisses(0),
+  indirectCount(0),
+  indirectMisses(0)
+{
+  if (bufferEntries == 0 || (bufferEntries & (bufferEntries - 1)) != 0 ||
+      stackDepth == 0)
+  {
+    throw std::invalid_argument(
+      "The branch target buffer must have a power of two entries and the "
+      "return address stack at least one.");
+  }
+
+  const Entry empty = { 0, 0 };
+  buffer.assign(bufferEntries, empty);
+  returns.assign(stackDepth, 0);
+}
+
+bool dlx::timing::TargetPredictor::resolve(
+  const hardware::DecodedInstruction& instruction, std::uint32_t address,
+  std::uint32_t target)
+{
+  const auto operation = instruction.operation;
+  bool predicted = true;
+
+  if (operation == 18 && instruction.ri == 31) // jr r31
+  {
+    // An empty stack has nothing to predict with.
+    ++returnCount;
+    predicted = depth > 0 && returns[top] == target;
+    if (!predicted) ++returnMisses;
+    if (depth > 0)
+    {
+      top = (top == 0) ? returns.size() - 1 : top - 1;
+      --depth;
+    }
+  }
+  else if (operation == 18 || operation == 19) // jr and jalr
+  {
+    Entry& entry = buffer[Index(address) & (buffer.size() - 1)];
+    ++indirectCount;
+    predicted = entry.address == (address | 1) && entry.target == target;
+    if (!predicted) ++indirectMisses;
+    entry.address = address | 1;
+    entry.target = target;
+  }
+
+  if (operation == 3 || operation == 19) // jal and jalr
+  {
+    top = (top + 1 == returns.size()) ? 0 : top + 1;
+    returns[top] = address + 4;
+    if (depth < returns.size()) ++depth;
+  }
+
+  return predicted;
+}
+
+dlx::timing::BranchPredictors::BranchPredictors(unsigned int bufferEntries,
+                                                unsigned int stackDepth)
+: predictors(),
+  targets(bufferEntries, stackDepth),
+  siteIndices(),
+  sites(),
+  mispredictions(),
+  conditionalCount(0),
+  jumpCount(0)
+{
+}
+
+void dlx::timing::BranchPredictors::add(
+  std::unique_ptr<DirectionPredictor> predictor)
+{
+  if (!sites.empty())
+  {
+    throw std::logic_error(
+      "The predictors must be added before any branches are executed.");
+  }
+  predictors.push_back(std::move(predictor));
+}
+
+void dlx::timing::BranchPredictors::executed(
+  const hardware::Execution& execution)
+{
+  const hardware::DecodedInstruction& instruction = *execution.instruction;
+  const auto operation = instruction.operation;
+  if (operation < 2 || (operation > 5 && operation != 18 && operation != 19))
+  {
+    return;
+  }
+
+  // The row has a column for each predictor and the target predictor.
+  const std::size_t columns = predictors.size() + 1;
+  const auto inserted =
+    siteIndices.insert(std::make_pair(execution.address, sites.size()));
+  if (inserted.second)
+  {
+    const Site site = { execution.address, operation, 0, 0 };
+    sites.push_back(site);
+    mispredictions.resize(mispredictions.size() + columns, 0);
+  }
+
+  Site& site = sites[inserted.first->second];
+  std::uint64_t* const row = &mispredictions[inserted.first->second * columns];
+  const bool taken = execution.nextAddress != execution.address + 4;
+  ++site.executions;
+  if (taken) ++site.taken;
+
+  if (operation == 4 || operation == 5) // beqz and bnez
+  {
+    ++conditionalCount;
+    for (std::size_t i = 0; i < predictors.size(); ++i)
+    {
+      if (predictors[i]->predict(execution.address) != taken) ++row[i];
+      predictors[i]->update(execution.address, taken);
+    }
+  }
+  else
+  {
+    ++jumpCount;
+    if (!targets.resolve(instruction, execution.address,
+                         execution.nextAddress))
+    {
+      ++row[columns - 1];
+    }
+  }
+}
+
+std::uint64_t dlx::timing::BranchPredictors::Mispredictions(
+  std::size_t predictor) const
+{
+  const std::size_t columns = predictors.size() + 1;
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < sites.size(); ++i)
+  {
+    total += mispredictions[i * columns + predictor];
+  }
+  return total;
+}
+
+void dlx::timing::BranchPredictors::report(std::ostream& output,
+                                           unsigned int worst) const
+{
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+  const std::size_t columns = predictors.size() + 1;
+
+  output << "Branch prediction:\n"
+         << "  Predictor            Branches   Mispredicted   Accuracy\n";
+  for (std::size_t i = 0; i < predictors.size(); ++i)
+  {
+    const std::uint64_t misses = Mispredictions(i);
+    output << "  " << std::left << std::setw(16) << predictors[i]->Name()
+           << std::right << ' ' << std::setw(12) << conditionalCount << ' '
+           << std::setw(14) << misses << ' ';
+    WriteAccuracy(output, misses, conditionalCount);
+    output << '\n';
+  }
+  output << "  " << std::left << std::setw(16) << "return stack"
+         << std::right << ' ' << std::setw(12) << targets.ReturnCount() << ' '
+         << std::setw(14) << targets.ReturnMisses() << ' ';
+  WriteAccuracy(output, targets.ReturnMisses(), targets.ReturnCount());
+  output << "\n  " << std::left << std::setw(16) << "target buffer"
+         << std::right << ' ' << std::setw(12) << targets.IndirectCount()
+         << ' ' << std::setw(14) << targets.IndirectMisses() << ' ';
+  WriteAccuracy(output, targets.IndirectMisses(), targets.IndirectCount());
+  output << "\n  " << std::left << std::setw(16) << "j and jal"
+         << std::right << ' ' << std::setw(12)
+         << jumpCount - targets.ReturnCount() - targets.IndirectCount() << ' '
+         << std::setw(14) << 0 << ' ';
+  WriteAccuracy(output, 0, 0);
+  output << '\n';
+
+  // The branches by their most mispredictions by any predictor.
+  std::vector<std::size_t> order(sites.size());
+  for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+  const auto most = [this, columns](std::size_t site)
+  {
+    const std::uint64_t* const row = &mispredictions[site * columns];
+    return *std::max_element(row, row + columns);
+  };
+  const auto worse = [this, &most](std::size_t a, std::size_t b)
+  {
+    return most(a) > most(b) ||
+           (most(a) == most(b) && sites[a].address < sites[b].address);
+  };
+  const std::size_t count = std::min<std::size_t>(worst, order.size());
+  std::partial_sort(order.begin(), order.begin() + count, order.end(), worse);
+
+  output << "Branches with the most mispredictions (accuracy):\n"
+         << "  Address  Instruction   Executions     Taken";
+  for (const auto& predictor : predictors)
+  {
+    output << ' ' << std::setw(std::max<std::size_t>(9,
+                                                     predictor->Name().size()))
+           << predictor->Name();
+  }
+  output << "     target\n";
+
+  for (std::size_t i = 0; i < count && most(order[i]) > 0; ++i)
+  {
+    const Site& site = sites[order[i]];
+    const std::uint64_t* const row = &mispredictions[order[i] * columns];
+    const bool conditional = site.operation == 4 || site.operation == 5;
+
+    output << "  " << std::hex << std::setfill('0') << std::setw(8)
+           << site.address << std::dec << std::setfill(' ') << ' '
+           << std::left << std::setw(11)
+           << hardware::mnemonic(site.operation) << std::right << ' '
+           << std::setw(12) << site.executions << ' ';
+    WriteAccuracy(output, site.executions - site.taken, site.executions);
+    for (std::size_t j = 0; j < predictors.size(); ++j)
+    {
+      const std::size_t width =
+        std::max<std::size_t>(9, predictors[j]->Name().size());
+      if (conditional)
+      {
+        output << std::setw(width - 8) << "";
+        WriteAccuracy(output, row[j], site.executions);
+      }
+      else
+      {
+        output << ' ' << std::setw(width) << '-';
+      }
+    }
+    if (conditional)
+    {
+      output << ' ' << std::setw(10) << '-';
+    }
+    else
+    {
+      output << "  ";
+      WriteAccuracy(output, row[columns - 1], site.executions);
+    }
+    output << '\n';
+  }
+
+  output.flags(flags);
+  output.precision(precision);
+}
+
+//===--------------------------- End of the file --------------------------===//
@@ -0,0 +1,152 @@
+#ifndef DLX_BRANCHPREDICTOR_HPP_
+#define DLX_BRANCHPREDICTOR_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : BranchPredictor
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides models of predicting branches.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : A DirectionPredictor guesses whether beqz and bnez are taken
+//                before they are resolved, and the TargetPredictor guesses
+//                where jr and jalr go with a return address stack for jr r31
+//                and a branch target buffer for the others. The targets of j
+//                and jal are known once they are decoded.
+//
+//                The BranchPredictors observe the machine and give the same
+//                branches to any number of direction predictors, so they can
+//                be compared in a single run.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../hardware/Observer.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dlx
+{
+  namespace timing
+  {
+    class DirectionPredictor
+    {
+    public:
+      virtual ~DirectionPredictor() {}
+
+      // The name the predictor was created from, see CreatePredictor.
+      virtual std::string Name() const = 0;
+
+      // Returns true if the branch at the address is predicted to be taken.
+      virtual bool predict(std::uint32_t address) const = 0;
+
+      // Learns from whether the branch at the address was taken.
+      virtual void update(std::uint32_t address, bool taken) = 0;
+    };
+
+    // Creates the predictor given by one of:
+    //   not-taken        Always predicts not taken.
+    //   bimodal[:BITS]   A 2-bit counter for each of 2^BITS branch addresses.
+    //   gshare[:BITS]    A 2-bit counter for each of 2^BITS branch addresses
+    //                    exclusive or'd with the outcome of the last BITS
+    //                    branches.
+    //   tournament[:BITS]
+    //                    A bimodal and gshare predictor with a 2-bit counter
+    //                    for each branch address choosing between them.
+    // BITS is from 1 to 24, and 12 if it is left out.
+    //
+    // Throws std::invalid_argument if it is none of them.
+    std::unique_ptr<DirectionPredictor> CreatePredictor(
+      const std::string& name);
+
+    class TargetPredictor
+    {
+      // The address of the jump with 1 as a valid flag, and its target.
+      struct Entry
+      {
+        std::uint32_t address;
+        std::uint32_t target;
+      };
+
+      std::vector<Entry> buffer;
+
+      // A circular stack, where the oldest return address is lost when a
+      // call is made with it full.
+      std::vector<std::uint32_t> returns;
+      unsigned int top;
+      unsigned int depth;
+
+      std::uint64_t returnCount;
+      std::uint64_t returnMisses;
+      std::uint64_t indirectCount;
+      std::uint64_t indirectMisses;
+
+    public:
+      // Throws std::invalid_argument if there are no entries in the buffer
+      // or stack, or the entries in the buffer are not a power of two.
+      TargetPredictor(unsigned int bufferEntries, unsigned int stackDepth);
+
+      // Predicts the target of the jump at the address and learns where it
+      // went, returning true if it was predicted. Calls made by jal and jalr
+      // are pushed on the stack.
+      bool resolve(const hardware::DecodedInstruction& instruction,
+                   std::uint32_t address, std::uint32_t target);
+
+      std::uint64_t ReturnCount() const { return returnCount; }
+      std::uint64_t ReturnMisses() const { return returnMisses; }
+      std::uint64_t IndirectCount() const { return indirectCount; }
+      std::uint64_t IndirectMisses() const { return indirectMisses; }
+    };
+
+    class BranchPredictors : public hardware::Observer
+    {
+      std::vector<std::unique_ptr<DirectionPredictor>> predictors;
+      TargetPredictor targets;
+
+      // A branch or jump in the program, with the mispredictions of each
+      // predictor in a row of mispredictions.
+      struct Site
+      {
+        std::uint32_t address;
+        std::uint8_t operation;
+        std::uint64_t executions;
+        std::uint64_t taken;
+      };
+
+      std::unordered_map<std::uint32_t, std::size_t> siteIndices;
+      std::vector<Site> sites;
+      std::vector<std::uint64_t> mispredictions;
+
+      std::uint64_t conditionalCount;
+      std::uint64_t jumpCount;
+
+    public:
+      // Throws std::invalid_argument, see TargetPredictor.
+      BranchPredictors(unsigned int bufferEntries, unsigned int stackDepth);
+
+      void add(std::unique_ptr<DirectionPredictor> predictor);
+
+      void executed(const hardware::Execution& execution) override;
+
+      std::size_t PredictorCount() const { return predictors.size(); }
+      const TargetPredictor& Targets() const { return targets; }
+
+      // The number of beqz and bnez executed, and the number of those the
+      // predictor got wrong.
+      std::uint64_t ConditionalCount() const { return conditionalCount; }
+      std::uint64_t Mispredictions(std::size_t predictor) const;
+
+      // Writes the accuracy of each predictor, followed by the given number
+      // of the branches with the most mispredictions.
+      void report(std::ostream& output, unsigned int worst) const;
+    };
+  }
+}
+
+#endif
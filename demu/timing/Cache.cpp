@@ -0,0 +1,349 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Cache
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides a model of the caches between the processor and
+//                memory.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the look-up and replacement of the lines.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Cache.hpp"
+
+#include "../hardware/Decoder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+  bool IsPowerOfTwo(std::uint64_t value)
+  {
+    return value != 0 && (value & (value - 1)) == 0;
+  }
+
+  unsigned int Log2(std::uint64_t value)
+  {
+    unsigned int bits = 0;
+    while (value >>= 1) ++bits;
+    return bits;
+  }
+
+  // A 4-bit value in each nibble.
+  const std::uint64_t Nibbles = 0x1111111111111111ull;
+
+  // Returns the position of the lowest nibble of value which is zero, which
+  // there must be one of.
+  unsigned int LowestZeroNibble(std::uint64_t value)
+  {
+    // Only the lowest zero nibble is sure to be found, as the borrow out of
+    // it may make those above look like zero as well.
+    const std::uint64_t zeros = (value - Nibbles) & ~value & (Nibbles << 3);
+    return __builtin_ctzll(zeros) / 4;
+  }
+
+  void WriteRate(std::ostream& output, std::uint64_t count,
+                 std::uint64_t total)
+  {
+    output << std::setw(7) << std::fixed << std::setprecision(2)
+           << (total ? 100.0 * count / total : 0.0) << '%';
+  }
+}
+
+dlx::timing::CacheConfiguration dlx::timing::ParseCacheConfiguration(
+  const std::string& text)
+{
+  CacheConfiguration configuration = {
+    0, 0, 0, Replacement::LeastRecentlyUsed, WritePolicy::WriteBack,
+  };
+
+  std::size_t start = 0;
+  for (unsigned int field = 0; start <= text.size(); ++field)
+  {
+    std::size_t end = text.find(',', start);
+    if (end == std::string::npos) end = text.size();
+    const std::string value = text.substr(start, end - start);
+    start = end + 1;
+
+    if (field < 3)
+    {
+      char* rest;
+      unsigned long number = std::strtoul(value.c_str(), &rest, 0);
+      if (field == 0 && (*rest == 'K' || *rest == 'k')) number <<= 10, ++rest;
+      else if (field == 0 && (*rest == 'M' || *rest == 'm'))
+      {
+        number <<= 20;
+        ++rest;
+      }
+
+      if (value.empty() || *rest != '\0' || number > 0xFFFFFFFFul)
+      {
+        throw std::invalid_argument("The cache size, ways and line size must "
+                                    "be numbers, not '" + value + "'.");
+      }
+
+      if (field == 0) configuration.size = number;
+      else if (field == 1) configuration.ways = number;
+      else configuration.lineSize = number;
+    }
+    else if (value == "lru")
+    {
+      configuration.replacement = Replacement::LeastRecentlyUsed;
+    }
+    else if (value == "fifo")
+    {
+      configuration.replacement = Replacement::FirstInFirstOut;
+    }
+    else if (value == "random")
+    {
+      configuration.replacement = Replacement::Random;
+    }
+    else if (value == "wb")
+    {
+      configuration.writePolicy = WritePolicy::WriteBack;
+    }
+    else if (value == "wt")
+    {
+      configuration.writePolicy = WritePolicy::WriteThrough;
+    }
+    else
+    {
+      throw std::invalid_argument("Unknown cache policy '" + value + "'.");
+    }
+  }
+
+  if (configuration.lineSize == 0)
+  {
+    throw std::invalid_argument(
+      "A cache is given by its size, ways and line size.");
+  }
+  return configuration;
+}
+
+dlx::timing::Cache::Cache(const CacheConfiguration& configuration,
+                          Cache* next)
+: configuration(configuration),
+  lineBits(Log2(configuration.lineSize)),
+  setMask(configuration.ways && configuration.lineSize ?
+          configuration.size / configuration.ways / configuration.lineSize - 1 :
+          0),
+  lines(),
+  orders(),
+  next(next),
+  randomState(0x12345678),
+  reads(0),
+  readMisses(0),
+  writes(0),
+  writeMisses(0),
+  writeBacks(0)
+{
+  if (!IsPowerOfTwo(configuration.size) ||
+      !IsPowerOfTwo(configuration.ways) ||
+      !IsPowerOfTwo(configuration.lineSize) ||
+      configuration.ways > 16 || configuration.lineSize < 4 ||
+      configuration.size < configuration.ways * configuration.lineSize)
+  {
+    throw std::invalid_argument(
+      "The size, ways and line size of a cache must be powers of two, with "
+      "up to 16 ways, lines of at least 4 bytes and at least one set.");
+  }
+
+  const std::uint32_t sets = setMask + 1;
+  lines.assign(static_cast<std::size_t>(sets) * configuration.ways, 0);
+
+  // The ways start off in order with the first being the most recent.
+  std::uint64_t order = 0;
+  for (unsigned int way = configuration.ways; way-- > 0;)
+  {
+    order = (order << 4) | way;
+  }
+  orders.assign(sets, order);
+}
+
+void dlx::timing::Cache::touch(std::uint32_t set, unsigned int way)
+{
+  std::uint64_t& order = orders[set];
+
+  // Find where the way is by making its nibble zero, with those past the
+  // last way made non-zero.
+  const unsigned int ways = configuration.ways;
+  const std::uint64_t unused =
+    (ways == 16) ? 0 : (Nibbles << (4 * ways)) & (Nibbles << 3);
+  const unsigned int position =
+    LowestZeroNibble((order ^ (Nibbles * way)) | unused);
+
+  // Shift the ways before it along and put it at the front.
+  const std::uint64_t before =
+    order & ((std::uint64_t(1) << (4 * position)) - 1);
+  const std::uint64_t after = (position == 15) ? 0 :
+    order & ~((std::uint64_t(1) << (4 * (position + 1))) - 1);
+  order = after | (before << 4) | way;
+}
+
+unsigned int dlx::timing::Cache::victim(std::uint32_t set)
+{
+  const std::uint32_t* const ways = &lines[set * configuration.ways];
+  for (unsigned int way = 0; way < configuration.ways; ++way)
+  {
+    if (!(ways[way] & Valid)) return way;
+  }
+
+  if (configuration.replacement == Replacement::Random)
+  {
+    // Xorshift, which is good enough to pick a way.
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState & (configuration.ways - 1);
+  }
+
+  // The last in the order is the least recently used, or the first in.
+  return (orders[set] >> (4 * (configuration.ways - 1))) & 0xF;
+}
+
+bool dlx::timing::Cache::access(std::uint32_t address, bool write)
+{
+  const std::uint32_t line = address & ~((1u << lineBits) - 1);
+  const std::uint32_t set = (address >> lineBits) & setMask;
+  std::uint32_t* const ways = &lines[set * configuration.ways];
+  const bool writeBack = configuration.writePolicy == WritePolicy::WriteBack;
+
+  if (write) ++writes;
+  else ++reads;
+
+  for (unsigned int way = 0; way < configuration.ways; ++way)
+  {
+    if ((ways[way] & ~(Valid | Dirty)) == line && (ways[way] & Valid))
+    {
+      if (configuration.replacement == Replacement::LeastRecentlyUsed)
+      {
+        touch(set, way);
+      }
+
+      if (write && writeBack) ways[way] |= Dirty;
+      else if (write && next) next->access(address, true);
+      return true;
+    }
+  }
+
+  if (write) ++writeMisses;
+  else ++readMisses;
+
+  if (write && !writeBack)
+  {
+    if (next) next->access(address, true);
+    return false;
+  }
+
+  const unsigned int way = victim(set);
+  if ((ways[way] & (Valid | Dirty)) == (Valid | Dirty))
+  {
+    ++writeBacks;
+    if (next) next->access(ways[way] & ~(Valid | Dirty), true);
+  }
+
+  if (next) next->access(address, false);
+  ways[way] = line | Valid | (write ? Dirty : 0);
+  if (configuration.replacement != Replacement::Random) touch(set, way);
+  return false;
+}
+
+dlx::timing::CacheHierarchy::CacheHierarchy(
+  const CacheConfiguration& instructionCache,
+  const CacheConfiguration& dataCache,
+  const CacheConfiguration* level2Cache)
+: level2(level2Cache ? new Cache(*level2Cache, nullptr) : nullptr),
+  instructions(instructionCache, level2.get()),
+  data(dataCache, level2.get()),
+  misses()
+{
+}
+
+void dlx::timing::CacheHierarchy::executed(
+  const hardware::Execution& execution)
+{
+  Misses& counts = misses[execution.address];
+  ++counts.executions;
+
+  const std::uint64_t level2Misses = level2 ? level2->Misses() : 0;
+
+  if (!instructions.access(execution.address, false)) ++counts.instruction;
+
+  const hardware::DecodedInstruction& instruction = *execution.instruction;
+  const bool store = hardware::isStore(instruction);
+  if (store || hardware::isLoad(instruction))
+  {
+    if (!data.access(execution.effectiveAddress, store)) ++counts.data;
+  }
+
+  if (level2) counts.level2 += level2->Misses() - level2Misses;
+}
+
+void dlx::timing::CacheHierarchy::report(std::ostream& output,
+                                         unsigned int worst) const
+{
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+
+  output << "Caches:\n"
+         << "  Cache      Accesses       Misses  Miss rate   Write backs\n";
+  const std::pair<const char*, const Cache*> caches[] = {
+    std::make_pair("L1I", &instructions),
+    std::make_pair("L1D", &data),
+    std::make_pair("L2", level2.get()),
+  };
+  for (auto cache : caches)
+  {
+    if (!cache.second) continue;
+    output << "  " << std::left << std::setw(5) << cache.first << std::right
+           << std::setw(12) << cache.second->Accesses() << ' '
+           << std::setw(12) << cache.second->Misses() << "   ";
+    WriteRate(output, cache.second->Misses(), cache.second->Accesses());
+    output << ' ' << std::setw(13) << cache.second->WriteBacks() << '\n';
+  }
+
+  // The addresses with the most misses at any level, then by address.
+  std::vector<std::pair<std::uint32_t, Misses>> sorted(misses.begin(),
+                                                       misses.end());
+  const auto total = [](const Misses& counts)
+  {
+    return counts.instruction + counts.data + counts.level2;
+  };
+  const auto worse =
+    [&total](const std::pair<std::uint32_t, Misses>& a,
+             const std::pair<std::uint32_t, Misses>& b)
+    {
+      return total(a.second) > total(b.second) ||
+             (total(a.second) == total(b.second) && a.first < b.first);
+    };
+  const std::size_t count = std::min<std::size_t>(worst, sorted.size());
+  std::partial_sort(sorted.begin(), sorted.begin() + count, sorted.end(),
+                    worse);
+
+  output << "Addresses with the most misses:\n"
+         << "  Address     Executions   L1I misses   L1D misses    L2 misses\n";
+  for (std::size_t i = 0; i < count && total(sorted[i].second) > 0; ++i)
+  {
+    const Misses& counts = sorted[i].second;
+    output << "  " << std::hex << std::setfill('0') << std::setw(8)
+           << sorted[i].first << std::dec << std::setfill(' ')
+           << ' ' << std::setw(14) << counts.executions
+           << ' ' << std::setw(12) << counts.instruction
+           << ' ' << std::setw(12) << counts.data
+           << ' ' << std::setw(12) << counts.level2 << '\n';
+  }
+
+  output.flags(flags);
+  output.precision(precision);
+}
+
+//===--------------------------- End of the file --------------------------===//
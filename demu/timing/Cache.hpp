@@ -0,0 +1,167 @@
+#ifndef DLX_CACHE_HPP_
+#define DLX_CACHE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Cache
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides a model of the caches between the processor and
+//                memory.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : A set-associative cache keeps the address of the line in
+//                each way, with the low bits that would be the offset into
+//                the line used for its valid and dirty flags, so the ways of
+//                a set are a single run of words to search.
+//
+//                The order the ways of a set were used in is kept as a 4-bit
+//                way number for each of them in a 64-bit word, most recent
+//                first, so a cache can have up to 16 ways.
+//
+//                The CacheHierarchy has instruction and data caches, which
+//                may be followed by a unified second level cache, fed with
+//                the instruction fetches and loads and stores as the machine
+//                executes them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../hardware/Observer.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dlx
+{
+  namespace timing
+  {
+    // The way replaced when a line is brought into a full set.
+    enum class Replacement
+    {
+      LeastRecentlyUsed,
+      FirstInFirstOut,
+      Random,
+    };
+
+    enum class WritePolicy
+    {
+      // Writes only go to the next level when a modified line is replaced,
+      // and a write which misses brings the line into the cache.
+      WriteBack,
+
+      // Writes go to the next level straight away, and a write which misses
+      // does not bring the line into the cache.
+      WriteThrough,
+    };
+
+    struct CacheConfiguration
+    {
+      std::uint32_t size;     // In bytes.
+      unsigned int ways;      // From 1 to 16.
+      unsigned int lineSize;  // In bytes, at least 4.
+      Replacement replacement;
+      WritePolicy writePolicy;
+    };
+
+    // Reads the configuration from SIZE,WAYS,LINE followed by any of lru,
+    // fifo, random, wb and wt separated by commas, where the size may end in
+    // K or M.
+    //
+    // Throws std::invalid_argument if it is not valid.
+    CacheConfiguration ParseCacheConfiguration(const std::string& text);
+
+    class Cache
+    {
+      static const std::uint32_t Valid = 1;
+      static const std::uint32_t Dirty = 2;
+
+      const CacheConfiguration configuration;
+      const unsigned int lineBits;
+      const std::uint32_t setMask;
+
+      // The address of the line in each way of each set, along with the
+      // Valid and Dirty flags.
+      std::vector<std::uint32_t> lines;
+
+      // The ways of each set from the most to least recently used, or
+      // brought in for FirstInFirstOut.
+      std::vector<std::uint64_t> orders;
+
+      // The cache the misses and write backs go to, or nullptr for memory.
+      Cache* const next;
+
+      std::uint32_t randomState;
+
+      std::uint64_t reads;
+      std::uint64_t readMisses;
+      std::uint64_t writes;
+      std::uint64_t writeMisses;
+      std::uint64_t writeBacks;
+
+      // Moves the way to the front of the order of the set.
+      void touch(std::uint32_t set, unsigned int way);
+
+      // Returns the way to bring a line into for the set.
+      unsigned int victim(std::uint32_t set);
+
+    public:
+      // Throws std::invalid_argument if the size, ways and line size are not
+      // powers of two, the size is not a multiple of the ways by the line
+      // size or there are more than 16 ways.
+      Cache(const CacheConfiguration& configuration, Cache* next);
+
+      // Reads or writes the byte at the address, returning true if it was
+      // in the cache.
+      bool access(std::uint32_t address, bool write);
+
+      std::uint64_t Accesses() const { return reads + writes; }
+      std::uint64_t Misses() const { return readMisses + writeMisses; }
+      std::uint64_t WriteBacks() const { return writeBacks; }
+    };
+
+    class CacheHierarchy : public hardware::Observer
+    {
+      // The level 2 cache is created first as the others refer to it.
+      std::unique_ptr<Cache> level2;
+      Cache instructions;
+      Cache data;
+
+      // The misses of each level caused by the instruction at an address.
+      struct Misses
+      {
+        std::uint64_t executions;
+        std::uint64_t instruction;
+        std::uint64_t data;
+        std::uint64_t level2;
+      };
+
+      std::unordered_map<std::uint32_t, Misses> misses;
+
+    public:
+      // Creates the caches, without a second level cache if level2 is
+      // nullptr.
+      //
+      // Throws std::invalid_argument, see Cache.
+      CacheHierarchy(const CacheConfiguration& instructionCache,
+                     const CacheConfiguration& dataCache,
+                     const CacheConfiguration* level2Cache);
+
+      void executed(const hardware::Execution& execution) override;
+
+      const Cache& InstructionCache() const { return instructions; }
+      const Cache& DataCache() const { return data; }
+      const Cache* Level2Cache() const { return level2.get(); }
+
+      // Writes the accesses and misses of each cache, followed by the given
+      // number of the addresses with the most misses.
+      void report(std::ostream& output, unsigned int worst) const;
+    };
+  }
+}
+
+#endif
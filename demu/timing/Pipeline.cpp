@@ -0,0 +1,348 @@
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Pipeline
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides the timing of the classic five stage pipeline.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Implements the hazards between the instructions.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Pipeline.hpp"
+
+#include "../hardware/Decoder.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+namespace
+{
+  // The number of cycles after being fetched that an instruction is in the
+  // stage.
+  unsigned int Offset(dlx::timing::Stage stage)
+  {
+    return static_cast<unsigned int>(stage);
+  }
+
+  const char* StageName(dlx::timing::Stage stage)
+  {
+    static const char* const names[] = { "IF", "ID", "EX", "MEM", "WB" };
+    return names[Offset(stage)];
+  }
+
+  // The registers are numbered with r0 to r31 first, then f0 to f31 and last
+  // the fpsr, so the hazards on each of them are worked out the same way.
+  const unsigned int FloatRegisters = 32;
+  const unsigned int StatusRegister = 64;
+
+  // A register the instruction reads and the stage it is first needed in.
+  struct Source
+  {
+    unsigned int reg;
+    dlx::timing::Stage stage;
+  };
+
+  // Fills in the floating point register read in the stage, or both of the
+  // registers of its pair for a double, returning how many there are.
+  unsigned int FloatSources(unsigned int reg, bool isDouble,
+                            dlx::timing::Stage stage, Source* sources)
+  {
+    sources[0].reg = FloatRegisters + (isDouble ? reg & ~1u : reg);
+    sources[0].stage = stage;
+    if (!isDouble) return 1;
+
+    sources[1].reg = sources[0].reg + 1;
+    sources[1].stage = stage;
+    return 2;
+  }
+
+  // Fills in the registers the instruction reads when there is forwarding,
+  // returning how many there are.
+  unsigned int Sources(const dlx::hardware::DecodedInstruction& instruction,
+                       dlx::timing::Stage branchStage, Source sources[4])
+  {
+    using dlx::timing::Stage;
+
+    const auto operation = instruction.operation;
+    switch (operation)
+    {
+      case 2: // j
+      case 3: // jal
+      case 15: // lhi
+      case 16: // rfe
+      case 17: // trap
+        return 0;
+      case 4: // beqz
+      case 5: // bnez
+      case 18: // jr
+      case 19: // jalr
+        sources[0].reg = instruction.ri;
+        sources[0].stage = branchStage;
+        return 1;
+      case 6: // bfpt
+      case 7: // bfpf
+        sources[0].reg = StatusRegister;
+        sources[0].stage = branchStage;
+        return 1;
+      case 46: // sf
+      case 47: // sd
+        sources[0].reg = instruction.ri;
+        sources[0].stage = Stage::Execute;
+        return 1 + FloatSources(instruction.rj, operation == 47,
+                                Stage::Memory, sources + 1);
+      case 114: // movf
+      case 115: // movd
+      case 116: // movfp2i
+        return FloatSources(instruction.rj, operation == 115, Stage::Execute,
+                            sources);
+      case 117: // movi2fp
+        sources[0].reg = instruction.rj;
+        sources[0].stage = Stage::Execute;
+        return 1;
+      case 136: // cvtf2d
+      case 137: // cvtf2i
+      case 138: // cvtd2f
+      case 139: // cvtd2i
+      case 140: // cvti2f
+      case 141: // cvti2d
+        return FloatSources(instruction.rj,
+                            operation == 138 || operation == 139,
+                            Stage::Execute, sources);
+      case 142: // mult
+      case 143: // div
+      case 150: // multu
+      case 151: // divu
+        sources[0].reg = instruction.ri;
+        sources[0].stage = Stage::Execute;
+        sources[1].reg = instruction.rj;
+        sources[1].stage = Stage::Execute;
+        return 2;
+    }
+
+    if (dlx::hardware::isStore(instruction))
+    {
+      // The value stored is only needed once the address has been worked out.
+      sources[0].reg = instruction.ri;
+      sources[0].stage = Stage::Execute;
+      sources[1].reg = instruction.rj;
+      sources[1].stage = Stage::Memory;
+      return 2;
+    }
+
+    if (operation >= 64 && operation < 128)
+    {
+      // nop, halt, wait and movs2i don't read the general registers.
+      if (instruction.modifier <= 2 || instruction.modifier == 49) return 0;
+
+      sources[0].reg = instruction.ri;
+      sources[0].stage = Stage::Execute;
+      sources[1].reg = instruction.rj;
+      sources[1].stage = Stage::Execute;
+      return 2;
+    }
+
+    if (operation >= 8 && operation < 64)
+    {
+      sources[0].reg = instruction.ri;
+      sources[0].stage = Stage::Execute;
+      return 1;
+    }
+
+    // The floating point arithmetic and compares, of fi and fj.
+    if (operation >= 128 && operation < 158)
+    {
+      const bool isDouble =
+        (operation >= 132 && operation < 136) || operation >= 152;
+      const unsigned int count =
+        FloatSources(instruction.ri, isDouble, Stage::Execute, sources);
+      return count + FloatSources(instruction.rj, isDouble, Stage::Execute,
+                                  sources + count);
+    }
+
+    return 0;
+  }
+
+  // Fills in the floating point register written, or both of the registers
+  // of its pair for a double, returning how many there are.
+  unsigned int FloatTargets(unsigned int reg, bool isDouble,
+                            unsigned int targets[2])
+  {
+    targets[0] = FloatRegisters + (isDouble ? reg & ~1u : reg);
+    if (!isDouble) return 1;
+
+    targets[1] = targets[0] + 1;
+    return 2;
+  }
+
+  // Fills in the registers the instruction writes, returning how many there
+  // are.
+  unsigned int Targets(const dlx::hardware::DecodedInstruction& instruction,
+                       unsigned int targets[2])
+  {
+    const auto operation = instruction.operation;
+    switch (operation)
+    {
+      case 38: // lf
+      case 39: // ld
+        return FloatTargets(instruction.rj, operation == 39, targets);
+      case 114: // movf
+      case 115: // movd
+      case 117: // movi2fp
+        return FloatTargets(instruction.rk, operation == 115, targets);
+      case 136: // cvtf2d
+      case 137: // cvtf2i
+      case 138: // cvtd2f
+      case 139: // cvtd2i
+      case 140: // cvti2f
+      case 141: // cvti2d
+        return FloatTargets(instruction.rk,
+                            operation == 136 || operation == 141, targets);
+    }
+
+    if (operation >= 128 && operation < 136)
+    {
+      return FloatTargets(instruction.rk, operation >= 132, targets);
+    }
+
+    if ((operation >= 144 && operation < 150) ||
+        (operation >= 152 && operation < 158))
+    {
+      targets[0] = StatusRegister;
+      return 1;
+    }
+
+    targets[0] = dlx::hardware::destinationRegister(instruction);
+    return targets[0] != 0 ? 1 : 0;
+  }
+}
+
+dlx::timing::Pipeline::Pipeline(const PipelineConfiguration& configuration)
+: configuration(configuration),
+  nextFetch(0),
+  lastFetch(0),
+  instructions(0),
+  dataStalls(0),
+  loadStalls(0),
+  controlStalls(0)
+{
+  if (configuration.branchStage != Stage::Decode &&
+      configuration.branchStage != Stage::Execute &&
+      configuration.branchStage != Stage::Memory)
+  {
+    throw std::invalid_argument(
+      "The branches must be resolved in the ID, EX or MEM stage.");
+  }
+
+  std::fill(ready, ready + RegisterCount, 0);
+  std::fill(loaded, loaded + RegisterCount, false);
+}
+
+void dlx::timing::Pipeline::executed(const hardware::Execution& execution)
+{
+  const hardware::DecodedInstruction& instruction = *execution.instruction;
+
+  Source sources[4];
+  const unsigned int sourceCount =
+    Sources(instruction, configuration.branchStage, sources);
+
+  // Hold the instruction back until the registers it reads are available in
+  // the stage it reads them. Without forwarding they are all read by ID.
+  std::uint64_t fetch = nextFetch;
+  bool waitedForLoad = false;
+  for (unsigned int i = 0; i < sourceCount; ++i)
+  {
+    const unsigned int reg = sources[i].reg;
+    if (reg == 0) continue;
+
+    const unsigned int needed = configuration.forwarding ?
+      Offset(sources[i].stage) : Offset(Stage::Decode);
+    if (ready[reg] > fetch + needed)
+    {
+      fetch = ready[reg] - needed;
+      waitedForLoad = loaded[reg];
+    }
+  }
+
+  if (waitedForLoad)
+  {
+    loadStalls += fetch - nextFetch;
+  }
+  else
+  {
+    dataStalls += fetch - nextFetch;
+  }
+
+  // The result can be forwarded from the end of EX, or MEM for a load, else
+  // it is written by WB in time for ID to read it in the same cycle.
+  unsigned int targets[2];
+  const unsigned int targetCount = Targets(instruction, targets);
+  const bool load = hardware::isLoad(instruction);
+  for (unsigned int i = 0; i < targetCount; ++i)
+  {
+    const unsigned int target = targets[i];
+    if (configuration.forwarding)
+    {
+      ready[target] =
+        fetch + Offset(load ? Stage::Memory : Stage::Execute) + 1;
+    }
+    else
+    {
+      ready[target] = fetch + Offset(Stage::WriteBack);
+    }
+    loaded[target] = load;
+  }
+
+  ++instructions;
+  lastFetch = fetch;
+  nextFetch = fetch + 1;
+
+  // The instructions fetched after a taken branch or jump until it has been
+  // resolved are thrown away.
+  if (execution.nextAddress != execution.address + 4)
+  {
+    const bool jump =
+      instruction.operation == 2 || instruction.operation == 3;
+    const unsigned int penalty =
+      jump ? Offset(Stage::Decode) : Offset(configuration.branchStage);
+    nextFetch += penalty;
+    controlStalls += penalty;
+  }
+}
+
+void dlx::timing::Pipeline::report(std::ostream& output) const
+{
+  const std::uint64_t cycles = CycleCount();
+  const auto percentOfCycles = [cycles](std::uint64_t count)
+  {
+    return cycles ? 100.0 * count / cycles : 0.0;
+  };
+
+  const auto flags = output.flags();
+  const auto precision = output.precision();
+  output << "Pipeline (" << (configuration.forwarding ? "" : "no ")
+         << "forwarding, branches resolved in "
+         << StageName(configuration.branchStage) << "):\n"
+         << std::fixed << std::setprecision(2)
+         << "  Instructions   " << std::setw(12) << instructions << '\n'
+         << "  Cycles         " << std::setw(12) << cycles << '\n'
+         << "  CPI            " << std::setw(12)
+         << (instructions ? static_cast<double>(cycles) / instructions : 0.0)
+         << '\n'
+         << "  Stalls:\n"
+         << "    Data         " << std::setw(12) << dataStalls << ' '
+         << std::setw(6) << percentOfCycles(dataStalls) << "%\n"
+         << "    Load-use     " << std::setw(12) << loadStalls << ' '
+         << std::setw(6) << percentOfCycles(loadStalls) << "%\n"
+         << "    Control      " << std::setw(12) << controlStalls << ' '
+         << std::setw(6) << percentOfCycles(controlStalls) << "%\n";
+  output.flags(flags);
+  output.precision(precision);
+}
+
+//===--------------------------- End of the file --------------------------===//
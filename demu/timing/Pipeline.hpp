@@ -0,0 +1,116 @@
+#ifndef DLX_PIPELINE_HPP_
+#define DLX_PIPELINE_HPP_
+//===----------------------------------------------------------------------===//
+//
+//                       DLX Instruction Set Emulator
+//
+// NAME         : Pipeline
+// NAMESPACE    : dlx::timing
+// PURPOSE      : Provides the timing of the classic five stage pipeline.
+// COPYRIGHT    : (c) 2015 Sean Donnellan.
+// LICENSE      : The MIT License (see LICENSE.txt)
+// AUTHORS      : Sean Donnellan (darkdonno@gmail.com)
+// DESCRIPTION  : Works out the cycle each instruction would be fetched in by
+//                the IF, ID, EX, MEM, WB pipeline of Hennessy and Patterson,
+//                from the instructions the machine executes.
+//
+//                An instruction is held in ID until the registers it reads
+//                are available, which with forwarding is once the EX stage
+//                of the instruction writing them has finished, or MEM for a
+//                load. Without forwarding it is once the WB stage has
+//                written them, which is read by ID in the same cycle.
+//
+//                The floating point operations take a single cycle in EX the
+//                same as the integer ones, and a double waits for both of the
+//                registers of its pair. bfpt and bfpf wait for the compare
+//                setting the fpsr as the other branches wait for ri.
+//
+//                The instructions following a branch are fetched as if it is
+//                not taken, so a taken branch throws away those fetched
+//                before the stage it is resolved in. A jump is known in ID.
+//
+//                The instruction and data memory are separate and every
+//                access takes a single cycle.
+//
+//===----------------------------------------------------------------------===//
+
+#include "../hardware/Observer.hpp"
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace dlx
+{
+  namespace timing
+  {
+    // The stages in the order the instructions go through them.
+    enum class Stage
+    {
+      Fetch,     // IF
+      Decode,    // ID
+      Execute,   // EX
+      Memory,    // MEM
+      WriteBack, // WB
+    };
+
+    struct PipelineConfiguration
+    {
+      bool forwarding;
+
+      // The stage the conditional branches and jumps to a register are
+      // resolved in, which is Decode, Execute or Memory.
+      Stage branchStage;
+    };
+
+    class Pipeline : public hardware::Observer
+    {
+      const PipelineConfiguration configuration;
+
+      // The cycle each register can first be used in by the stage which
+      // reads it, and whether it was written by a load. The general
+      // registers are followed by the floating point ones and the fpsr.
+      static const unsigned int RegisterCount = 65;
+      std::uint64_t ready[RegisterCount];
+      bool loaded[RegisterCount];
+
+      // The cycle the next instruction can be fetched in.
+      std::uint64_t nextFetch;
+
+      // The cycle the last instruction was fetched in.
+      std::uint64_t lastFetch;
+
+      std::uint64_t instructions;
+      std::uint64_t dataStalls;
+      std::uint64_t loadStalls;
+      std::uint64_t controlStalls;
+
+    public:
+      // Throws std::invalid_argument if the branches are resolved in a stage
+      // other than Decode, Execute or Memory.
+      explicit Pipeline(const PipelineConfiguration& configuration);
+
+      void executed(const hardware::Execution& execution) override;
+
+      std::uint64_t InstructionCount() const { return instructions; }
+
+      // Returns the number of cycles until the last instruction has left the
+      // pipeline.
+      std::uint64_t CycleCount() const
+      {
+        return instructions ? lastFetch + 5 : 0;
+      }
+
+      // The cycles lost waiting for the result of an instruction other than
+      // a load, waiting for a load and fetching instructions after a taken
+      // branch or jump which weren't to be executed.
+      std::uint64_t DataStalls() const { return dataStalls; }
+      std::uint64_t LoadStalls() const { return loadStalls; }
+      std::uint64_t ControlStalls() const { return controlStalls; }
+
+      // Writes the cycles, cycles per instruction and the stalls.
+      void report(std::ostream& output) const;
+    };
+  }
+}
+
+#endif